@@ -23,6 +23,7 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "VLSG.h"
 
@@ -34,10 +35,24 @@
 #define INLINE inline
 #endif
 
+#if defined(__GNUC__)
+#define STORE_RELEASE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#else
+#define STORE_RELEASE(var, value) ((var) = (value))
+#define LOAD_ACQUIRE(var) (var)
+#endif
+
 
 #define MIDI_CHANNELS 16
 #define DRUM_CHANNEL 9
 #define MAX_VOICES 64
+// samples after the last voice until the reverb state decays to zero - measured by running the reverb's integer arithmetic
+// on random input: less than 36000 samples at the full output level, less than 40000 samples at the level of 64 voices
+// (the comb filters feed back through 2000 sample delays with gain below 0.5), the value is rounded up for margin
+#define REVERB_TAIL_SAMPLES 65536
+// MIDI events are processed this many milliseconds after their time (value used by VLSG.DLL)
+#define DEFAULT_EVENT_DELAY 100
 
 
 typedef struct
@@ -126,42 +141,58 @@ enum Channel_Flags
 
 
 static const char VLSG_Name[] = "CASIO SW-10";
-static uint32_t (*VLSG_GetTime)(void);
-
-static uint32_t dword_C0000000;
-static uint32_t dword_C0000004;
-static uint32_t dword_C0000008;
-static int32_t output_size_para;
-static uint32_t system_time_2;
-static uint8_t event_data[32];
-static int32_t recent_voice_index;
-static struc_6 *stru6_ptr;
-static Channel_Data *channel_data_ptr;
-static uint32_t event_type;
-static int32_t event_length;
-static int32_t reverb_data_buffer[32768];
-static uint32_t reverb_data_index;
-static int32_t is_reverb_enabled;
-static uint32_t reverb_shift;
-static volatile uint32_t midi_data_read_index;
-static uint8_t midi_data_buffer[65536];
-static volatile uint32_t midi_data_write_index;
-static uint32_t processing_phase;
-static uint32_t rom_offset;
-static struc_6 stru_C0030080[MIDI_CHANNELS];
-static Channel_Data channel_data[MIDI_CHANNELS];
-static Voice_Data voice_data[MAX_VOICES];
-static uint32_t effect_type;
-static int32_t current_polyphony;
-static const uint8_t *romsxgm_ptr;
-static uint32_t output_frequency;
-static int32_t maximum_polyphony_new_value;
-static uint32_t system_time_1;
-static int32_t maximum_polyphony;
-static uint8_t *output_data_ptr;
-static uint32_t output_buffer_size_samples;
-static uint32_t output_buffer_size_bytes;
-static uint32_t effect_param_value;
+
+struct VLSG_Instance
+{
+    uint32_t (*get_time)(void *context);
+    void *get_time_context;
+
+    uint32_t dword_C0000000;
+    uint32_t dword_C0000004;
+    uint32_t dword_C0000008;
+    int32_t output_size_para;
+    uint32_t system_time_2;
+    uint8_t event_data[32];
+    int32_t recent_voice_index;
+    struc_6 *stru6_ptr;
+    Channel_Data *channel_data_ptr;
+    uint32_t event_type;
+    int32_t event_length;
+    int32_t reverb_data_buffer[32768];
+    uint32_t reverb_data_index;
+    int32_t is_reverb_enabled;
+    uint32_t reverb_shift;
+    volatile uint32_t midi_data_read_index;
+    uint8_t midi_data_buffer[65536];
+    volatile uint32_t midi_data_write_index;
+    uint32_t processing_phase;
+    uint32_t rom_offset;
+    struc_6 stru_C0030080[MIDI_CHANNELS];
+    Channel_Data channel_data[MIDI_CHANNELS];
+    Voice_Data voice_data[MAX_VOICES];
+    uint32_t effect_type;
+    int32_t current_polyphony;
+    const uint8_t *romsxgm_ptr;
+    uint32_t output_frequency;
+    int32_t maximum_polyphony_new_value;
+    uint32_t system_time_1;
+    int32_t maximum_polyphony;
+    uint8_t *output_data_ptr;
+    uint32_t output_buffer_size_samples;
+    uint32_t output_buffer_size_bytes;
+    uint32_t output_sub_blocks;
+    uint32_t effect_param_value;
+    int32_t *reverb_data_ptr;
+    uint32_t event_time;
+    VLSG_Statistics statistics;
+    uint32_t silent_samples;
+    uint32_t fast_forward;
+    uint32_t event_delay;
+};
+
+static VLSG_Instance default_instance = { .output_sub_blocks = 4, .event_delay = DEFAULT_EVENT_DELAY };
+static uint32_t (*legacy_get_time)(void);
+
 
 static const uint32_t dword_C0032188[112+104+40] =
 {
@@ -380,7 +411,6 @@ static const int32_t dword_C0032AA8[12][128] =
 };
 static const uint8_t drum_kits[8] = { 0, 8, 16, 24, 25, 32, 40, 48 };
 static const uint8_t drum_kit_numbers[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
-static int32_t *reverb_data_ptr;
 static const int32_t dword_C00342C0[4] = { 0, 1, 2, -1 };
 static const uint16_t word_C00342D0[17] = { 0, 250, 561, 949, 1430, 2030, 2776, 3704, 4858, 6295, 8083, 10307, 13075, 16519, 20803, 26135, 32768 };
 
@@ -395,53 +425,91 @@ const char *VLSG_GetName(void)
     return VLSG_Name;
 }
 
+static uint32_t LegacyGetTime(void *context)
+{
+    return legacy_get_time();
+}
+
 void VLSG_SetFunc_GetTime(uint32_t (*get_time)(void))
 {
-    VLSG_GetTime = get_time;
+    legacy_get_time = get_time;
+    VLSG_InstanceSetFunc_GetTime(&default_instance, &LegacyGetTime, NULL);
+}
+
+VLSG_Instance *VLSG_CreateInstance(void)
+{
+    VLSG_Instance *instance;
+
+    instance = (VLSG_Instance *)calloc(1, sizeof(VLSG_Instance));
+    if (instance == NULL)
+    {
+        return NULL;
+    }
+
+    instance->output_sub_blocks = 4;
+    instance->event_delay = DEFAULT_EVENT_DELAY;
+    return instance;
+}
+
+void VLSG_DestroyInstance(VLSG_Instance *instance)
+{
+    if (instance != &default_instance)
+    {
+        free(instance);
+    }
+}
+
+void VLSG_InstanceSetFunc_GetTime(VLSG_Instance *instance, uint32_t (*get_time)(void *context), void *context)
+{
+    instance->get_time = get_time;
+    instance->get_time_context = context;
 }
 
 
-static int32_t InitializeEffect(void);
+static int32_t InitializeEffect(VLSG_Instance *instance);
 static int32_t EMPTY_DeinitializeEffect(void);
-static int32_t InitializeVariables(void);
+static int32_t InitializeVariables(VLSG_Instance *instance);
 static int32_t EMPTY_DeinitializeVariables(void);
-static void CountActiveVoices(void);
-static void SetMaximumVoices(int maximum_voices);
-static void ProcessMidiData(void);
-static Voice_Data *FindAvailableVoice(int32_t channel_num_2, int32_t note_number);
-static Voice_Data *FindVoice(int32_t channel_num_2, int32_t note_number);
-static void NoteOff(void);
-static void NoteOn(int32_t arg_0);
-static void ControlChange(void);
-static void SystemExclusive(void);
-static int32_t InitializeReverbBuffer(void);
-static int32_t DeinitializeReverbBuffer(void);
-static void EnableReverb(void);
-static void DisableReverb(void);
-static void SetReverbShift(uint32_t shift);
-static void DefragmentVoices(void);
-static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t offset2);
-static int32_t InitializeMidiDataBuffer(void);
+static void ProgramChange(VLSG_Instance *instance, struc_6 *stru6_channel_ptr, uint32_t program_number);
+static void CountActiveVoices(VLSG_Instance *instance);
+static void SetMaximumVoices(VLSG_Instance *instance, int maximum_voices);
+static void RecordEventDelay(VLSG_Instance *instance);
+static void ProcessMidiData(VLSG_Instance *instance);
+static Voice_Data *FindAvailableVoice(VLSG_Instance *instance, int32_t channel_num_2, int32_t note_number);
+static Voice_Data *FindVoice(VLSG_Instance *instance, int32_t channel_num_2, int32_t note_number);
+static void NoteOff(VLSG_Instance *instance);
+static void NoteOn(VLSG_Instance *instance, int32_t arg_0);
+static void ControlChange(VLSG_Instance *instance);
+static void SystemExclusive(VLSG_Instance *instance);
+static int32_t InitializeReverbBuffer(VLSG_Instance *instance);
+static int32_t DeinitializeReverbBuffer(VLSG_Instance *instance);
+static void EnableReverb(VLSG_Instance *instance);
+static void DisableReverb(VLSG_Instance *instance);
+static void SetReverbShift(VLSG_Instance *instance, uint32_t shift);
+static void DefragmentVoices(VLSG_Instance *instance);
+static void GenerateOutputData(VLSG_Instance *instance, uint8_t *output_ptr, uint32_t offset1, uint32_t offset2);
+static void SkipOutputData(VLSG_Instance *instance, uint8_t *output_ptr, uint32_t offset1, uint32_t offset2);
+static int32_t InitializeMidiDataBuffer(VLSG_Instance *instance);
 static int32_t EMPTY_DeinitializeMidiDataBuffer(void);
-static void AddByteToMidiDataBuffer(uint8_t value);
-static uint8_t GetValueFromMidiDataBuffer(void);
-static int32_t InitializePhase(void);
+static void AddDataToMidiDataBuffer(VLSG_Instance *instance, const uint8_t *ptr, uint32_t len);
+static uint8_t GetValueFromMidiDataBuffer(VLSG_Instance *instance);
+static int32_t InitializePhase(VLSG_Instance *instance);
 static int32_t EMPTY_DeinitializePhase(void);
 static void sub_C0036A20(Voice_Data *voice_data_ptr);
-static void sub_C0036A80(Voice_Data *voice_data_ptr);
-static void sub_C0036B00(Voice_Data *voice_data_ptr);
-static void sub_C0036C20(Voice_Data *voice_data_ptr);
-static void ProcessPhase(void);
+static void sub_C0036A80(VLSG_Instance *instance, Voice_Data *voice_data_ptr);
+static void sub_C0036B00(VLSG_Instance *instance, Voice_Data *voice_data_ptr);
+static void sub_C0036C20(VLSG_Instance *instance, Voice_Data *voice_data_ptr);
+static void ProcessPhase(VLSG_Instance *instance);
 static int32_t sub_C0036FB0(int16_t value3);
-static void sub_C0036FE0(void);
-static void sub_C0037140(void);
-static int32_t InitializeStructures(void);
+static void sub_C0036FE0(VLSG_Instance *instance);
+static void sub_C0037140(VLSG_Instance *instance);
+static int32_t InitializeStructures(VLSG_Instance *instance);
 static int32_t EMPTY_DeinitializeStructures(void);
 static void ResetAllControllers(Channel_Data *channel_data_ptr);
 static void ResetChannel(Channel_Data *channel_data_ptr);
-static uint32_t sub_C00373A0(uint32_t arg_0, int32_t arg_4);
-static uint16_t sub_C0037400(void);
-static int16_t sub_C0037420(uint32_t arg_0);
+static uint32_t sub_C00373A0(VLSG_Instance *instance, uint32_t arg_0, int32_t arg_4);
+static uint16_t sub_C0037400(VLSG_Instance *instance);
+static int16_t sub_C0037420(VLSG_Instance *instance, uint32_t arg_0);
 
 
 static INLINE uint16_t READ_LE_UINT16(const uint8_t *ptr)
@@ -449,8 +517,13 @@ static INLINE uint16_t READ_LE_UINT16(const uint8_t *ptr)
     return ptr[0] | (ptr[1] << 8);
 }
 
+static INLINE uint32_t GetTime(VLSG_Instance *instance)
+{
+    return instance->get_time(instance->get_time_context);
+}
 
-int32_t VLSG_SetParameter(uint32_t type, uintptr_t value)
+
+int32_t VLSG_InstanceSetParameter(VLSG_Instance *instance, uint32_t type, uintptr_t value)
 {
     uint32_t buffer_size;
     int32_t polyphony;
@@ -458,36 +531,36 @@ int32_t VLSG_SetParameter(uint32_t type, uintptr_t value)
     switch (type)
     {
         case PARAMETER_OutputBuffer:
-            output_data_ptr = (uint8_t *)value;
+            instance->output_data_ptr = (uint8_t *)value;
             return 1;
 
         case PARAMETER_ROMAddress:
-            romsxgm_ptr = (const uint8_t *)value;
+            instance->romsxgm_ptr = (const uint8_t *)value;
             return 1;
 
         case PARAMETER_Frequency:
             if (value == 0)
             {
-                output_frequency = 11025;
-                output_size_para = 64;
+                instance->output_frequency = 11025;
+                instance->output_size_para = 64;
                 buffer_size = 4096;
             }
             else if (value == 2)
             {
-                output_frequency = 44100;
-                output_size_para = 256;
+                instance->output_frequency = 44100;
+                instance->output_size_para = 256;
                 buffer_size = 16384;
             }
             else
             {
-                output_frequency = 22050;
-                output_size_para = 128;
+                instance->output_frequency = 22050;
+                instance->output_size_para = 128;
                 buffer_size = 8192;
             }
 
-            output_buffer_size_samples = buffer_size;
-            output_buffer_size_bytes = 4 * buffer_size;
-            InitializeReverbBuffer();
+            instance->output_buffer_size_samples = buffer_size;
+            instance->output_buffer_size_bytes = 4 * buffer_size;
+            InitializeReverbBuffer(instance);
             return 1;
 
         case PARAMETER_Polyphony:
@@ -508,28 +581,53 @@ int32_t VLSG_SetParameter(uint32_t type, uintptr_t value)
                 polyphony = 24;
             }
 
-            maximum_polyphony = polyphony;
-            maximum_polyphony_new_value = polyphony;
+            instance->maximum_polyphony = polyphony;
+            instance->maximum_polyphony_new_value = polyphony;
+            return 1;
+
+        case PARAMETER_SubBlocks:
+            // number of sub-blocks (64 << frequency samples each) generated by one call of VLSG_FillOutputBuffer
+            if ((value != 1) && (value != 2) && (value != 4))
+            {
+                return 0;
+            }
+
+            instance->output_sub_blocks = (uint32_t)value;
+            return 1;
+
+        case PARAMETER_FastForward:
+            // voices are advanced without generating the output and reverb
+            instance->fast_forward = (value != 0) ? 1 : 0;
+            return 1;
+
+        case PARAMETER_EventDelay:
+            // shorter delay lowers the latency, but the events are less evenly spaced in the output (they're quantized to sub-blocks)
+            if (value > 1000)
+            {
+                return 0;
+            }
+
+            instance->event_delay = (uint32_t)value;
             return 1;
 
         case PARAMETER_Effect:
-            effect_param_value = (uint32_t)value;
-            DisableReverb();
-            if (effect_param_value == 0x20)
+            instance->effect_param_value = (uint32_t)value;
+            DisableReverb(instance);
+            if (instance->effect_param_value == 0x20)
             {
-                DisableReverb();
+                DisableReverb(instance);
                 return 1;
             }
-            else if (effect_param_value == 0x22)
+            else if (instance->effect_param_value == 0x22)
             {
-                SetReverbShift(0);
-                EnableReverb();
+                SetReverbShift(instance, 0);
+                EnableReverb(instance);
                 return 1;
             }
             else
             {
-                SetReverbShift(1);
-                EnableReverb();
+                SetReverbShift(instance, 1);
+                EnableReverb(instance);
                 return 1;
             }
 
@@ -538,111 +636,129 @@ int32_t VLSG_SetParameter(uint32_t type, uintptr_t value)
     }
 }
 
-int32_t VLSG_PlaybackStart(void)
+int32_t VLSG_SetParameter(uint32_t type, uintptr_t value)
 {
-    current_polyphony = 0;
-    dword_C0000000 = 0;
+    return VLSG_InstanceSetParameter(&default_instance, type, value);
+}
 
-    if (InitializeEffect())
+int32_t VLSG_InstancePlaybackStart(VLSG_Instance *instance)
+{
+    instance->current_polyphony = 0;
+    instance->dword_C0000000 = 0;
+
+    if (InitializeEffect(instance))
     {
         return 0;
     }
 
-    if (InitializeVariables())
+    if (InitializeVariables(instance))
     {
         EMPTY_DeinitializeEffect();
         return 0;
     }
 
-    if (InitializeReverbBuffer())
+    if (InitializeReverbBuffer(instance))
     {
         EMPTY_DeinitializeVariables();
         EMPTY_DeinitializeEffect();
         return 0;
     }
 
-    if (InitializePhase())
+    if (InitializePhase(instance))
     {
-        DeinitializeReverbBuffer();
+        DeinitializeReverbBuffer(instance);
         EMPTY_DeinitializeVariables();
         EMPTY_DeinitializeEffect();
         return 0;
     }
 
-    if (InitializeMidiDataBuffer())
+    if (InitializeMidiDataBuffer(instance))
     {
         EMPTY_DeinitializePhase();
-        DeinitializeReverbBuffer();
+        DeinitializeReverbBuffer(instance);
         EMPTY_DeinitializeVariables();
         EMPTY_DeinitializeEffect();
         return 0;
     }
 
-    if (InitializeStructures())
+    if (InitializeStructures(instance))
     {
         EMPTY_DeinitializeMidiDataBuffer();
         EMPTY_DeinitializePhase();
-        DeinitializeReverbBuffer();
+        DeinitializeReverbBuffer(instance);
         EMPTY_DeinitializeVariables();
         EMPTY_DeinitializeEffect();
         return 0;
     }
 
-    dword_C0000004 = 2972;
+    instance->dword_C0000004 = 2972;
+    instance->silent_samples = REVERB_TAIL_SAMPLES;
     return 1;
 }
 
-int32_t VLSG_PlaybackStop(void)
+int32_t VLSG_PlaybackStart(void)
 {
-    current_polyphony = 0;
+    return VLSG_InstancePlaybackStart(&default_instance);
+}
+
+int32_t VLSG_InstancePlaybackStop(VLSG_Instance *instance)
+{
+    instance->current_polyphony = 0;
 
     EMPTY_DeinitializeStructures();
     EMPTY_DeinitializeMidiDataBuffer();
     EMPTY_DeinitializePhase();
-    DeinitializeReverbBuffer();
+    DeinitializeReverbBuffer(instance);
     EMPTY_DeinitializeVariables();
     return EMPTY_DeinitializeEffect();
 }
 
+int32_t VLSG_PlaybackStop(void)
+{
+    return VLSG_InstancePlaybackStop(&default_instance);
+}
+
+void VLSG_InstanceAddMidiData(VLSG_Instance *instance, const uint8_t *ptr, uint32_t len)
+{
+    AddDataToMidiDataBuffer(instance, ptr, len);
+}
+
 void VLSG_AddMidiData(const uint8_t *ptr, uint32_t len)
 {
-    for (; len != 0; len--)
-    {
-        AddByteToMidiDataBuffer(*ptr++);
-    }
+    VLSG_InstanceAddMidiData(&default_instance, ptr, len);
 }
 
-int32_t VLSG_FillOutputBuffer(uint32_t output_buffer_counter)
+int32_t VLSG_InstanceFillOutputBuffer(VLSG_Instance *instance, uint32_t output_buffer_counter)
 {
     uint32_t time1, value1, time2, time3, offset1;
     int counter;
     uint8_t *output_ptr;
     uint32_t time4;
 
-    time1 = VLSG_GetTime();
+    time1 = GetTime(instance);
 
-    if ((output_buffer_counter == 0) || (time1 - system_time_1 > 200))
+    if ((output_buffer_counter == 0) || (time1 - instance->system_time_1 > 200))
     {
         value1 = 0;
         time2 = time1;
-        system_time_1 = time1;
-        system_time_2 = time1;
+        instance->system_time_1 = time1;
+        instance->system_time_2 = time1;
     }
     else
     {
-        value1 = dword_C0000000;
-        time2 = dword_C0000008;
+        value1 = instance->dword_C0000000;
+        time2 = instance->dword_C0000008;
     }
 
-    dword_C0000000 = value1;
-    dword_C0000008 = time2;
+    instance->dword_C0000000 = value1;
+    instance->dword_C0000008 = time2;
 
     if (value1 >= 512)
     {
-        dword_C0000000 = 0;
-        time2 += dword_C0000004;
-        dword_C0000008 = time2;
-        time3 = (7 * dword_C0000004 - system_time_2) + time1;
+        instance->dword_C0000000 = 0;
+        time2 += instance->dword_C0000004;
+        instance->dword_C0000008 = time2;
+        time3 = (7 * instance->dword_C0000004 - instance->system_time_2) + time1;
 
         if (time1 < time2)
         {
@@ -653,52 +769,149 @@ int32_t VLSG_FillOutputBuffer(uint32_t output_buffer_counter)
             time3 += (time1 - time2) >> 4;
         }
 
-        system_time_2 = time1;
-        dword_C0000004 = (time3 >> 3) + ((time3 & 4) >> 2);
+        instance->system_time_2 = time1;
+        instance->dword_C0000004 = (time3 >> 3) + ((time3 & 4) >> 2);
     }
 
     offset1 = 0;
-    output_ptr = &output_data_ptr[((output_buffer_counter & 0x0F) * output_size_para) << 4];
-    for (counter = 4; counter != 0; counter--)
+    output_ptr = &instance->output_data_ptr[((output_buffer_counter & 0x0F) * instance->output_size_para * instance->output_sub_blocks) << 2];
+    for (counter = instance->output_sub_blocks; counter != 0; counter--)
     {
-        ProcessMidiData();
-        ProcessPhase();
-        GenerateOutputData(output_ptr, offset1, offset1 + output_size_para);
-        offset1 += output_size_para;
-        dword_C0000000++;
-        system_time_1 = (((uint32_t)(dword_C0000000 * dword_C0000004)) >> 9) + dword_C0000008;
+        ProcessMidiData(instance);
+        ProcessPhase(instance);
+        if (instance->fast_forward)
+        {
+            SkipOutputData(instance, output_ptr, offset1, offset1 + instance->output_size_para);
+        }
+        else
+        {
+            GenerateOutputData(instance, output_ptr, offset1, offset1 + instance->output_size_para);
+        }
+        offset1 += instance->output_size_para;
+        instance->dword_C0000000++;
+        instance->system_time_1 = (((uint32_t)(instance->dword_C0000000 * instance->dword_C0000004)) >> 9) + instance->dword_C0000008;
     }
 
-    time4 = VLSG_GetTime();
-    CountActiveVoices();
+    time4 = GetTime(instance);
+    CountActiveVoices(instance);
     time4 -= time1;
-    maximum_polyphony = maximum_polyphony_new_value;
+    instance->maximum_polyphony = instance->maximum_polyphony_new_value;
+
+    instance->statistics.active_voices = instance->current_polyphony;
+    if (instance->current_polyphony > instance->statistics.peak_voices)
+    {
+        instance->statistics.peak_voices = instance->current_polyphony;
+    }
+
+    // samples since the last active voice (for detecting the end of reverb tail)
+    if (instance->current_polyphony != 0)
+    {
+        instance->silent_samples = 0;
+    }
+    else if (instance->silent_samples < REVERB_TAIL_SAMPLES)
+    {
+        instance->silent_samples += instance->output_size_para * instance->output_sub_blocks;
+    }
 
     if (time4 > 300)
     {
-        SetMaximumVoices(2);
-        return current_polyphony;
+        instance->statistics.polyphony_reductions++;
+        SetMaximumVoices(instance, 2);
+        return instance->current_polyphony;
     }
 
-    if (time4 >= 16)
+    // thresholds are for 4 sub-blocks (~23 ms of audio) and are scaled for smaller blocks
+    if (time4 >= ((16 * instance->output_sub_blocks) >> 2))
     {
-        if (time4 >= 20)
+        instance->statistics.polyphony_reductions++;
+
+        if (time4 >= ((20 * instance->output_sub_blocks) >> 2))
         {
-            SetMaximumVoices((3 * current_polyphony) >> 2);
-            return current_polyphony;
+            SetMaximumVoices(instance, (3 * instance->current_polyphony) >> 2);
+            return instance->current_polyphony;
         }
 
-        SetMaximumVoices((7 * current_polyphony) >> 3);
-        return current_polyphony;
+        SetMaximumVoices(instance, (7 * instance->current_polyphony) >> 3);
+        return instance->current_polyphony;
     }
 
-    return current_polyphony;
+    return instance->current_polyphony;
 }
 
+int32_t VLSG_FillOutputBuffer(uint32_t output_buffer_counter)
+{
+    return VLSG_InstanceFillOutputBuffer(&default_instance, output_buffer_counter);
+}
 
-static int32_t InitializeEffect(void)
+void VLSG_InstanceGetStatistics(VLSG_Instance *instance, VLSG_Statistics *statistics)
 {
-    effect_type = 6;
+    // the values are read without synchronization, so they can be slightly out of date
+    *statistics = instance->statistics;
+    statistics->maximum_polyphony = instance->maximum_polyphony;
+}
+
+int32_t VLSG_InstanceIsSilent(VLSG_Instance *instance)
+{
+    if (instance->midi_data_read_index != LOAD_ACQUIRE(instance->midi_data_write_index))
+    {
+        return 0;
+    }
+
+    if (instance->current_polyphony != 0)
+    {
+        return 0;
+    }
+
+    if ((instance->is_reverb_enabled == 1) && (instance->silent_samples < REVERB_TAIL_SAMPLES))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+void VLSG_InstanceMoveState(VLSG_Instance *destination, VLSG_Instance *source)
+{
+    int index;
+    uint32_t read_index, write_index;
+
+    memcpy(destination->channel_data, source->channel_data, sizeof(destination->channel_data));
+
+    // instrument data is read again, because the destination can use a different ROM
+    for (index = 0; index < MIDI_CHANNELS; index++)
+    {
+        ProgramChange(destination, &(destination->stru_C0030080[index]), destination->channel_data[index].program_change);
+    }
+
+    destination->effect_type = source->effect_type;
+    destination->is_reverb_enabled = source->is_reverb_enabled;
+    destination->reverb_shift = source->reverb_shift;
+    destination->maximum_polyphony = source->maximum_polyphony_new_value;
+    destination->maximum_polyphony_new_value = source->maximum_polyphony_new_value;
+
+    // partially processed event
+    memcpy(destination->event_data, source->event_data, sizeof(destination->event_data));
+    destination->event_length = source->event_length;
+    destination->event_type = source->event_type;
+    destination->channel_data_ptr = &(destination->channel_data[destination->event_data[0] & 0x0F]);
+    destination->stru6_ptr = &(destination->stru_C0030080[destination->event_data[0] & 0x0F]);
+
+    // MIDI data waiting for its time
+    read_index = source->midi_data_read_index;
+    write_index = source->midi_data_write_index;
+    if (write_index < read_index)
+    {
+        AddDataToMidiDataBuffer(destination, &(source->midi_data_buffer[read_index]), 65536 - read_index);
+        read_index = 0;
+    }
+    AddDataToMidiDataBuffer(destination, &(source->midi_data_buffer[read_index]), write_index - read_index);
+    source->midi_data_read_index = write_index;
+}
+
+
+static int32_t InitializeEffect(VLSG_Instance *instance)
+{
+    instance->effect_type = 6;
     return 0;
 }
 
@@ -707,18 +920,18 @@ static int32_t EMPTY_DeinitializeEffect(void)
     return 0;
 }
 
-static void sub_C0034890(Voice_Data *voice_data_ptr, int32_t arg_4)
+static void sub_C0034890(VLSG_Instance *instance, Voice_Data *voice_data_ptr, int32_t arg_4)
 {
     Channel_Data *channel_ptr;
     int32_t value1;
     uint32_t value2;
 
-    channel_ptr = &(channel_data[voice_data_ptr->channel_num_2 >> 1]);
+    channel_ptr = &(instance->channel_data[voice_data_ptr->channel_num_2 >> 1]);
     value1 = (((int32_t)(channel_ptr->pitch_bend * channel_ptr->pitch_bend_sense)) >> 13) + arg_4 + channel_ptr->fine_tune + 2180;
     value2 = dword_C0032188[216 + (value1 >> 8)] * dword_C0032588[value1 & 0xFF];
 
     voice_data_ptr->field_24 = value2;
-    switch (output_frequency)
+    switch (instance->output_frequency)
     {
         case 11025:
             voice_data_ptr->field_24 = value2 >> 17;
@@ -733,24 +946,24 @@ static void sub_C0034890(Voice_Data *voice_data_ptr, int32_t arg_4)
             voice_data_ptr->field_24 = (value2 / 3) >> 16;
             break;
         default:
-            voice_data_ptr->field_24 = (uint32_t)((value2 >> 17) * 11025) / output_frequency;
+            voice_data_ptr->field_24 = (uint32_t)((value2 >> 17) * 11025) / instance->output_frequency;
             break;
     }
 }
 
-static int32_t sub_C0034970(Voice_Data *voice_data_ptr, int32_t arg_4)
+static int32_t sub_C0034970(VLSG_Instance *instance, Voice_Data *voice_data_ptr, int32_t arg_4)
 {
     uint32_t offset1;
     int32_t channel_num_2;
     int32_t note_number;
 
-    offset1 = sub_C00373A0(3, arg_4);
+    offset1 = sub_C00373A0(instance, 3, arg_4);
     channel_num_2 = (int16_t)(voice_data_ptr->channel_num_2 & ~1);
     note_number = voice_data_ptr->note_number;
 
     if (channel_num_2 != (2 * DRUM_CHANNEL))
     {
-        note_number += channel_data[channel_num_2 >> 1].coarse_tune;
+        note_number += instance->channel_data[channel_num_2 >> 1].coarse_tune;
         note_number += (voice_data_ptr->field_56 + 128) >> 8;
 
         if (note_number < 12)
@@ -764,27 +977,27 @@ static int32_t sub_C0034970(Voice_Data *voice_data_ptr, int32_t arg_4)
         }
     }
 
-    return sub_C0037420(offset1 + 2 * note_number);
+    return sub_C0037420(instance, offset1 + 2 * note_number);
 }
 
-static void ProgramChange(struc_6 *stru6_channel_ptr, uint32_t program_number)
+static void ProgramChange(VLSG_Instance *instance, struc_6 *stru6_channel_ptr, uint32_t program_number)
 {
     int16_t *data;
     int counter, index;
 
     data = stru6_channel_ptr->data;
-    if (stru6_channel_ptr == &(stru_C0030080[DRUM_CHANNEL]))
+    if (stru6_channel_ptr == &(instance->stru_C0030080[DRUM_CHANNEL]))
     {
         program_number = (program_number & 7) + 128;
     }
 
-    sub_C00373A0(1, sub_C0037420(sub_C00373A0(19, 0) + 2 * program_number));
+    sub_C00373A0(instance, 1, sub_C0037420(instance, sub_C00373A0(instance, 19, 0) + 2 * program_number));
 
     for (counter = 2; counter != 0; counter--)
     {
         for (index = 0; index < 14; index++)
         {
-            data[index] = (int16_t)sub_C0037400();
+            data[index] = (int16_t)sub_C0037400(instance);
         }
 
         data[3] >>= 8;
@@ -801,97 +1014,97 @@ static void ProgramChange(struc_6 *stru6_channel_ptr, uint32_t program_number)
     }
 }
 
-static void VoiceSoundOff(Voice_Data *voice_data_ptr)
+static void VoiceSoundOff(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
 {
     voice_data_ptr->field_50 = 0x7FFF;
     voice_data_ptr->vflags &= ~VFLAG_Value40;
     voice_data_ptr->vflags |= VFLAG_Value80;
     voice_data_ptr->vflags &= VFLAG_MaskC0;
-    sub_C0036B00(voice_data_ptr);
-    sub_C0036A80(voice_data_ptr);
+    sub_C0036B00(instance, voice_data_ptr);
+    sub_C0036A80(instance, voice_data_ptr);
 }
 
-static void VoiceNoteOff(Voice_Data *voice_data_ptr)
+static void VoiceNoteOff(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
 {
     voice_data_ptr->vflags |= VFLAG_Value80;
 
     if ((voice_data_ptr->vflags & VFLAG_Value40) == 0)
     {
         voice_data_ptr->vflags &= VFLAG_MaskC0;
-        sub_C0036B00(voice_data_ptr);
-        sub_C0036A80(voice_data_ptr);
+        sub_C0036B00(instance, voice_data_ptr);
+        sub_C0036A80(instance, voice_data_ptr);
     }
 }
 
-static void AllChannelNotesOff(int32_t channel_num)
+static void AllChannelNotesOff(VLSG_Instance *instance, int32_t channel_num)
 {
     int index;
 
     for (index = 0; index < MAX_VOICES; index++)
     {
-        if ((voice_data[index].channel_num_2 >> 1) == channel_num)
+        if ((instance->voice_data[index].channel_num_2 >> 1) == channel_num)
         {
-            VoiceNoteOff(&(voice_data[index]));
+            VoiceNoteOff(instance, &(instance->voice_data[index]));
         }
     }
 }
 
-static void AllChannelSoundsOff(int32_t channel_num)
+static void AllChannelSoundsOff(VLSG_Instance *instance, int32_t channel_num)
 {
     int index;
 
     for (index = 0; index < MAX_VOICES; index++)
     {
-        if ((voice_data[index].channel_num_2 >> 1) == channel_num)
+        if ((instance->voice_data[index].channel_num_2 >> 1) == channel_num)
         {
-            VoiceSoundOff(&(voice_data[index]));
+            VoiceSoundOff(instance, &(instance->voice_data[index]));
         }
     }
 }
 
-static void ControllerSettingsOn(int32_t channel_num)
+static void ControllerSettingsOn(VLSG_Instance *instance, int32_t channel_num)
 {
     int index;
 
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if ((voice_data[index].channel_num_2 >> 1) == channel_num)
+        if ((instance->voice_data[index].channel_num_2 >> 1) == channel_num)
         {
-            if (voice_data[index].note_number != 255)
+            if (instance->voice_data[index].note_number != 255)
             {
-                if ((voice_data[index].vflags & VFLAG_Value80) == 0)
+                if ((instance->voice_data[index].vflags & VFLAG_Value80) == 0)
                 {
-                    voice_data[index].vflags |= VFLAG_Value40;
+                    instance->voice_data[index].vflags |= VFLAG_Value40;
                 }
             }
         }
     }
 }
 
-static void ControllerSettingsOff(int32_t channel_num)
+static void ControllerSettingsOff(VLSG_Instance *instance, int32_t channel_num)
 {
     int index;
 
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if ((voice_data[index].channel_num_2 >> 1) == channel_num)
+        if ((instance->voice_data[index].channel_num_2 >> 1) == channel_num)
         {
-            if (voice_data[index].note_number != 255)
+            if (instance->voice_data[index].note_number != 255)
             {
-                voice_data[index].vflags &= ~VFLAG_Value40;
-                if ((voice_data[index].vflags & VFLAG_Value80) != 0)
+                instance->voice_data[index].vflags &= ~VFLAG_Value40;
+                if ((instance->voice_data[index].vflags & VFLAG_Value80) != 0)
                 {
-                    voice_data[index].vflags &= VFLAG_MaskC0;
+                    instance->voice_data[index].vflags &= VFLAG_MaskC0;
 
-                    sub_C0036B00(&(voice_data[index]));
-                    sub_C0036A80(&(voice_data[index]));
+                    sub_C0036B00(instance, &(instance->voice_data[index]));
+                    sub_C0036A80(instance, &(instance->voice_data[index]));
                 }
             }
         }
     }
 }
 
-static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_data_ptr, int16_t *stru6_data_ptr)
+static void StartPlayingVoice(VLSG_Instance *instance, Voice_Data *voice_data_ptr, Channel_Data *channel_data_ptr, int16_t *stru6_data_ptr)
 {
     uint16_t value0;
     uint32_t value1;
@@ -912,28 +1125,28 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
     voice_data_ptr->field_5C = stru6_data_ptr[9];
     voice_data_ptr->field_5E = stru6_data_ptr[10];
 
-    value1 = (uint16_t)sub_C0037420(sub_C00373A0(2, (stru6_data_ptr[1] & 0xFFF) + sub_C0034970(voice_data_ptr, (*(uint16_t *)stru6_data_ptr) >> 8)));
+    value1 = (uint16_t)sub_C0037420(instance, sub_C00373A0(instance, 2, (stru6_data_ptr[1] & 0xFFF) + sub_C0034970(instance, voice_data_ptr, (*(uint16_t *)stru6_data_ptr) >> 8)));
     value2 = 0;
-    value0 = sub_C0037400();
+    value0 = sub_C0037400(instance);
     value1 |= (value0 & 0xFF) << 16;
     voice_data_ptr->field_00 = value1 << 10;
 
     value1 = value0 >> 8;
-    value0 = sub_C0037400();
+    value0 = sub_C0037400(instance);
     value1 |= value0 << 8;
     voice_data_ptr->field_04 = value1 & 0x3FFFFF;
 
-    sub_C0037400();
-    value1 = sub_C0037400();
+    sub_C0037400(instance);
+    value1 = sub_C0037400(instance);
 
-    value0 = sub_C0037400();
+    value0 = sub_C0037400(instance);
     value1 |= (value0 & 0xFF) << 16;
     voice_data_ptr->field_68 = value0 >> 8;
     voice_data_ptr->field_66 = value0 & 0xFF;
     voice_data_ptr->field_08 = value1 & 0x3FFFFF;
 
-    voice_data_ptr->field_44 = sub_C0037400();
-    value0 = sub_C0037400();
+    voice_data_ptr->field_44 = sub_C0037400(instance);
+    value0 = sub_C0037400(instance);
 
     voice_data_ptr->field_60 = value0 & 0xFF;
     voice_data_ptr->field_0C[3] = 0;
@@ -948,7 +1161,7 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
         channel_num_2 = (int16_t)(voice_data_ptr->channel_num_2 & ~1);
         if (channel_num_2 != (2 * DRUM_CHANNEL))
         {
-            value2 += channel_data[channel_num_2 >> 1].coarse_tune;
+            value2 += instance->channel_data[channel_num_2 >> 1].coarse_tune;
             value2 += (voice_data_ptr->field_56 + 128) >> 8;
 
             if (value2 < 12)
@@ -973,11 +1186,11 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
     value2 += voice_data_ptr->field_44;
     value2 += (int8_t)voice_data_ptr->field_56;
     voice_data_ptr->field_44 = value2;
-    sub_C0034890(voice_data_ptr, value2);
-    sub_C0036C20(voice_data_ptr);
+    sub_C0034890(instance, voice_data_ptr, value2);
+    sub_C0036C20(instance, voice_data_ptr);
 
     value4 = stru6_data_ptr[12];
-    value5 = dword_C0032AA8[effect_type + 1][voice_data_ptr->note_velocity];
+    value5 = dword_C0032AA8[instance->effect_type + 1][voice_data_ptr->note_velocity];
 
     if (value4 >= 0)
     {
@@ -1013,18 +1226,18 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
     voice_data_ptr->field_52 = 0;
     voice_data_ptr->vflags = 0;
     voice_data_ptr->field_4E = 0;
-    sub_C0036A80(voice_data_ptr);
-    sub_C0036B00(voice_data_ptr);
+    sub_C0036A80(instance, voice_data_ptr);
+    sub_C0036B00(instance, voice_data_ptr);
 
     if ((channel_data_ptr->chflags & CHFLAG_Sostenuto) != 0)
     {
-        for (index = 0; index < maximum_polyphony; index++)
+        for (index = 0; index < instance->maximum_polyphony; index++)
         {
-            if (voice_data[index].note_number == 255) continue;
-            if (voice_data_ptr->note_number != voice_data[index].note_number) continue;
-            if (voice_data[index].channel_num_2 != voice_data_ptr->channel_num_2) continue;
-            if ((voice_data[index].vflags & VFLAG_Value80) == 0) continue;
-            if ((voice_data[index].vflags & VFLAG_Value40) == 0) continue;
+            if (instance->voice_data[index].note_number == 255) continue;
+            if (voice_data_ptr->note_number != instance->voice_data[index].note_number) continue;
+            if (instance->voice_data[index].channel_num_2 != voice_data_ptr->channel_num_2) continue;
+            if ((instance->voice_data[index].vflags & VFLAG_Value80) == 0) continue;
+            if ((instance->voice_data[index].vflags & VFLAG_Value40) == 0) continue;
 
             voice_data_ptr->vflags |= VFLAG_Value40;
             break;
@@ -1038,14 +1251,14 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
 
     if ((voice_data_ptr->channel_num_2 & ~1) == (2 * DRUM_CHANNEL))
     {
-        voice_data_ptr->field_6A = sub_C0037420(sub_C00373A0(18, 0) + 4 * voice_data_ptr->note_number);
+        voice_data_ptr->field_6A = sub_C0037420(instance, sub_C00373A0(instance, 18, 0) + 4 * voice_data_ptr->note_number);
         sub_C0036A20(voice_data_ptr);
 
 // this is possibly a bug in the original code
 // maybe there were supposed to be two zero terminated lists (dword_C0032988 and dword_C0032A20)
         drum_note_ptr = &(dword_C0032988[38]);
 // question: can program_change have a value of 135 ?
-        if (channel_data[DRUM_CHANNEL].program_change != 135)
+        if (instance->channel_data[DRUM_CHANNEL].program_change != 135)
         {
             drum_note_ptr = &(dword_C0032988[0]);
         }
@@ -1054,13 +1267,13 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
         {
             if (drum_note_ptr[0] != voice_data_ptr->note_number) continue;
 
-            for (index = 0; index < maximum_polyphony; index++)
+            for (index = 0; index < instance->maximum_polyphony; index++)
             {
-                if (voice_data[index].note_number == drum_note_ptr[1])
+                if (instance->voice_data[index].note_number == drum_note_ptr[1])
                 {
-                    if ((voice_data[index].channel_num_2 & ~1) == (2 * DRUM_CHANNEL))
+                    if ((instance->voice_data[index].channel_num_2 & ~1) == (2 * DRUM_CHANNEL))
                     {
-                        voice_data[index].note_number = 255;
+                        instance->voice_data[index].note_number = 255;
                     }
                 }
             }
@@ -1068,7 +1281,7 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
     }
     else
     {
-        value7 = sub_C00373A0(17, 0);
+        value7 = sub_C00373A0(instance, 17, 0);
         value8 = channel_data_ptr->pan + stru6_data_ptr[5];
 
         if (value8 > 127)
@@ -1080,29 +1293,29 @@ static void StartPlayingVoice(Voice_Data *voice_data_ptr, Channel_Data *channel_
             value8 = -127;
         }
 
-        voice_data_ptr->field_6A = sub_C0037420(value7 + 2 * value8 + 256);
+        voice_data_ptr->field_6A = sub_C0037420(instance, value7 + 2 * value8 + 256);
         sub_C0036A20(voice_data_ptr);
     }
 }
 
-static void AllVoicesSoundsOff(void)
+static void AllVoicesSoundsOff(VLSG_Instance *instance)
 {
     int index;
 
     for (index = 0; index < MAX_VOICES; index++)
     {
-        if (voice_data[index].note_number != 255)
+        if (instance->voice_data[index].note_number != 255)
         {
-            VoiceSoundOff(&(voice_data[index]));
+            VoiceSoundOff(instance, &(instance->voice_data[index]));
         }
     }
 }
 
-static int32_t InitializeVariables(void)
+static int32_t InitializeVariables(VLSG_Instance *instance)
 {
-    recent_voice_index = 0;
-    event_length = 0;
-    event_type = 0;
+    instance->recent_voice_index = 0;
+    instance->event_length = 0;
+    instance->event_type = 0;
     return 0;
 }
 
@@ -1111,40 +1324,40 @@ static int32_t EMPTY_DeinitializeVariables(void)
     return 0;
 }
 
-static void CountActiveVoices(void)
+static void CountActiveVoices(VLSG_Instance *instance)
 {
     int active_voices, index;
 
     active_voices = 0;
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if (voice_data[index].note_number != 255)
+        if (instance->voice_data[index].note_number != 255)
         {
             active_voices++;
         }
     }
-    current_polyphony = active_voices;
+    instance->current_polyphony = active_voices;
 }
 
-static void ReduceActiveVoices(int32_t maximum_voices)
+static void ReduceActiveVoices(VLSG_Instance *instance, int32_t maximum_voices)
 {
     int index1, index2, index3;
     int active_voices;
 
-    if (maximum_voices >= maximum_polyphony) return;
+    if (maximum_voices >= instance->maximum_polyphony) return;
 
     if (maximum_voices > 0)
     {
-        index2 = recent_voice_index + 1;
-        if (index2 >= maximum_polyphony)
+        index2 = instance->recent_voice_index + 1;
+        if (index2 >= instance->maximum_polyphony)
         {
             index2 = 0;
         }
 
         active_voices = 0;
-        for (index1 = 0; index1 < maximum_polyphony; index1++)
+        for (index1 = 0; index1 < instance->maximum_polyphony; index1++)
         {
-            if (voice_data[index1].note_number != 255)
+            if (instance->voice_data[index1].note_number != 255)
             {
                 active_voices++;
             }
@@ -1153,33 +1366,33 @@ static void ReduceActiveVoices(int32_t maximum_voices)
         index3 = index2;
         do
         {
-            if (voice_data[index3].note_number != 255)
+            if (instance->voice_data[index3].note_number != 255)
             {
-                if (voice_data[index3].vflags & VFLAG_Value80)
+                if (instance->voice_data[index3].vflags & VFLAG_Value80)
                 {
-                    voice_data[index3].note_number = 255;
+                    instance->voice_data[index3].note_number = 255;
                     active_voices--;
 
                     if (active_voices <= maximum_voices)
                     {
-                        current_polyphony = active_voices;
+                        instance->current_polyphony = active_voices;
                         return;
                     }
                 }
             }
 
             index3++;
-            if (index3 >= maximum_polyphony)
+            if (index3 >= instance->maximum_polyphony)
             {
                 index3 = 0;
             }
-        } while (index3 != recent_voice_index);
+        } while (index3 != instance->recent_voice_index);
 
         for (;;)
         {
-            if (voice_data[index2].note_number != 255)
+            if (instance->voice_data[index2].note_number != 255)
             {
-                voice_data[index2].note_number = 255;
+                instance->voice_data[index2].note_number = 255;
                 active_voices--;
 
                 if (active_voices <= maximum_voices)
@@ -1189,180 +1402,196 @@ static void ReduceActiveVoices(int32_t maximum_voices)
             }
 
             index2++;
-            if (index2 >= maximum_polyphony)
+            if (index2 >= instance->maximum_polyphony)
             {
                 index2 = 0;
             }
-            if (index2 == recent_voice_index)
+            if (index2 == instance->recent_voice_index)
             {
                 return;
             }
         }
 
-        current_polyphony = active_voices;
+        instance->current_polyphony = active_voices;
     }
     else
     {
-        for (index1 = 0; index1 < maximum_polyphony; index1++)
+        for (index1 = 0; index1 < instance->maximum_polyphony; index1++)
         {
-            voice_data[index1].note_number = 255;
+            instance->voice_data[index1].note_number = 255;
         }
-        current_polyphony = 0;
+        instance->current_polyphony = 0;
     }
 }
 
-static void SetMaximumVoices(int maximum_voices)
+static void SetMaximumVoices(VLSG_Instance *instance, int maximum_voices)
 {
     int index;
 
-    ReduceActiveVoices(maximum_voices);
-    DefragmentVoices();
-    maximum_polyphony = maximum_voices;
+    ReduceActiveVoices(instance, maximum_voices);
+    DefragmentVoices(instance);
+    instance->maximum_polyphony = maximum_voices;
 
     for (index = maximum_voices; index < MAX_VOICES; index++)
     {
-        voice_data[index].note_number = 255;
+        instance->voice_data[index].note_number = 255;
     }
 
-    CountActiveVoices();
+    CountActiveVoices(instance);
+
+    instance->recent_voice_index = 0;
+}
+
+static void RecordEventDelay(VLSG_Instance *instance)
+{
+    uint32_t delay;
+    int index;
 
-    recent_voice_index = 0;
+    // events are scheduled after their time plus the event delay
+    delay = instance->system_time_1 - (instance->event_time + instance->event_delay);
+
+    for (index = 0; (index < 7) && (delay >= (1u << index)); index++);
+
+    instance->statistics.events++;
+    instance->statistics.event_delay[index]++;
 }
 
-static void ProcessMidiData(void)
+static void ProcessMidiData(VLSG_Instance *instance)
 {
     uint8_t midi_value;
 
     for (;;)
     {
-        midi_value = GetValueFromMidiDataBuffer();
+        midi_value = GetValueFromMidiDataBuffer(instance);
         if (midi_value == 0xFF) break;
 
         if (midi_value > 0xF7) continue;
 
         if (midi_value == 0xF7)
         {
-            if (event_data[0] != 0xF0) continue;
+            if (instance->event_data[0] != 0xF0) continue;
         }
         else if ((midi_value & 0x80) != 0)
         {
-            event_length = 0;
-            event_type = midi_value & 0xF0;
-            event_data[0] = midi_value;
-            channel_data_ptr = &(channel_data[midi_value & 0x0F]);
-            stru6_ptr = &(stru_C0030080[midi_value & 0x0F]);
+            instance->event_length = 0;
+            instance->event_type = midi_value & 0xF0;
+            instance->event_data[0] = midi_value;
+            instance->channel_data_ptr = &(instance->channel_data[midi_value & 0x0F]);
+            instance->stru6_ptr = &(instance->stru_C0030080[midi_value & 0x0F]);
 
             continue;
         }
         else
         {
-            event_length++;
-            if (event_length >= 32) continue;
+            instance->event_length++;
+            if (instance->event_length >= 32) continue;
 
-            event_data[event_length] = midi_value;
+            instance->event_data[instance->event_length] = midi_value;
 
-            if (event_data[0] == 0xF0) continue;
+            if (instance->event_data[0] == 0xF0) continue;
 
-            if ((event_type != 0xC0) && (event_type != 0xD0) && (event_length != 2)) continue;
+            if ((instance->event_type != 0xC0) && (instance->event_type != 0xD0) && (instance->event_length != 2)) continue;
         }
 
-        switch (event_type)
+        RecordEventDelay(instance);
+
+        switch (instance->event_type)
         {
             case 0x80: // Note Off
-                NoteOff();
+                NoteOff(instance);
                 break;
 
             case 0x90: // Note On
-                if (event_data[2] != 0)
+                if (instance->event_data[2] != 0)
                 {
-                    NoteOn(0);
+                    NoteOn(instance, 0);
 
-                    if (stru6_ptr->data[1] & 0x8000)
+                    if (instance->stru6_ptr->data[1] & 0x8000)
                     {
-                        NoteOn(1);
+                        NoteOn(instance, 1);
                     }
                 }
                 else
                 {
-                    NoteOff();
+                    NoteOff(instance);
                 }
                 break;
 
             case 0xB0: // Controller
-                ControlChange();
+                ControlChange(instance);
                 break;
 
             case 0xC0: // Program Change
-                if ((event_data[0] & 0x0F) == DRUM_CHANNEL)
+                if ((instance->event_data[0] & 0x0F) == DRUM_CHANNEL)
                 {
                     int drum_kit_index;
 
                     for (drum_kit_index = 0; drum_kit_index < 8; drum_kit_index++)
                     {
-                        if (drum_kits[drum_kit_index] == event_data[1]) break;
+                        if (drum_kits[drum_kit_index] == instance->event_data[1]) break;
                     }
                     if (drum_kit_index >= 8) break;
 
-                    channel_data_ptr->program_change = drum_kit_numbers[drum_kit_index];
-                    ProgramChange(stru6_ptr, drum_kit_numbers[drum_kit_index]);
+                    instance->channel_data_ptr->program_change = drum_kit_numbers[drum_kit_index];
+                    ProgramChange(instance, instance->stru6_ptr, drum_kit_numbers[drum_kit_index]);
                 }
                 else
                 {
-                    channel_data_ptr->program_change = event_data[1];
-                    ProgramChange(stru6_ptr, event_data[1]);
+                    instance->channel_data_ptr->program_change = instance->event_data[1];
+                    ProgramChange(instance, instance->stru6_ptr, instance->event_data[1]);
                 }
                 break;
 
             case 0xD0: // Channel Pressure
-                channel_data_ptr->channel_pressure = event_data[1];
+                instance->channel_data_ptr->channel_pressure = instance->event_data[1];
                 break;
 
             case 0xE0: // Pitch Bend
-                channel_data_ptr->pitch_bend = event_data[1] + ((event_data[2] - 64) << 7);
+                instance->channel_data_ptr->pitch_bend = instance->event_data[1] + ((instance->event_data[2] - 64) << 7);
                 break;
 
             case 0xF0: // SysEx
-                SystemExclusive();
+                SystemExclusive(instance);
                 break;
 
             default:
                 break;
         }
 
-        event_length = 0;
+        instance->event_length = 0;
     }
 }
 
-static Voice_Data *FindAvailableVoice(int32_t channel_num_2, int32_t note_number)
+static Voice_Data *FindAvailableVoice(VLSG_Instance *instance, int32_t channel_num_2, int32_t note_number)
 {
     int index1, index2, index3, index4;
 
-    index1 = recent_voice_index + 1;
-    if (index1 >= maximum_polyphony)
+    index1 = instance->recent_voice_index + 1;
+    if (index1 >= instance->maximum_polyphony)
     {
         index1 = 0;
     }
 
-    for (index2 = 0; index2 < maximum_polyphony; index2++)
+    for (index2 = 0; index2 < instance->maximum_polyphony; index2++)
     {
-        if (voice_data[index2].note_number == 255)
+        if (instance->voice_data[index2].note_number == 255)
         {
-            recent_voice_index = index2;
-            return &(voice_data[index2]);
+            instance->recent_voice_index = index2;
+            return &(instance->voice_data[index2]);
         }
     }
 
     index3 = index1;
     do
     {
-        if ((voice_data[index3].vflags & VFLAG_Value80) != 0)
+        if ((instance->voice_data[index3].vflags & VFLAG_Value80) != 0)
         {
-            recent_voice_index = index3;
-            return &(voice_data[index3]);
+            instance->recent_voice_index = index3;
+            return &(instance->voice_data[index3]);
         }
 
         index3++;
-        if (index3 >= maximum_polyphony)
+        if (index3 >= instance->maximum_polyphony)
         {
             index3 = 0;
         }
@@ -1371,38 +1600,38 @@ static Voice_Data *FindAvailableVoice(int32_t channel_num_2, int32_t note_number
     index4 = index1;
     do
     {
-        if ((voice_data[index4].channel_num_2 & ~1) == (2 * DRUM_CHANNEL))
+        if ((instance->voice_data[index4].channel_num_2 & ~1) == (2 * DRUM_CHANNEL))
         {
-            recent_voice_index = index4;
-            return &(voice_data[index4]);
+            instance->recent_voice_index = index4;
+            return &(instance->voice_data[index4]);
         }
 
         index4++;
-        if (index4 >= maximum_polyphony)
+        if (index4 >= instance->maximum_polyphony)
         {
             index4 = 0;
         }
     } while (index4 != index1);
 
-    recent_voice_index = index1;
-    return &(voice_data[index1]);
+    instance->recent_voice_index = index1;
+    return &(instance->voice_data[index1]);
 }
 
-static Voice_Data *FindVoice(int32_t channel_num_2, int32_t note_number)
+static Voice_Data *FindVoice(VLSG_Instance *instance, int32_t channel_num_2, int32_t note_number)
 {
     int index;
 
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if (voice_data[index].note_number != 255)
+        if (instance->voice_data[index].note_number != 255)
         {
-            if (voice_data[index].channel_num_2 == channel_num_2)
+            if (instance->voice_data[index].channel_num_2 == channel_num_2)
             {
-                if (voice_data[index].note_number == note_number)
+                if (instance->voice_data[index].note_number == note_number)
                 {
-                    if ((voice_data[index].vflags & VFLAG_Value80) == 0)
+                    if ((instance->voice_data[index].vflags & VFLAG_Value80) == 0)
                     {
-                        return &(voice_data[index]);
+                        return &(instance->voice_data[index]);
                     }
                 }
             }
@@ -1413,217 +1642,218 @@ static Voice_Data *FindVoice(int32_t channel_num_2, int32_t note_number)
     return NULL;
 }
 
-static void NoteOff(void)
+static void NoteOff(VLSG_Instance *instance)
 {
     Voice_Data *voice;
 
-    if ((event_data[0] & 0x0F) == DRUM_CHANNEL)
+    if ((instance->event_data[0] & 0x0F) == DRUM_CHANNEL)
     {
-        if (channel_data_ptr->program_change != 7) return; // drum kit 49 (Orchestra Kit ?)
-        if (event_data[1] != 88) return; // Applause ?
+        if (instance->channel_data_ptr->program_change != 7) return; // drum kit 49 (Orchestra Kit ?)
+        if (instance->event_data[1] != 88) return; // Applause ?
     }
 
-    voice = FindVoice(2 * (event_data[0] & 0x0F), event_data[1]);
+    voice = FindVoice(instance, 2 * (instance->event_data[0] & 0x0F), instance->event_data[1]);
     if (voice != NULL)
     {
-        VoiceNoteOff(voice);
+        VoiceNoteOff(instance, voice);
     }
 
-    voice = FindVoice(2 * (event_data[0] & 0x0F) + 1, event_data[1]);
+    voice = FindVoice(instance, 2 * (instance->event_data[0] & 0x0F) + 1, instance->event_data[1]);
     if (voice != NULL)
     {
-        VoiceNoteOff(voice);
+        VoiceNoteOff(instance, voice);
     }
 }
 
-static void NoteOn(int32_t arg_0)
+static void NoteOn(VLSG_Instance *instance, int32_t arg_0)
 {
     Voice_Data *voice;
 
-    voice = FindAvailableVoice(arg_0 + 2 * (event_data[0] & 0x0F), event_data[1]);
+    voice = FindAvailableVoice(instance, arg_0 + 2 * (instance->event_data[0] & 0x0F), instance->event_data[1]);
     if (voice->note_number != 255)
     {
-        VoiceSoundOff(voice);
+        instance->statistics.voices_stolen++;
+        VoiceSoundOff(instance, voice);
     }
 
-    voice->channel_num_2 = arg_0 + 2 * (event_data[0] & 0x0F);
-    voice->note_number = event_data[1];
-    voice->note_velocity = event_data[2];
-    StartPlayingVoice(voice, channel_data_ptr, &(stru6_ptr->data[14 * arg_0]));
+    voice->channel_num_2 = arg_0 + 2 * (instance->event_data[0] & 0x0F);
+    voice->note_number = instance->event_data[1];
+    voice->note_velocity = instance->event_data[2];
+    StartPlayingVoice(instance, voice, instance->channel_data_ptr, &(instance->stru6_ptr->data[14 * arg_0]));
 }
 
-static void ControlChange(void)
+static void ControlChange(VLSG_Instance *instance)
 {
-    switch (event_data[1])
+    switch (instance->event_data[1])
     {
         case 0x01: // Modulation
-            channel_data_ptr->modulation = event_data[2];
+            instance->channel_data_ptr->modulation = instance->event_data[2];
             break;
         case 0x06: // Data Entry (MSB)
-            channel_data_ptr->data_entry_MSB = event_data[2];
-            if (channel_data_ptr->parameter_number_MSB == 0)
+            instance->channel_data_ptr->data_entry_MSB = instance->event_data[2];
+            if (instance->channel_data_ptr->parameter_number_MSB == 0)
             {
-                if (channel_data_ptr->parameter_number_LSB == 0) // Pitch bend range
+                if (instance->channel_data_ptr->parameter_number_LSB == 0) // Pitch bend range
                 {
-                    if (channel_data_ptr->data_entry_MSB <= 12)
+                    if (instance->channel_data_ptr->data_entry_MSB <= 12)
                     {
-                        channel_data_ptr->pitch_bend_sense = 2 * ((channel_data_ptr->data_entry_MSB << 7) + channel_data_ptr->data_entry_LSB);
+                        instance->channel_data_ptr->pitch_bend_sense = 2 * ((instance->channel_data_ptr->data_entry_MSB << 7) + instance->channel_data_ptr->data_entry_LSB);
                     }
                 }
-                else if (channel_data_ptr->parameter_number_LSB == 1) // Fine tuning
+                else if (instance->channel_data_ptr->parameter_number_LSB == 1) // Fine tuning
                 {
-                    channel_data_ptr->fine_tune = ((channel_data_ptr->data_entry_LSB & 0x60) >> 5) + 4 * channel_data_ptr->data_entry_MSB - 256;
+                    instance->channel_data_ptr->fine_tune = ((instance->channel_data_ptr->data_entry_LSB & 0x60) >> 5) + 4 * instance->channel_data_ptr->data_entry_MSB - 256;
                 }
-                else if (channel_data_ptr->parameter_number_LSB == 2) // Coarse tuning
+                else if (instance->channel_data_ptr->parameter_number_LSB == 2) // Coarse tuning
                 {
-                    if (channel_data_ptr->data_entry_MSB >= 40 && channel_data_ptr->data_entry_MSB <= 88)
+                    if (instance->channel_data_ptr->data_entry_MSB >= 40 && instance->channel_data_ptr->data_entry_MSB <= 88)
                     {
-                        channel_data_ptr->coarse_tune = channel_data_ptr->data_entry_MSB - 64;
+                        instance->channel_data_ptr->coarse_tune = instance->channel_data_ptr->data_entry_MSB - 64;
                     }
                 }
             }
             break;
         case 0x07: // Main Volume
-            channel_data_ptr->volume = event_data[2];
+            instance->channel_data_ptr->volume = instance->event_data[2];
             break;
         case 0x0A: // Pan
-            channel_data_ptr->pan = (2 * event_data[2]) - 128;
+            instance->channel_data_ptr->pan = (2 * instance->event_data[2]) - 128;
             break;
         case 0x0B: // Expression Controller
-            channel_data_ptr->expression = event_data[2];
+            instance->channel_data_ptr->expression = instance->event_data[2];
             break;
         case 0x26: // Data Entry (LSB)
-            channel_data_ptr->data_entry_LSB = event_data[2];
-            if (channel_data_ptr->parameter_number_MSB == 0)
+            instance->channel_data_ptr->data_entry_LSB = instance->event_data[2];
+            if (instance->channel_data_ptr->parameter_number_MSB == 0)
             {
-                if (channel_data_ptr->parameter_number_LSB == 0) // Pitch bend range
+                if (instance->channel_data_ptr->parameter_number_LSB == 0) // Pitch bend range
                 {
-                    if (channel_data_ptr->data_entry_MSB <= 12)
+                    if (instance->channel_data_ptr->data_entry_MSB <= 12)
                     {
-                        channel_data_ptr->pitch_bend_sense = 2 * ((channel_data_ptr->data_entry_MSB << 7) + channel_data_ptr->data_entry_LSB);
+                        instance->channel_data_ptr->pitch_bend_sense = 2 * ((instance->channel_data_ptr->data_entry_MSB << 7) + instance->channel_data_ptr->data_entry_LSB);
                     }
                 }
-                else if (channel_data_ptr->parameter_number_LSB == 1) // Fine tuning
+                else if (instance->channel_data_ptr->parameter_number_LSB == 1) // Fine tuning
                 {
-                    channel_data_ptr->fine_tune = ((channel_data_ptr->data_entry_LSB & 0x60) >> 5) + 4 * channel_data_ptr->data_entry_MSB - 256;
+                    instance->channel_data_ptr->fine_tune = ((instance->channel_data_ptr->data_entry_LSB & 0x60) >> 5) + 4 * instance->channel_data_ptr->data_entry_MSB - 256;
                 }
-                else if (channel_data_ptr->parameter_number_LSB == 2) // Coarse tuning
+                else if (instance->channel_data_ptr->parameter_number_LSB == 2) // Coarse tuning
                 {
-                    if (channel_data_ptr->data_entry_MSB >= 40 && channel_data_ptr->data_entry_MSB <= 88)
+                    if (instance->channel_data_ptr->data_entry_MSB >= 40 && instance->channel_data_ptr->data_entry_MSB <= 88)
                     {
-                        channel_data_ptr->coarse_tune = channel_data_ptr->data_entry_MSB - 64;
+                        instance->channel_data_ptr->coarse_tune = instance->channel_data_ptr->data_entry_MSB - 64;
                     }
                 }
             }
             break;
         case 0x40: // Damper pedal (sustain)
-            if (event_data[2] <= 63)
+            if (instance->event_data[2] <= 63)
             {
-                channel_data_ptr->chflags &= ~CHFLAG_Sustain;
-                ControllerSettingsOff(event_data[0] & 0x0F);
+                instance->channel_data_ptr->chflags &= ~CHFLAG_Sustain;
+                ControllerSettingsOff(instance, instance->event_data[0] & 0x0F);
             }
             else
             {
-                channel_data_ptr->chflags |= CHFLAG_Sustain;
-                ControllerSettingsOn(event_data[0] & 0x0F);
+                instance->channel_data_ptr->chflags |= CHFLAG_Sustain;
+                ControllerSettingsOn(instance, instance->event_data[0] & 0x0F);
             }
             break;
         case 0x42: // Sostenuto
-            if (event_data[2] <= 63)
+            if (instance->event_data[2] <= 63)
             {
-                channel_data_ptr->chflags &= ~CHFLAG_Sostenuto;
-                ControllerSettingsOff(event_data[0] & 0x0F);
+                instance->channel_data_ptr->chflags &= ~CHFLAG_Sostenuto;
+                ControllerSettingsOff(instance, instance->event_data[0] & 0x0F);
             }
             else
             {
-                channel_data_ptr->chflags |= CHFLAG_Sostenuto;
-                ControllerSettingsOn(event_data[0] & 0x0F);
+                instance->channel_data_ptr->chflags |= CHFLAG_Sostenuto;
+                ControllerSettingsOn(instance, instance->event_data[0] & 0x0F);
             }
           break;
         case 0x43: // Soft Pedal
-            if (event_data[2] <= 63)
+            if (instance->event_data[2] <= 63)
             {
-                channel_data_ptr->chflags &= ~CHFLAG_Soft;
+                instance->channel_data_ptr->chflags &= ~CHFLAG_Soft;
             }
             else
             {
-                channel_data_ptr->chflags |= CHFLAG_Soft;
+                instance->channel_data_ptr->chflags |= CHFLAG_Soft;
             }
             break;
         case 0x62: // Non-Registered Parameter Number (LSB)
-            channel_data_ptr->parameter_number_LSB = 255;
+            instance->channel_data_ptr->parameter_number_LSB = 255;
             break;
         case 0x63: // Non-Registered Parameter Number (MSB)
-            channel_data_ptr->parameter_number_MSB = 255;
+            instance->channel_data_ptr->parameter_number_MSB = 255;
             break;
         case 0x64: // Registered Parameter Number (LSB)
-            channel_data_ptr->parameter_number_LSB = event_data[2];
+            instance->channel_data_ptr->parameter_number_LSB = instance->event_data[2];
             break;
         case 0x65: // Registered Parameter Number (MSB)
-            channel_data_ptr->parameter_number_MSB = event_data[2];
+            instance->channel_data_ptr->parameter_number_MSB = instance->event_data[2];
             break;
         case 0x78: // All sounds off
-            AllChannelSoundsOff(event_data[0] & 0x0F);
+            AllChannelSoundsOff(instance, instance->event_data[0] & 0x0F);
             break;
         case 0x79: // Reset all controllers
-            ResetAllControllers(channel_data_ptr);
-            ControllerSettingsOff(event_data[0] & 0x0F);
+            ResetAllControllers(instance->channel_data_ptr);
+            ControllerSettingsOff(instance, instance->event_data[0] & 0x0F);
             break;
         case 0x7B: // All notes off
-            AllChannelNotesOff(event_data[0] & 0x0F);
+            AllChannelNotesOff(instance, instance->event_data[0] & 0x0F);
             break;
         default:
             break;
     }
 }
 
-static void SystemExclusive(void)
+static void SystemExclusive(VLSG_Instance *instance)
 {
     int index;
 
     // GM reset / GS reset
-    if ((event_data[0] == 0xF0 && event_data[1] == 0x7E && event_data[2] == 0x7F && event_data[3] == 0x09 && event_data[4] == 0x01) ||
-        (event_data[0] == 0xF0 && event_data[1] == 0x41 && event_data[2] == 0x10 && event_data[3] == 0x42 && event_data[4] == 0x12 && event_data[5] == 0x40 && event_data[6] == 0x00 && event_data[7] == 0x7F && event_data[8] == 0x00 && event_data[9] == 0x41)
+    if ((instance->event_data[0] == 0xF0 && instance->event_data[1] == 0x7E && instance->event_data[2] == 0x7F && instance->event_data[3] == 0x09 && instance->event_data[4] == 0x01) ||
+        (instance->event_data[0] == 0xF0 && instance->event_data[1] == 0x41 && instance->event_data[2] == 0x10 && instance->event_data[3] == 0x42 && instance->event_data[4] == 0x12 && instance->event_data[5] == 0x40 && instance->event_data[6] == 0x00 && instance->event_data[7] == 0x7F && instance->event_data[8] == 0x00 && instance->event_data[9] == 0x41)
        )
     {
-        AllVoicesSoundsOff();
+        AllVoicesSoundsOff(instance);
 
         for (index = 0; index < MIDI_CHANNELS; index++)
         {
-            ResetChannel(&(channel_data[index]));
+            ResetChannel(&(instance->channel_data[index]));
         }
 
         for (index = 0; index < MIDI_CHANNELS; index++)
         {
-            ProgramChange(&(stru_C0030080[index]), 0);
+            ProgramChange(instance, &(instance->stru_C0030080[index]), 0);
         }
 
         return;
     }
 
     // change polyphony
-    if (event_data[0] == 0xF0 && event_data[1] == 0x44 && event_data[2] == 0x0E && event_data[3] == 0x03)
+    if (instance->event_data[0] == 0xF0 && instance->event_data[1] == 0x44 && instance->event_data[2] == 0x0E && instance->event_data[3] == 0x03)
     {
-        switch (event_data[4])
+        switch (instance->event_data[4])
         {
             case 0x10:
-                SetMaximumVoices(24);
-                maximum_polyphony_new_value = 24;
+                SetMaximumVoices(instance, 24);
+                instance->maximum_polyphony_new_value = 24;
                 return;
 
             case 0x11:
-                SetMaximumVoices(32);
-                maximum_polyphony_new_value = 32;
+                SetMaximumVoices(instance, 32);
+                instance->maximum_polyphony_new_value = 32;
                 return;
 
             case 0x12:
-                SetMaximumVoices(48);
-                maximum_polyphony_new_value = 48;
+                SetMaximumVoices(instance, 48);
+                instance->maximum_polyphony_new_value = 48;
                 return;
 
             case 0x13:
-                maximum_polyphony = 64;
-                maximum_polyphony_new_value = 64;
+                instance->maximum_polyphony = 64;
+                instance->maximum_polyphony_new_value = 64;
                 return;
 
             default:
@@ -1632,22 +1862,22 @@ static void SystemExclusive(void)
     }
 
     // change reverb
-    if (event_data[0] == 0xF0 && event_data[1] == 0x44 && event_data[2] == 0x0E && event_data[3] == 0x03)
+    if (instance->event_data[0] == 0xF0 && instance->event_data[1] == 0x44 && instance->event_data[2] == 0x0E && instance->event_data[3] == 0x03)
     {
-        switch (event_data[4])
+        switch (instance->event_data[4])
         {
             case 0x20:
-                DisableReverb();
+                DisableReverb(instance);
                 return;
 
             case 0x21:
-                EnableReverb();
-                SetReverbShift(1);
+                EnableReverb(instance);
+                SetReverbShift(instance, 1);
                 return;
 
             case 0x22:
-                EnableReverb();
-                SetReverbShift(0);
+                EnableReverb(instance);
+                SetReverbShift(instance, 0);
                 return;
 
             default:
@@ -1656,42 +1886,42 @@ static void SystemExclusive(void)
     }
 
     // change effect
-    if (event_data[0] == 0xF0 && event_data[1] == 0x44 && event_data[2] == 0x0E && event_data[3] == 0x03)
+    if (instance->event_data[0] == 0xF0 && instance->event_data[1] == 0x44 && instance->event_data[2] == 0x0E && instance->event_data[3] == 0x03)
     {
-        switch (event_data[4])
+        switch (instance->event_data[4])
         {
             case 0x40:
-                effect_type = 0;
+                instance->effect_type = 0;
                 return;
             case 0x41:
-                effect_type = 1;
+                instance->effect_type = 1;
                 return;
             case 0x42:
-                effect_type = 2;
+                instance->effect_type = 2;
                 return;
             case 0x43:
-                effect_type = 3;
+                instance->effect_type = 3;
                 return;
             case 0x44:
-                effect_type = 4;
+                instance->effect_type = 4;
                 return;
             case 0x45:
-                effect_type = 5;
+                instance->effect_type = 5;
                 return;
             case 0x46:
-                effect_type = 6;
+                instance->effect_type = 6;
                 return;
             case 0x47:
-                effect_type = 7;
+                instance->effect_type = 7;
                 return;
             case 0x48:
-                effect_type = 8;
+                instance->effect_type = 8;
                 return;
             case 0x49:
-                effect_type = 9;
+                instance->effect_type = 9;
                 return;
             case 0x4A:
-                effect_type = 10;
+                instance->effect_type = 10;
                 return;
             default:
                 break;
@@ -1699,60 +1929,146 @@ static void SystemExclusive(void)
     }
 }
 
-static int32_t InitializeReverbBuffer(void)
+static int32_t InitializeReverbBuffer(VLSG_Instance *instance)
 {
-    reverb_data_ptr = reverb_data_buffer;
-    reverb_data_index = 0;
+    instance->reverb_data_ptr = instance->reverb_data_buffer;
+    instance->reverb_data_index = 0;
     return 0;
 }
 
-static int32_t DeinitializeReverbBuffer(void)
+static int32_t DeinitializeReverbBuffer(VLSG_Instance *instance)
 {
-    reverb_data_ptr = NULL;
+    instance->reverb_data_ptr = NULL;
     return 0;
 }
 
-static void EnableReverb(void)
+static void EnableReverb(VLSG_Instance *instance)
 {
-    is_reverb_enabled = 1;
+    instance->is_reverb_enabled = 1;
 }
 
-static void DisableReverb(void)
+static void DisableReverb(VLSG_Instance *instance)
 {
-    is_reverb_enabled = 0;
-    memset(reverb_data_buffer, 0, sizeof(reverb_data_buffer));
+    instance->is_reverb_enabled = 0;
+    memset(instance->reverb_data_buffer, 0, sizeof(instance->reverb_data_buffer));
 }
 
-static void SetReverbShift(uint32_t shift)
+static void SetReverbShift(VLSG_Instance *instance, uint32_t shift)
 {
-    reverb_shift = shift;
+    instance->reverb_shift = shift;
 }
 
-static void DefragmentVoices(void)
+static void DefragmentVoices(VLSG_Instance *instance)
 {
     int index1, index2;
 
     index2 = 0;
-    for (index1 = 0; index1 < maximum_polyphony; index1++)
+    for (index1 = 0; index1 < instance->maximum_polyphony; index1++)
     {
-        if (voice_data[index1].note_number != 255) continue;
+        if (instance->voice_data[index1].note_number != 255) continue;
 
         if (index2 < index1)
         {
             index2 = index1;
         }
-        while (voice_data[index2].note_number == 255)
+        while (instance->voice_data[index2].note_number == 255)
         {
             index2++;
-            if (index2 >= maximum_polyphony) return;
+            if (index2 >= instance->maximum_polyphony) return;
         }
 
-        voice_data[index1] = voice_data[index2];
-        voice_data[index2].note_number = 255;
+        instance->voice_data[index1] = instance->voice_data[index2];
+        instance->voice_data[index2].note_number = 255;
+    }
+}
+
+// the voice reached the end of the sample data - the sample is looped or the voice is stopped (returns 0)
+static INLINE int LoopVoiceSample(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
+{
+    uint32_t value1, value2, value3;
+    const uint8_t *rom_ptr;
+    int32_t value4, value5;
+
+    value1 = voice_data_ptr->field_04;
+    value2 = voice_data_ptr->field_00 >> 10;
+
+    if (value1 == voice_data_ptr->field_08)
+    {
+        voice_data_ptr->note_number = 255;
+        voice_data_ptr->field_28 = 0;
+        return 0;
+    }
+
+    value3 = (value2 + (voice_data_ptr->field_08 & 1) - value1) & ~1;
+    if (value3 >= 10)
+    {
+        voice_data_ptr->field_00 += (8 - value3) << 10;
+        value3 = 8;
+    }
+
+    rom_ptr = &(instance->romsxgm_ptr[voice_data_ptr->field_04]);
+    value4 = ((int32_t)(READ_LE_UINT16(&(rom_ptr[value3])) << 17)) >> 17;
+    voice_data_ptr->field_1C = (((int32_t)READ_LE_UINT16(&(rom_ptr[10]))) >> (value3 + (value3 >> 1))) & 7;
+
+    voice_data_ptr->field_0C[1] = value4;
+    voice_data_ptr->field_0C[0] = value4 - ((((int32_t)(READ_LE_UINT16(&(instance->romsxgm_ptr[voice_data_ptr->field_08 & ~1])) << 16)) >> 25) << voice_data_ptr->field_1C);
+
+    voice_data_ptr->field_00 += (voice_data_ptr->field_08 - voice_data_ptr->field_04) << 10;
+    value2 = voice_data_ptr->field_00 >> 10;
+    voice_data_ptr->field_20 = (value2 & ~1) + 2;
+    value5 = READ_LE_UINT16(&(instance->romsxgm_ptr[voice_data_ptr->field_20]));
+    voice_data_ptr->field_1C += dword_C00342C0[value5 & 3];
+    voice_data_ptr->field_0C[2] = voice_data_ptr->field_0C[1] + ((((int32_t)(value5 << 23)) >> 25) << voice_data_ptr->field_1C);
+    voice_data_ptr->field_0C[3] = voice_data_ptr->field_0C[2] + ((((int32_t)(value5 << 16)) >> 25) << voice_data_ptr->field_1C);
+
+    return 1;
+}
+
+// decodes the sample data up to the given position
+static INLINE void DecodeVoiceSamples(VLSG_Instance *instance, Voice_Data *voice_data_ptr, uint32_t value2)
+{
+    const uint8_t *rom_ptr;
+    int32_t value4, value5;
+
+    while (voice_data_ptr->field_20 <= (value2 & ~1))
+    {
+        voice_data_ptr->field_20 += 2;
+        if (voice_data_ptr->field_04 <= voice_data_ptr->field_20)
+        {
+            voice_data_ptr->field_0C[0] = voice_data_ptr->field_0C[2];
+            voice_data_ptr->field_0C[1] = voice_data_ptr->field_0C[3];
+
+            if ((voice_data_ptr->field_08 & 1) != 0)
+            {
+                rom_ptr = &(instance->romsxgm_ptr[voice_data_ptr->field_04]);
+                value4 = ((int32_t)(READ_LE_UINT16(rom_ptr) << 17)) >> 17;
+                voice_data_ptr->field_1C = rom_ptr[10] & 7;
+
+                voice_data_ptr->field_0C[2] = value4;
+            }
+            else
+            {
+                rom_ptr = &(instance->romsxgm_ptr[voice_data_ptr->field_04]);
+                value4 = ((int32_t)(READ_LE_UINT16(rom_ptr) << 17)) >> 17;
+                voice_data_ptr->field_1C = rom_ptr[10] & 7;
+
+                voice_data_ptr->field_0C[3] = value4;
+                voice_data_ptr->field_0C[2] = value4 - ((((int32_t)(READ_LE_UINT16(&(instance->romsxgm_ptr[voice_data_ptr->field_08 & ~1])) << 16)) >> 25) << voice_data_ptr->field_1C);
+            }
+        }
+        else
+        {
+            value5 = READ_LE_UINT16(&(instance->romsxgm_ptr[voice_data_ptr->field_20]));
+            voice_data_ptr->field_0C[0] = voice_data_ptr->field_0C[2];
+            voice_data_ptr->field_0C[1] = voice_data_ptr->field_0C[3];
+            voice_data_ptr->field_1C += dword_C00342C0[value5 & 3];
+            voice_data_ptr->field_0C[2] = voice_data_ptr->field_0C[1] + ((((int32_t)(value5 << 23)) >> 25) << voice_data_ptr->field_1C);
+            voice_data_ptr->field_0C[3] = voice_data_ptr->field_0C[2] + ((((int32_t)(value5 << 16)) >> 25) << voice_data_ptr->field_1C);
+        }
     }
 }
 
-static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t offset2)
+static void GenerateOutputData(VLSG_Instance *instance, uint8_t *output_ptr, uint32_t offset1, uint32_t offset2)
 {
     int index1, max_active_index;
     unsigned int index2;
@@ -1760,10 +2076,6 @@ static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t o
     int32_t right;
     uint32_t value1;
     uint32_t value2;
-    uint32_t value3;
-    const uint8_t *rom_ptr;
-    int32_t value4;
-    int32_t value5;
     int32_t value6;
     int32_t value7;
     int32_t reverb_value1;
@@ -1771,12 +2083,12 @@ static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t o
     int32_t reverb_value3;
     int32_t reverb_value4;
 
-    DefragmentVoices();
+    DefragmentVoices(instance);
 
     max_active_index = -1;
-    for (index1 = 0; index1 < maximum_polyphony; index1++)
+    for (index1 = 0; index1 < instance->maximum_polyphony; index1++)
     {
-        if (voice_data[index1].note_number != 255)
+        if (instance->voice_data[index1].note_number != 255)
         {
             max_active_index = index1;
         }
@@ -1788,124 +2100,63 @@ static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t o
         right = 0;
         for (index1 = 0; index1 <= max_active_index; index1++)
         {
-            value1 = voice_data[index1].field_04;
-            value2 = voice_data[index1].field_00 >> 10;
+            value1 = instance->voice_data[index1].field_04;
+            value2 = instance->voice_data[index1].field_00 >> 10;
             if (value2 >= value1)
             {
-                if (value1 == voice_data[index1].field_08)
-                {
-                    voice_data[index1].note_number = 255;
-                    voice_data[index1].field_28 = 0;
-                    continue;
-                }
-
-                value3 = (value2 + (voice_data[index1].field_08 & 1) - value1) & ~1;
-                if (value3 >= 10)
-                {
-                    voice_data[index1].field_00 += (8 - value3) << 10;
-                    value3 = 8;
-                }
-
-                rom_ptr = &(romsxgm_ptr[voice_data[index1].field_04]);
-                value4 = ((int32_t)(READ_LE_UINT16(&(rom_ptr[value3])) << 17)) >> 17;
-                voice_data[index1].field_1C = (((int32_t)READ_LE_UINT16(&(rom_ptr[10]))) >> (value3 + (value3 >> 1))) & 7;
-
-                voice_data[index1].field_0C[1] = value4;
-                voice_data[index1].field_0C[0] = value4 - ((((int32_t)(READ_LE_UINT16(&(romsxgm_ptr[voice_data[index1].field_08 & ~1])) << 16)) >> 25) << voice_data[index1].field_1C);
-
-                voice_data[index1].field_00 += (voice_data[index1].field_08 - voice_data[index1].field_04) << 10;
-                value2 = voice_data[index1].field_00 >> 10;
-                voice_data[index1].field_20 = (value2 & ~1) + 2;
-                value5 = READ_LE_UINT16(&(romsxgm_ptr[voice_data[index1].field_20]));
-                voice_data[index1].field_1C += dword_C00342C0[value5 & 3];
-                voice_data[index1].field_0C[2] = voice_data[index1].field_0C[1] + ((((int32_t)(value5 << 23)) >> 25) << voice_data[index1].field_1C);
-                voice_data[index1].field_0C[3] = voice_data[index1].field_0C[2] + ((((int32_t)(value5 << 16)) >> 25) << voice_data[index1].field_1C);
+                if (!LoopVoiceSample(instance, &(instance->voice_data[index1]))) continue;
+                value2 = instance->voice_data[index1].field_00 >> 10;
             }
             else
             {
-                while (voice_data[index1].field_20 <= (value2 & ~1))
-                {
-                    voice_data[index1].field_20 += 2;
-                    if (voice_data[index1].field_04 <= voice_data[index1].field_20)
-                    {
-                        voice_data[index1].field_0C[0] = voice_data[index1].field_0C[2];
-                        voice_data[index1].field_0C[1] = voice_data[index1].field_0C[3];
-
-                        if ((voice_data[index1].field_08 & 1) != 0)
-                        {
-                            rom_ptr = &(romsxgm_ptr[voice_data[index1].field_04]);
-                            value4 = ((int32_t)(READ_LE_UINT16(rom_ptr) << 17)) >> 17;
-                            voice_data[index1].field_1C = rom_ptr[10] & 7;
-
-                            voice_data[index1].field_0C[2] = value4;
-                        }
-                        else
-                        {
-                            rom_ptr = &(romsxgm_ptr[voice_data[index1].field_04]);
-                            value4 = ((int32_t)(READ_LE_UINT16(rom_ptr) << 17)) >> 17;
-                            voice_data[index1].field_1C = rom_ptr[10] & 7;
-
-                            voice_data[index1].field_0C[3] = value4;
-                            voice_data[index1].field_0C[2] = value4 - ((((int32_t)(READ_LE_UINT16(&(romsxgm_ptr[voice_data[index1].field_08 & ~1])) << 16)) >> 25) << voice_data[index1].field_1C);
-                        }
-                    }
-                    else
-                    {
-                        value5 = READ_LE_UINT16(&(romsxgm_ptr[voice_data[index1].field_20]));
-                        voice_data[index1].field_0C[0] = voice_data[index1].field_0C[2];
-                        voice_data[index1].field_0C[1] = voice_data[index1].field_0C[3];
-                        voice_data[index1].field_1C += dword_C00342C0[value5 & 3];
-                        voice_data[index1].field_0C[2] = voice_data[index1].field_0C[1] + ((((int32_t)(value5 << 23)) >> 25) << voice_data[index1].field_1C);
-                        voice_data[index1].field_0C[3] = voice_data[index1].field_0C[2] + ((((int32_t)(value5 << 16)) >> 25) << voice_data[index1].field_1C);
-                    }
-                }
+                DecodeVoiceSamples(instance, &(instance->voice_data[index1]), value2);
             }
 
-            value7 = voice_data[index1].field_0C[value2 & 1];
-            value7 += ((int32_t)((voice_data[index1].field_0C[(value2 & 1) + 1] - value7) * (voice_data[index1].field_00 & 0x3FF))) >> 10;
-            value6 = ((int32_t)(15 * voice_data[index1].field_2C + voice_data[index1].field_38)) >> 4;
+            value7 = instance->voice_data[index1].field_0C[value2 & 1];
+            value7 += ((int32_t)((instance->voice_data[index1].field_0C[(value2 & 1) + 1] - value7) * (instance->voice_data[index1].field_00 & 0x3FF))) >> 10;
+            value6 = ((int32_t)(15 * instance->voice_data[index1].field_2C + instance->voice_data[index1].field_38)) >> 4;
             value7 = ((int32_t)(value7 * value6)) >> 12;
 
-            voice_data[index1].field_2C = value6;
-            voice_data[index1].field_00 += voice_data[index1].field_24;
-            left += value7 >> voice_data[index1].field_30;
-            right += value7 >> voice_data[index1].field_34;
+            instance->voice_data[index1].field_2C = value6;
+            instance->voice_data[index1].field_00 += instance->voice_data[index1].field_24;
+            left += value7 >> instance->voice_data[index1].field_30;
+            right += value7 >> instance->voice_data[index1].field_34;
         }
 
-        if (is_reverb_enabled == 1)
+        if (instance->is_reverb_enabled == 1)
         {
             reverb_value1 = (left + right) >> 3;
 
-            reverb_value2 = reverb_data_ptr[reverb_data_index & 0x7FFF];
-            reverb_data_ptr[(reverb_data_index + 500) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
+            reverb_value2 = instance->reverb_data_ptr[instance->reverb_data_index & 0x7FFF];
+            instance->reverb_data_ptr[(instance->reverb_data_index + 500) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
             reverb_value1 = (reverb_value1 >> 1) + reverb_value2;
 
-            reverb_value2 = reverb_data_ptr[(reverb_data_index + 501) & 0x7FFF];
-            reverb_data_ptr[(reverb_data_index + 826) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
+            reverb_value2 = instance->reverb_data_ptr[(instance->reverb_data_index + 501) & 0x7FFF];
+            instance->reverb_data_ptr[(instance->reverb_data_index + 826) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
             reverb_value1 = (reverb_value1 >> 1) + reverb_value2;
 
-            reverb_value2 = reverb_data_ptr[(reverb_data_index + 827) & 0x7FFF];
-            reverb_data_ptr[(reverb_data_index + 1038) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
+            reverb_value2 = instance->reverb_data_ptr[(instance->reverb_data_index + 827) & 0x7FFF];
+            instance->reverb_data_ptr[(instance->reverb_data_index + 1038) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
             reverb_value1 = (reverb_value1 >> 1) + reverb_value2;
 
-            reverb_value2 = reverb_data_ptr[(reverb_data_index + 1039) & 0x7FFF];
-            reverb_data_ptr[(reverb_data_index + 1176) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
+            reverb_value2 = instance->reverb_data_ptr[(instance->reverb_data_index + 1039) & 0x7FFF];
+            instance->reverb_data_ptr[(instance->reverb_data_index + 1176) & 0x7FFF] = reverb_value1 - (reverb_value2 >> 1);
             reverb_value1 = (reverb_value1 >> 1) + reverb_value2;
 
             reverb_value3 = reverb_value1 >> 1;
 
-            reverb_value4 = reverb_data_ptr[(reverb_data_index + 1177) & 0x7FFF] - ((96 * reverb_data_ptr[(reverb_data_index + 1179) & 0x7FFF]) >> 8);
-            reverb_data_ptr[(reverb_data_index + 1178) & 0x7FFF] = reverb_value4 >> 3;
-            reverb_data_ptr[(reverb_data_index + 3177) & 0x7FFF] = reverb_value4 + reverb_value3;
+            reverb_value4 = instance->reverb_data_ptr[(instance->reverb_data_index + 1177) & 0x7FFF] - ((96 * instance->reverb_data_ptr[(instance->reverb_data_index + 1179) & 0x7FFF]) >> 8);
+            instance->reverb_data_ptr[(instance->reverb_data_index + 1178) & 0x7FFF] = reverb_value4 >> 3;
+            instance->reverb_data_ptr[(instance->reverb_data_index + 3177) & 0x7FFF] = reverb_value4 + reverb_value3;
 
-            reverb_value4 = reverb_data_ptr[(reverb_data_index + 3178) & 0x7FFF] - ((97 * reverb_data_ptr[(reverb_data_index + 3180) & 0x7FFF]) >> 8);
-            reverb_data_ptr[(reverb_data_index + 3179) & 0x7FFF] = reverb_value4 >> 3;
-            reverb_data_ptr[(reverb_data_index + 5118) & 0x7FFF] = reverb_value4 + reverb_value3;
+            reverb_value4 = instance->reverb_data_ptr[(instance->reverb_data_index + 3178) & 0x7FFF] - ((97 * instance->reverb_data_ptr[(instance->reverb_data_index + 3180) & 0x7FFF]) >> 8);
+            instance->reverb_data_ptr[(instance->reverb_data_index + 3179) & 0x7FFF] = reverb_value4 >> 3;
+            instance->reverb_data_ptr[(instance->reverb_data_index + 5118) & 0x7FFF] = reverb_value4 + reverb_value3;
 
-            left += (reverb_data_ptr[(reverb_data_index + 1179) & 0x7FFF] + reverb_data_ptr[(reverb_data_index + 3335) & 0x7FFF]) >> reverb_shift;
-            right += (reverb_data_ptr[(reverb_data_index + 1339) & 0x7FFF] + reverb_data_ptr[(reverb_data_index + 3180) & 0x7FFF]) >> reverb_shift;
+            left += (instance->reverb_data_ptr[(instance->reverb_data_index + 1179) & 0x7FFF] + instance->reverb_data_ptr[(instance->reverb_data_index + 3335) & 0x7FFF]) >> instance->reverb_shift;
+            right += (instance->reverb_data_ptr[(instance->reverb_data_index + 1339) & 0x7FFF] + instance->reverb_data_ptr[(instance->reverb_data_index + 3180) & 0x7FFF]) >> instance->reverb_shift;
 
-            reverb_data_index = (reverb_data_index + 1) & 0x7FFF;
+            instance->reverb_data_index = (instance->reverb_data_index + 1) & 0x7FFF;
         }
 
         if (left > 32767)
@@ -1931,10 +2182,64 @@ static void GenerateOutputData(uint8_t *output_ptr, uint32_t offset1, uint32_t o
     }
 }
 
-static int32_t InitializeMidiDataBuffer(void)
+// advances the voices the same way as GenerateOutputData, but the output (silence) and reverb aren't generated
+static void SkipOutputData(VLSG_Instance *instance, uint8_t *output_ptr, uint32_t offset1, uint32_t offset2)
 {
-    midi_data_write_index = 0;
-    midi_data_read_index = 0;
+    int index1;
+    uint32_t remaining, count, counter;
+    uint64_t value1;
+    int32_t value6;
+    Voice_Data *voice_data_ptr;
+
+    DefragmentVoices(instance);
+
+    for (index1 = 0; index1 < instance->maximum_polyphony; index1++)
+    {
+        voice_data_ptr = &(instance->voice_data[index1]);
+
+        remaining = offset2 - offset1;
+        while ((remaining != 0) && (voice_data_ptr->note_number != 255))
+        {
+            if ((voice_data_ptr->field_00 >> 10) >= voice_data_ptr->field_04)
+            {
+                if (!LoopVoiceSample(instance, voice_data_ptr)) break;
+                count = 1;
+            }
+            else
+            {
+                // number of samples before the end of the sample data (or before the position overflows)
+                count = remaining;
+                if (voice_data_ptr->field_24 != 0)
+                {
+                    value1 = ((((uint64_t)voice_data_ptr->field_04) << 10) - voice_data_ptr->field_00 + voice_data_ptr->field_24 - 1) / voice_data_ptr->field_24;
+                    if (value1 < count) count = (uint32_t)value1;
+                    value1 = (0xFFFFFFFFu - voice_data_ptr->field_00) / voice_data_ptr->field_24 + 1;
+                    if (value1 < count) count = (uint32_t)value1;
+                }
+
+                DecodeVoiceSamples(instance, voice_data_ptr, (voice_data_ptr->field_00 + (count - 1) * voice_data_ptr->field_24) >> 10);
+            }
+
+            // volume stops changing when it reaches the target
+            for (counter = count; counter != 0; counter--)
+            {
+                value6 = ((int32_t)(15 * voice_data_ptr->field_2C + voice_data_ptr->field_38)) >> 4;
+                if (value6 == voice_data_ptr->field_2C) break;
+                voice_data_ptr->field_2C = value6;
+            }
+
+            voice_data_ptr->field_00 += count * voice_data_ptr->field_24;
+            remaining -= count;
+        }
+    }
+
+    memset(&(output_ptr[offset1 << 2]), 0, (offset2 - offset1) << 2);
+}
+
+static int32_t InitializeMidiDataBuffer(VLSG_Instance *instance)
+{
+    instance->midi_data_write_index = 0;
+    instance->midi_data_read_index = 0;
     return 0;
 }
 
@@ -1943,16 +2248,22 @@ static int32_t EMPTY_DeinitializeMidiDataBuffer(void)
     return 0;
 }
 
-static void AddByteToMidiDataBuffer(uint8_t value)
+static void AddDataToMidiDataBuffer(VLSG_Instance *instance, const uint8_t *ptr, uint32_t len)
 {
     uint32_t write_index;
 
-    write_index = midi_data_write_index;
-    midi_data_buffer[write_index] = value;
-    midi_data_write_index = (write_index + 1) & 0xFFFF;
+    write_index = instance->midi_data_write_index;
+    for (; len != 0; len--)
+    {
+        instance->midi_data_buffer[write_index] = *ptr++;
+        write_index = (write_index + 1) & 0xFFFF;
+    }
+
+    // publish all data at once, so the reader never sees a partial event
+    STORE_RELEASE(instance->midi_data_write_index, write_index);
 }
 
-static uint8_t GetValueFromMidiDataBuffer(void)
+static uint8_t GetValueFromMidiDataBuffer(VLSG_Instance *instance)
 {
     uint32_t write_index, read_index;
     int index;
@@ -1960,8 +2271,8 @@ static uint8_t GetValueFromMidiDataBuffer(void)
     uint32_t time_2;
     uint8_t result;
 
-    write_index = midi_data_write_index;
-    read_index = midi_data_read_index;
+    write_index = LOAD_ACQUIRE(instance->midi_data_write_index);
+    read_index = instance->midi_data_read_index;
     if (write_index == read_index)
     {
         return 0xFF;
@@ -1970,39 +2281,40 @@ static uint8_t GetValueFromMidiDataBuffer(void)
     event_time = 0;
     for (index = 0; index < 4; index++)
     {
-        event_time |= midi_data_buffer[read_index] << (8 * index);
+        event_time |= instance->midi_data_buffer[read_index] << (8 * index);
         read_index = (read_index + 1) & 0xFFFF;
 
         if (write_index == read_index)
         {
-            midi_data_read_index = read_index;
+            instance->midi_data_read_index = read_index;
             return 0xFF;
         }
     }
 
-    time_2 = (system_time_1 >= 600000) ? (system_time_1 - 600000) : 0;
+    time_2 = (instance->system_time_1 >= 600000) ? (instance->system_time_1 - 600000) : 0;
 
-    if ((system_time_1 + 600000 <= event_time) || (time_2 >= event_time))
+    if ((instance->system_time_1 + 600000 <= event_time) || (time_2 >= event_time))
     {
-        AllVoicesSoundsOff();
-        midi_data_read_index = 0;
-        midi_data_write_index = 0;
+        AllVoicesSoundsOff(instance);
+        instance->midi_data_read_index = 0;
+        instance->midi_data_write_index = 0;
         return 0xFF;
     }
 
-    if (event_time + 100 > system_time_1)
+    if (event_time + instance->event_delay > instance->system_time_1)
     {
         return 0xFF;
     }
 
-    result = midi_data_buffer[read_index];
-    midi_data_read_index = (read_index + 1) & 0xFFFF;
+    instance->event_time = event_time;
+    result = instance->midi_data_buffer[read_index];
+    instance->midi_data_read_index = (read_index + 1) & 0xFFFF;
     return result;
 }
 
-static int32_t InitializePhase(void)
+static int32_t InitializePhase(VLSG_Instance *instance)
 {
-    processing_phase = 0;
+    instance->processing_phase = 0;
     return 0;
 }
 
@@ -2017,11 +2329,11 @@ static void sub_C0036A20(Voice_Data *voice_data_ptr)
     voice_data_ptr->field_30 = sub_C0036FB0(voice_data_ptr->field_6A & 0x1F);
 }
 
-static void sub_C0036A80(Voice_Data *voice_data_ptr)
+static void sub_C0036A80(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
 {
     uint32_t offset1;
 
-    offset1 = sub_C00373A0(10, (voice_data_ptr->field_5C >> 8) + sub_C0034970(voice_data_ptr, voice_data_ptr->field_5C & 0xFF));
+    offset1 = sub_C00373A0(instance, 10, (voice_data_ptr->field_5C >> 8) + sub_C0034970(instance, voice_data_ptr, voice_data_ptr->field_5C & 0xFF));
     offset1 += 4 * (voice_data_ptr->vflags & VFLAG_Mask07);
 
     if ((voice_data_ptr->vflags & VFLAG_MaskC0) == VFLAG_Value80)
@@ -2029,19 +2341,19 @@ static void sub_C0036A80(Voice_Data *voice_data_ptr)
         offset1 += 32;
     }
 
-    voice_data_ptr->field_48 = sub_C0037420(offset1);
-    voice_data_ptr->field_4A = sub_C0037400();
+    voice_data_ptr->field_48 = sub_C0037420(instance, offset1);
+    voice_data_ptr->field_4A = sub_C0037400(instance);
     voice_data_ptr->vflags = (voice_data_ptr->vflags & VFLAG_NotMask07) | (voice_data_ptr->field_48 & 7);
 }
 
-static void sub_C0036B00(Voice_Data *voice_data_ptr)
+static void sub_C0036B00(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
 {
     uint32_t offset1;
     uint16_t value1;
     int32_t value2;
     int32_t value3;
 
-    offset1 = sub_C00373A0(11, (voice_data_ptr->field_5E >> 8) + sub_C0034970(voice_data_ptr, voice_data_ptr->field_5E & 0xFF));
+    offset1 = sub_C00373A0(instance, 11, (voice_data_ptr->field_5E >> 8) + sub_C0034970(instance, voice_data_ptr, voice_data_ptr->field_5E & 0xFF));
     offset1 += (voice_data_ptr->vflags & VFLAG_Mask38) >> 1;
 
     if ((voice_data_ptr->vflags & VFLAG_MaskC0) == VFLAG_Value80)
@@ -2049,7 +2361,7 @@ static void sub_C0036B00(Voice_Data *voice_data_ptr)
         offset1 += 32;
     }
 
-    value1 = sub_C0037420(offset1);
+    value1 = sub_C0037420(instance, offset1);
     value1 = ((voice_data_ptr->field_62 * (value1 >> 8)) & 0xFF00) | (value1 & 0xFF);
     voice_data_ptr->field_4E = value1;
 
@@ -2059,7 +2371,7 @@ static void sub_C0036B00(Voice_Data *voice_data_ptr)
         return;
     }
 
-    value2 = sub_C0037400() >> 8;
+    value2 = sub_C0037400(instance) >> 8;
     if ((value2 & 0xE0) == 0x20)
     {
         value3 = (value2 & 0x1F) << 8;
@@ -2089,58 +2401,58 @@ static void sub_C0036B00(Voice_Data *voice_data_ptr)
     voice_data_ptr->field_50 = value3;
 }
 
-static void sub_C0036C20(Voice_Data *voice_data_ptr)
+static void sub_C0036C20(VLSG_Instance *instance, Voice_Data *voice_data_ptr)
 {
     int32_t value0;
 
-    value0 = channel_data[voice_data_ptr->channel_num_2 >> 1].expression * channel_data[voice_data_ptr->channel_num_2 >> 1].volume;
+    value0 = instance->channel_data[voice_data_ptr->channel_num_2 >> 1].expression * instance->channel_data[voice_data_ptr->channel_num_2 >> 1].volume;
     value0 = ((int32_t)(value0 * value0)) >> 13;
     voice_data_ptr->field_64 = ((int32_t)(value0 * voice_data_ptr->field_60)) >> 7;
 
     sub_C0036A20(voice_data_ptr);
 }
 
-static void ProcessPhase(void)
+static void ProcessPhase(VLSG_Instance *instance)
 {
     int phase, index, value;
     Channel_Data *channel;
 
-    phase = processing_phase & 7;
-    processing_phase++;
+    phase = instance->processing_phase & 7;
+    instance->processing_phase++;
 
     switch ( phase )
     {
         case 0:
-            sub_C0037140();
+            sub_C0037140(instance);
 
-            for (index = 0; index < maximum_polyphony; index++)
+            for (index = 0; index < instance->maximum_polyphony; index++)
             {
-                if (voice_data[index].note_number != 255)
+                if (instance->voice_data[index].note_number != 255)
                 {
-                    voice_data[index].field_54 += dword_C0032188[voice_data[index].field_5A + 112];
+                    instance->voice_data[index].field_54 += dword_C0032188[instance->voice_data[index].field_5A + 112];
                 }
             }
 
             break;
 
         case 1:
-            sub_C0037140();
-            sub_C0036FE0();
+            sub_C0037140(instance);
+            sub_C0036FE0(instance);
             break;
 
         case 2:
-            sub_C0037140();
+            sub_C0037140(instance);
             break;
 
         case 3:
-            sub_C0037140();
+            sub_C0037140(instance);
 
-            for (index = 0; index < maximum_polyphony; index++)
+            for (index = 0; index < instance->maximum_polyphony; index++)
             {
-                if (voice_data[index].note_number != 255)
+                if (instance->voice_data[index].note_number != 255)
                 {
-                    channel = &(channel_data[voice_data[index].channel_num_2 >> 1]);
-                    value = voice_data[index].field_58 + channel->channel_pressure + channel->modulation;
+                    channel = &(instance->channel_data[instance->voice_data[index].channel_num_2 >> 1]);
+                    value = instance->voice_data[index].field_58 + channel->channel_pressure + channel->modulation;
                     if (value > 127)
                     {
                         value = 127;
@@ -2150,42 +2462,42 @@ static void ProcessPhase(void)
                         value = 0;
                     }
 
-                    sub_C0034890(&(voice_data[index]), (int16_t)(voice_data[index].field_44 + (((int32_t)(value * (voice_data[index].field_54 >> 8))) >> 7) + (voice_data[index].field_4C >> 3)));
+                    sub_C0034890(instance, &(instance->voice_data[index]), (int16_t)(instance->voice_data[index].field_44 + (((int32_t)(value * (instance->voice_data[index].field_54 >> 8))) >> 7) + (instance->voice_data[index].field_4C >> 3)));
                 }
             }
 
             break;
 
         case 4:
-            for (index = 0; index < maximum_polyphony; index++)
+            for (index = 0; index < instance->maximum_polyphony; index++)
             {
-                if (voice_data[index].note_number != 255)
+                if (instance->voice_data[index].note_number != 255)
                 {
-                    sub_C0036C20(&(voice_data[index]));
+                    sub_C0036C20(instance, &(instance->voice_data[index]));
                 }
             }
 
-            sub_C0037140();
+            sub_C0037140(instance);
             break;
 
         case 5:
-            sub_C0037140();
-            sub_C0036FE0();
+            sub_C0037140(instance);
+            sub_C0036FE0(instance);
             break;
 
         case 6:
-            sub_C0037140();
+            sub_C0037140(instance);
             break;
 
         case 7:
-            sub_C0037140();
+            sub_C0037140(instance);
 
-            for (index = 0; index < maximum_polyphony; index++)
+            for (index = 0; index < instance->maximum_polyphony; index++)
             {
-                if (voice_data[index].note_number != 255)
+                if (instance->voice_data[index].note_number != 255)
                 {
-                    channel = &(channel_data[voice_data[index].channel_num_2 >> 1]);
-                    value = voice_data[index].field_58 + channel->channel_pressure + channel->modulation;
+                    channel = &(instance->channel_data[instance->voice_data[index].channel_num_2 >> 1]);
+                    value = instance->voice_data[index].field_58 + channel->channel_pressure + channel->modulation;
                     if (value > 127)
                     {
                         value = 127;
@@ -2195,7 +2507,7 @@ static void ProcessPhase(void)
                         value = 0;
                     }
 
-                    sub_C0034890(&(voice_data[index]), (int16_t)(voice_data[index].field_44 + (((int32_t)(value * (voice_data[index].field_54 >> 8))) >> 7) + (voice_data[index].field_4C >> 3)));
+                    sub_C0034890(instance, &(instance->voice_data[index]), (int16_t)(instance->voice_data[index].field_44 + (((int32_t)(value * (instance->voice_data[index].field_54 >> 8))) >> 7) + (instance->voice_data[index].field_4C >> 3)));
                 }
             }
 
@@ -2224,20 +2536,20 @@ static int32_t sub_C0036FB0(int16_t value3)
     return value1;
 }
 
-static void sub_C0036FE0(void)
+static void sub_C0036FE0(VLSG_Instance *instance)
 {
     int index;
     int32_t value1, value2, value3;
 
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if (voice_data[index].note_number == 255) continue;
+        if (instance->voice_data[index].note_number == 255) continue;
 
-        value1 = voice_data[index].field_48;
-        value2 = voice_data[index].field_4C;
+        value1 = instance->voice_data[index].field_48;
+        value2 = instance->voice_data[index].field_4C;
         if (value1 > value2)
         {
-            value3 = value2 + voice_data[index].field_4A;
+            value3 = value2 + instance->voice_data[index].field_4A;
             if (value3 > 32767)
             {
                 value3 = 32767;
@@ -2245,13 +2557,13 @@ static void sub_C0036FE0(void)
 
             if (value1 > value3)
             {
-                voice_data[index].field_4C = value3;
+                instance->voice_data[index].field_4C = value3;
                 continue;
             }
         }
         else
         {
-            value3 = value2 - voice_data[index].field_4A;
+            value3 = value2 - instance->voice_data[index].field_4A;
             if (value3 < -32767)
             {
                 value3 = -32767;
@@ -2259,29 +2571,29 @@ static void sub_C0036FE0(void)
 
             if (value1 < value3)
             {
-                voice_data[index].field_4C = value3;
+                instance->voice_data[index].field_4C = value3;
                 continue;
             }
         }
 
-        voice_data[index].field_4C = value1;
+        instance->voice_data[index].field_4C = value1;
 
-        sub_C0036A80(&(voice_data[index]));
+        sub_C0036A80(instance, &(instance->voice_data[index]));
     }
 }
 
-static void sub_C0037140(void)
+static void sub_C0037140(VLSG_Instance *instance)
 {
     int index, choice, index2;
     int32_t value1, value2, value3;
 
-    for (index = 0; index < maximum_polyphony; index++)
+    for (index = 0; index < instance->maximum_polyphony; index++)
     {
-        if (voice_data[index].note_number == 255) continue;
+        if (instance->voice_data[index].note_number == 255) continue;
 
-        value1 = voice_data[index].field_52;
-        value2 = voice_data[index].field_50;
-        value3 = voice_data[index].field_4E & 0xFF00;
+        value1 = instance->voice_data[index].field_52;
+        value2 = instance->voice_data[index].field_50;
+        value3 = instance->voice_data[index].field_4E & 0xFF00;
 
         if (value3 > value1)
         {
@@ -2306,53 +2618,53 @@ static void sub_C0037140(void)
 
         if (choice)
         {
-            voice_data[index].field_52 = value3;
+            instance->voice_data[index].field_52 = value3;
             index2 = (value3 & 0x7fff) >> 11;
-            voice_data[index].field_28 = word_C00342D0[index2] + (((int32_t)((word_C00342D0[index2 + 1] - word_C00342D0[index2]) * (value3 & 0x07ff))) >> 11);
-            sub_C0036B00(&(voice_data[index]));
+            instance->voice_data[index].field_28 = word_C00342D0[index2] + (((int32_t)((word_C00342D0[index2 + 1] - word_C00342D0[index2]) * (value3 & 0x07ff))) >> 11);
+            sub_C0036B00(instance, &(instance->voice_data[index]));
         }
         else
         {
-            voice_data[index].field_52 = value1;
+            instance->voice_data[index].field_52 = value1;
             index2 = (value1 & 0x7fff) >> 11;
-            voice_data[index].field_28 = word_C00342D0[index2] + (((int32_t)((word_C00342D0[index2 + 1] - word_C00342D0[index2]) * (value1 & 0x07ff))) >> 11);
+            instance->voice_data[index].field_28 = word_C00342D0[index2] + (((int32_t)((word_C00342D0[index2 + 1] - word_C00342D0[index2]) * (value1 & 0x07ff))) >> 11);
         }
 
-        voice_data[index].field_38 = ((int32_t)(voice_data[index].field_28 * voice_data[index].field_64)) >> 14;
+        instance->voice_data[index].field_38 = ((int32_t)(instance->voice_data[index].field_28 * instance->voice_data[index].field_64)) >> 14;
     }
 }
 
-static int32_t InitializeStructures(void)
+static int32_t InitializeStructures(VLSG_Instance *instance)
 {
     int index;
 
     for (index = 0; index < MAX_VOICES; index++)
     {
-        voice_data[index].note_number = 255;
+        instance->voice_data[index].note_number = 255;
     }
 
     for (index = 0; index < MIDI_CHANNELS; index++)
     {
-        channel_data[index].program_change = 0;
-        channel_data[index].pitch_bend = 0;
-        channel_data[index].channel_pressure = 0;
-        channel_data[index].modulation = 0;
-        channel_data[index].volume = 100;
-        channel_data[index].pan = 0;
-        channel_data[index].expression = 127;
-        channel_data[index].chflags &= ~CHFLAG_Sustain;
-        channel_data[index].pitch_bend_sense = 512;
-        channel_data[index].fine_tune = 0;
-        channel_data[index].coarse_tune = 0;
-        channel_data[index].parameter_number_LSB = 255;
-        channel_data[index].parameter_number_MSB = 255;
-        channel_data[index].data_entry_MSB = 0;
-        channel_data[index].data_entry_LSB = 0;
+        instance->channel_data[index].program_change = 0;
+        instance->channel_data[index].pitch_bend = 0;
+        instance->channel_data[index].channel_pressure = 0;
+        instance->channel_data[index].modulation = 0;
+        instance->channel_data[index].volume = 100;
+        instance->channel_data[index].pan = 0;
+        instance->channel_data[index].expression = 127;
+        instance->channel_data[index].chflags &= ~CHFLAG_Sustain;
+        instance->channel_data[index].pitch_bend_sense = 512;
+        instance->channel_data[index].fine_tune = 0;
+        instance->channel_data[index].coarse_tune = 0;
+        instance->channel_data[index].parameter_number_LSB = 255;
+        instance->channel_data[index].parameter_number_MSB = 255;
+        instance->channel_data[index].data_entry_MSB = 0;
+        instance->channel_data[index].data_entry_LSB = 0;
     }
 
     for (index = 0; index < MIDI_CHANNELS; index++)
     {
-        ProgramChange(&(stru_C0030080[index]), 0);
+        ProgramChange(instance, &(instance->stru_C0030080[index]), 0);
     }
 
     return 0;
@@ -2395,32 +2707,32 @@ static void ResetChannel(Channel_Data *channel_data_ptr)
     channel_data_ptr->data_entry_LSB = 0;
 }
 
-static uint32_t sub_C00373A0(uint32_t arg_0, int32_t arg_4)
+static uint32_t sub_C00373A0(VLSG_Instance *instance, uint32_t arg_0, int32_t arg_4)
 {
     const uint8_t *address1;
     uint32_t offset1;
     int32_t offset2;
 
-    address1 = &(romsxgm_ptr[4 * arg_0 + 65588]);
+    address1 = &(instance->romsxgm_ptr[4 * arg_0 + 65588]);
     offset1 = (READ_LE_UINT16(address1 + 2) << 8) + (READ_LE_UINT16(address1) >> 8);
-    offset2 = 4 + arg_4 * (int16_t)READ_LE_UINT16(romsxgm_ptr + offset1 + 2);
+    offset2 = 4 + arg_4 * (int16_t)READ_LE_UINT16(instance->romsxgm_ptr + offset1 + 2);
 
-    rom_offset = offset1 + offset2;
-    return rom_offset;
+    instance->rom_offset = offset1 + offset2;
+    return instance->rom_offset;
 }
 
-static uint16_t sub_C0037400(void)
+static uint16_t sub_C0037400(VLSG_Instance *instance)
 {
     uint16_t result;
 
-    result = READ_LE_UINT16(romsxgm_ptr + rom_offset);
-    rom_offset += 2;
+    result = READ_LE_UINT16(instance->romsxgm_ptr + instance->rom_offset);
+    instance->rom_offset += 2;
     return result;
 }
 
-static int16_t sub_C0037420(uint32_t arg_0)
+static int16_t sub_C0037420(VLSG_Instance *instance, uint32_t arg_0)
 {
-    rom_offset = arg_0 + 2;
-    return (int16_t)READ_LE_UINT16(romsxgm_ptr + arg_0);
+    instance->rom_offset = arg_0 + 2;
+    return (int16_t)READ_LE_UINT16(instance->romsxgm_ptr + arg_0);
 }
 
@@ -34,8 +34,28 @@ enum ParameterType
     PARAMETER_Frequency     = 3,
     PARAMETER_Polyphony     = 4,
     PARAMETER_Effect        = 5,
+
+    // extensions (not present in VLSG.DLL)
+    PARAMETER_SubBlocks     = 0x100,
+    PARAMETER_FastForward   = 0x101,    // nonzero = only the synthesizer state is advanced, output is silent
+    PARAMETER_EventDelay    = 0x102,    // delay of MIDI event processing in milliseconds (0 - 1000, default = 100)
 };
 
+typedef struct VLSG_Instance VLSG_Instance;
+
+// extensions (not present in VLSG.DLL)
+// counters are updated only by the thread which fills the output buffer and are never reset
+typedef struct
+{
+    uint32_t events;                // number of processed MIDI events
+    uint32_t event_delay[8];        // histogram of event delay after its scheduled time: < 1 ms, < 2 ms, < 4 ms, ..., < 64 ms, >= 64 ms
+    uint32_t voices_stolen;         // number of notes which took over a sounding voice
+    uint32_t polyphony_reductions;  // number of voice reductions because of slow output buffer filling
+    int32_t active_voices;          // number of active voices after the last filled output buffer
+    int32_t peak_voices;            // maximal number of active voices
+    int32_t maximum_polyphony;      // current maximal number of voices
+} VLSG_Statistics;
+
 uint32_t VLSG_GetVersion(void);
 const char *VLSG_GetName(void);
 void VLSG_SetFunc_GetTime(uint32_t (*get_time)(void));
@@ -46,5 +66,23 @@ int32_t VLSG_PlaybackStop(void);
 void VLSG_AddMidiData(const uint8_t *ptr, uint32_t len);
 int32_t VLSG_FillOutputBuffer(uint32_t output_buffer_counter);
 
+// extensions (not present in VLSG.DLL)
+// independent synthesizer instances - each instance can be used from a different thread
+VLSG_Instance *VLSG_CreateInstance(void);
+void VLSG_DestroyInstance(VLSG_Instance *instance);
+void VLSG_InstanceSetFunc_GetTime(VLSG_Instance *instance, uint32_t (*get_time)(void *context), void *context);
+
+int32_t VLSG_InstanceSetParameter(VLSG_Instance *instance, uint32_t type, uintptr_t value);
+int32_t VLSG_InstancePlaybackStart(VLSG_Instance *instance);
+int32_t VLSG_InstancePlaybackStop(VLSG_Instance *instance);
+void VLSG_InstanceAddMidiData(VLSG_Instance *instance, const uint8_t *ptr, uint32_t len);
+int32_t VLSG_InstanceFillOutputBuffer(VLSG_Instance *instance, uint32_t output_buffer_counter);
+void VLSG_InstanceGetStatistics(VLSG_Instance *instance, VLSG_Statistics *statistics);
+// returns 1 when the instance produces only silence (no active voices, no waiting MIDI data and reverb tail finished)
+int32_t VLSG_InstanceIsSilent(VLSG_Instance *instance);
+// move channel settings (programs, controllers, effects) and unprocessed MIDI data to another (started) instance, sounding voices aren't moved
+// neither instance can be used by other threads during the call
+void VLSG_InstanceMoveState(VLSG_Instance *destination, VLSG_Instance *source);
+
 #endif
 
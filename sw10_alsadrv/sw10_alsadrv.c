@@ -33,9 +33,22 @@
 #include <dirent.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <pwd.h>
+#include <sched.h>
+#include <malloc.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <alsa/asoundlib.h>
 #include "VLSG.h"
+#include "sw10_ingress.h"
+#include "sw10_resampler.h"
+#include "sw10_session.h"
 
 #ifdef PANDORA
 #define secure_getenv __secure_getenv
@@ -44,27 +57,187 @@
 
 #define ROMSIZE (2 * 1024 * 1024)
 
+#define MAX_SYNTHS 8
+
+enum Output_Type
+{
+    OUTPUT_ALSA,        // ALSA PCM device
+    OUTPUT_NULL,        // discard data, paced by timer
+    OUTPUT_UNPACED,     // discard data, as fast as possible
+    OUTPUT_WAV,         // WAV file, paced by timer
+    OUTPUT_RAW,         // raw PCM file, paced by timer
+};
+
+#define MAX_INGRESS_CLIENTS 16
+#define INGRESS_QUEUE_SIZE 4096
+
+#define RENDER_TIME_BUCKETS 10
+#define OUTPUT_FILL_BUCKETS 8
+
+enum Control_Request
+{
+    CONTROL_NONE,
+    CONTROL_SWAP,       // swap synthesizer instances between blocks (render thread)
+    CONTROL_FREQUENCY,  // change output frequency (main thread)
+};
+
+#define SESSION_BUFFER_SIZE (1024 * 1024)
+
+// sizes in the WAV header are 32-bit values
+#define WAV_MAX_FRAMES ((0xFFFFFFFFu - 36) / 4)
+
+#define PREFAULT_STACK_SIZE (256 * 1024)
+#define PREFAULT_HEAP_SIZE (4 * 1024 * 1024)
+
 
 static const char midi_name[] = "CASIO SW-10";
 static const char port_name[] = "CASIO SW-10 port";
 
 static snd_seq_t *midi_seq;
-static int midi_port_id;
+static int midi_port_id[MAX_SYNTHS];
+static int midi_queue_id = -1;
+static snd_rawmidi_t *midi_rawmidi;
 static pthread_t midi_thread;
+static int midi_stop_pipe[2] = { -1, -1 };
+static int midi_thread_started;
 static snd_pcm_t *midi_pcm;
 static volatile int midi_init_state;
 static volatile int midi_event_written;
+static volatile int output_suspended;
+static sem_t resume_wakeup;
+static volatile sig_atomic_t exit_requested;
+static volatile sig_atomic_t stats_requested;
 
-static int frequency, polyphony, reverb_effect, daemonize;
+static int frequency, polyphony, reverb_effect, daemonize, num_synths;
 static const char *rom_filepath = "ROMSXGM.BIN";
+static const char *rawmidi_device;
+static const char *stats_socket_path;
+static const char *ingress_socket_path;
+static const char *ingress_ring_name;
+static const char *control_socket_path;
+static int output_type;
+static const char *output_filepath;
+static const char *pcm_device = "default";
+static unsigned int requested_rate;
+static int resample_quality;
+static unsigned int target_latency, period_frames, num_periods;
+static int event_delay;
+static int custom_buffer;
+static int rt_priority, render_cpu, midi_cpu, lock_memory;
+static unsigned int render_ahead;
 
 static uint8_t *rom_address;
 static uint32_t outbuf_counter;
-static unsigned int bytes_per_call, samples_per_call;
+static unsigned int bytes_per_call, samples_per_call, sub_blocks;
+static snd_pcm_uframes_t pcm_buffer_size, pcm_period_size;
+static snd_pcm_sframes_t write_threshold;
+
+static FILE *output_file;
+static unsigned int output_rate;
+static unsigned int output_block_frames;
+static sw10_resampler *resampler;
+static uint8_t *resample_buffer;
+static struct timespec output_start_time;
+static int64_t output_queued_frames;
+static uint64_t output_file_frames;
+static unsigned long output_underruns;
 static uint8_t midi_buffer[65536];
+static uint8_t midi_running_status[MAX_SYNTHS];
+static uint8_t event_batch[MAX_SYNTHS][5 * 2048];
+static unsigned int event_batch_length[MAX_SYNTHS];
 static uint8_t *midi_buf[16];
+static const uint8_t silence_buffer[65536 / 16];
+
+static VLSG_Instance *synth_instance[MAX_SYNTHS];
+static uint8_t *synth_buffer[MAX_SYNTHS];
+static uint8_t block_silent[16];
+static int output_dropped;
+static pthread_t render_thread[MAX_SYNTHS];
+static sem_t render_start[MAX_SYNTHS];
+static sem_t render_done;
+static uint32_t render_counter;
+
+static pthread_t ahead_thread;
+static sem_t ahead_wakeup, ahead_ready;
+static volatile uint32_t ahead_produced, ahead_consumed;
+static volatile unsigned int ahead_lead;
+static volatile int ahead_idle;
+static volatile int ahead_waiting;
+static volatile int ahead_stop;
+static int ahead_thread_started;
+static unsigned int ahead_min_level;
+static unsigned long ahead_near_misses;
+static time_t ahead_shrink_time;
+
+static int ingress_enabled, input_locking;
+static pthread_mutex_t synth_input_mutex[MAX_SYNTHS];
+static int ingress_socket = -1;
+static pthread_t ingress_socket_thread;
+static sw10_ingress_ring *ingress_ring;
+static pthread_t ingress_ring_thread;
+static int ingress_stop_pipe[2] = { -1, -1 };
+static volatile int ingress_stopping;
+static int ingress_socket_started, ingress_ring_started, ingress_queue_started;
+static uint8_t ingress_packet[SW10_INGRESS_MAX_PACKET];
+static uint8_t ingress_ring_record[SW10_INGRESS_RING_SIZE];
+
+typedef struct
+{
+    uint64_t time;
+    uint32_t sequence;  // records with the same time keep their order
+    uint16_t port;
+    uint16_t length;
+    uint8_t data[];
+} ingress_queued_record;
+
+// records with future time wait in a heap ordered by time, so they don't delay the following records in the synthesizer
+static ingress_queued_record *ingress_queue[INGRESS_QUEUE_SIZE];
+static unsigned int ingress_queue_length;
+static uint32_t ingress_queue_sequence;
+static pthread_mutex_t ingress_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ingress_queue_cond;
+static pthread_t ingress_queue_thread;
+
+static int control_socket = -1;
+static pthread_t control_thread;
+static sem_t control_done;
+static volatile int control_pending;
+static int control_frequency, control_result;
+static unsigned int control_sub_blocks;
+static VLSG_Instance *control_instance[MAX_SYNTHS];
+static VLSG_Instance *retired_instance[MAX_SYNTHS];
+static uint8_t *fade_buffer[MAX_SYNTHS];
+
+static const char *session_log_path;
+static int session_fd = -1;
+static volatile int session_recording;
+static pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t session_thread;
+static sem_t session_wakeup;
+static uint8_t *session_buffer[2];
+static unsigned int session_length[2];
+static int session_current;
+
+static int stats_socket = -1;
+static pthread_t stats_thread;
+static struct timespec stats_start_time;
+
+// each statistics counter has only one writer thread, the counters are read without synchronization
+static uint32_t stats_midi_events;
+static uint32_t stats_ingress_records;
+static uint32_t stats_blocks;
+static uint32_t stats_render_time[RENDER_TIME_BUCKETS];
+static uint32_t stats_render_time_max;
+static uint32_t stats_output_fill[OUTPUT_FILL_BUCKETS];
+static uint32_t stats_ring_level[16];
+
+static uint8_t rawmidi_status, rawmidi_data[3];
+static unsigned int rawmidi_length, rawmidi_expected, rawmidi_skip;
+static int rawmidi_sysex;
 
 static struct timespec start_time;
+static int64_t queue_time_offset;
+static uint32_t queue_sync_time;
 
 #if defined(CLOCK_MONOTONIC_RAW)
     static clockid_t monotonic_clock_id;
@@ -84,17 +257,159 @@ static uint32_t VLSG_GetTime(void)
     return ((_tp.tv_sec - start_time.tv_sec) * 1000) + ((_tp.tv_nsec - start_time.tv_nsec) / 1000000);
 }
 
+// session mutex must be locked, space for the end record is always kept free
+static void write_session_end(uint32_t reason)
+{
+    sw10_session_record record;
+    uint8_t *buffer;
+
+    record.type = SW10_SESSION_END;
+    record.synth = 0;
+    record.length = 4;
+
+    buffer = session_buffer[session_current] + session_length[session_current];
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), &reason, 4);
+    session_length[session_current] += sizeof(record) + 4;
+
+    session_recording = 0;
+}
+
+// records are appended from the render, MIDI, ingress and control threads
+static void append_session_record(int type, int synth_index, const void *data, unsigned int length)
+{
+    sw10_session_record record;
+    unsigned int used;
+    int wakeup;
+
+    pthread_mutex_lock(&session_mutex);
+
+    if (!session_recording)
+    {
+        pthread_mutex_unlock(&session_mutex);
+        return;
+    }
+
+    used = session_length[session_current];
+    if (used + sizeof(record) + length > SESSION_BUFFER_SIZE - (sizeof(record) + 4))
+    {
+        // the log can't be written fast enough, so it's ended instead of losing records
+        write_session_end(SW10_SESSION_END_OVERFLOW);
+        pthread_mutex_unlock(&session_mutex);
+        sem_post(&session_wakeup);
+        fprintf(stderr, "Session log overflow, recording stopped\n");
+        return;
+    }
+
+    record.type = type;
+    record.synth = synth_index;
+    record.length = length;
+
+    memcpy(session_buffer[session_current] + used, &record, sizeof(record));
+    memcpy(session_buffer[session_current] + used + sizeof(record), data, length);
+    session_length[session_current] = used + sizeof(record) + length;
+
+    // the writer thread also wakes up periodically, so it's woken up only when the buffer is half full
+    wakeup = (used < SESSION_BUFFER_SIZE / 2) && (session_length[session_current] >= SESSION_BUFFER_SIZE / 2);
+
+    pthread_mutex_unlock(&session_mutex);
+
+    if (wakeup)
+    {
+        sem_post(&session_wakeup);
+    }
+}
+
+static void record_session_midi(int synth_index, const uint8_t *data, unsigned int length)
+{
+    unsigned int chunk;
+
+    for (; length != 0; length -= chunk, data += chunk)
+    {
+        chunk = (length < SW10_SESSION_MAX_RECORD) ? length : SW10_SESSION_MAX_RECORD;
+        append_session_record(SW10_SESSION_MIDI, synth_index, data, chunk);
+    }
+}
+
+static void stop_session_log(uint32_t reason)
+{
+    pthread_mutex_lock(&session_mutex);
+    if (session_recording)
+    {
+        write_session_end(reason);
+    }
+    pthread_mutex_unlock(&session_mutex);
+
+    sem_post(&session_wakeup);
+}
+
+static uint32_t get_synth_time(void *context)
+{
+    uint32_t time;
+
+    time = VLSG_GetTime();
+
+    // context is the synthesizer index
+    if (session_recording)
+    {
+        append_session_record(SW10_SESSION_TIME, (intptr_t)context, &time, 4);
+    }
+
+    return time;
+}
+
+static int64_t get_time_us(void)
+{
+    struct timespec _tp;
+
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &_tp);
 
-static void set_thread_scheduler(void) __attribute__((noinline));
-static void set_thread_scheduler(void)
+    return ((int64_t)(_tp.tv_sec - start_time.tv_sec) * 1000000) + ((_tp.tv_nsec - start_time.tv_nsec) / 1000);
+}
+
+
+static void set_thread_scheduler(const char *thread_name) __attribute__((noinline));
+static void set_thread_scheduler(const char *thread_name)
 {
     struct sched_param param;
+    int err;
 
     memset(&param, 0, sizeof(struct sched_param));
-    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
-    if (param.sched_priority > 0)
+    if (rt_priority == 0)
     {
-        sched_setscheduler(0, SCHED_FIFO, &param);
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        if (param.sched_priority > 0)
+        {
+            sched_setscheduler(0, SCHED_FIFO, &param);
+        }
+        return;
+    }
+
+    param.sched_priority = rt_priority;
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        fprintf(stderr, "Warning: unable to set real-time priority %i for %s thread: %s\n", rt_priority, thread_name, strerror(err));
+    }
+}
+
+static void set_thread_affinity(int cpu, const char *thread_name) __attribute__((noinline));
+static void set_thread_affinity(int cpu, const char *thread_name)
+{
+    cpu_set_t cpuset;
+    int err;
+
+    if (cpu < 0)
+    {
+        return;
+    }
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (err != 0)
+    {
+        fprintf(stderr, "Warning: unable to pin %s thread to CPU %i: %s\n", thread_name, cpu, strerror(err));
     }
 }
 
@@ -144,43 +459,216 @@ static inline void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
     ptr[3] = (value >> 24) & 0xff;
 }
 
-static void write_event(const uint8_t *event, unsigned int length)
+static void sync_queue_time(void)
 {
-    uint8_t event_time[4];
+    snd_seq_queue_status_t *status;
+    const snd_seq_real_time_t *real_time;
+    int64_t time_before, time_after;
 
-    WRITE_LE_UINT32(event_time, VLSG_GetTime());
+    snd_seq_queue_status_alloca(&status);
 
-    for (; length != 0; length--,event++)
+    time_before = get_time_us();
+    if (snd_seq_get_queue_status(midi_seq, midi_queue_id, status) < 0)
+    {
+        return;
+    }
+    time_after = get_time_us();
+
+    real_time = snd_seq_queue_status_get_real_time(status);
+
+    // difference between engine time and queue time (in microseconds)
+    queue_time_offset = ((time_before + time_after) / 2) - (((int64_t)real_time->tv_sec * 1000000) + (real_time->tv_nsec / 1000));
+    queue_sync_time = (uint32_t)(time_after / 1000);
+}
+
+static uint32_t get_event_time(const snd_seq_event_t *event)
+{
+    uint32_t current_time;
+    int64_t time;
+
+    current_time = VLSG_GetTime();
+
+    // use arrival time for events without real-time timestamp from our queue
+    if ((midi_queue_id < 0) || (event->queue != midi_queue_id) || ((event->flags & SND_SEQ_TIME_STAMP_MASK) != SND_SEQ_TIME_STAMP_REAL))
+    {
+        return current_time;
+    }
+
+    // resynchronize queue time with engine time every second to compensate for clock drift
+    if (current_time - queue_sync_time >= 1000)
+    {
+        sync_queue_time();
+    }
+
+    time = (((int64_t)event->time.time.tv_sec * 1000000) + (event->time.time.tv_nsec / 1000) + queue_time_offset) / 1000;
+
+    // event time can't be in the future
+    if ((time < 0) || ((int32_t)((uint32_t)time - current_time) > 0))
     {
-        VLSG_AddMidiData(event_time, 4);
-        VLSG_AddMidiData(event, 1);
+        return current_time;
     }
 
+    return (uint32_t)time;
+}
+
+static void signal_midi_event(void)
+{
     midi_event_written = 1;
+
+    // wake up the main thread only when the output is suspended
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&output_suspended, __ATOMIC_RELAXED))
+    {
+        sem_post(&resume_wakeup);
+    }
+}
+
+static void flush_synth_events(int synth_index)
+{
+    if (event_batch_length[synth_index] == 0)
+    {
+        return;
+    }
+
+    // publish the whole batch to the render thread at once
+    if (input_locking)
+    {
+        pthread_mutex_lock(&(synth_input_mutex[synth_index]));
+        VLSG_InstanceAddMidiData(synth_instance[synth_index], event_batch[synth_index], event_batch_length[synth_index]);
+        if (session_recording)
+        {
+            record_session_midi(synth_index, event_batch[synth_index], event_batch_length[synth_index]);
+        }
+        pthread_mutex_unlock(&(synth_input_mutex[synth_index]));
+
+        // other inputs can write to the synthesizer between batches, so running status can't continue in the next batch
+        midi_running_status[synth_index] = 0;
+    }
+    else
+    {
+        VLSG_InstanceAddMidiData(synth_instance[synth_index], event_batch[synth_index], event_batch_length[synth_index]);
+        if (session_recording)
+        {
+            record_session_midi(synth_index, event_batch[synth_index], event_batch_length[synth_index]);
+        }
+    }
+    event_batch_length[synth_index] = 0;
+
+    signal_midi_event();
+}
+
+static void flush_events(void)
+{
+    int synth_index;
+
+    for (synth_index = 0; synth_index < num_synths; synth_index++)
+    {
+        flush_synth_events(synth_index);
+    }
+}
+
+static void reserve_event_space(int synth_index, unsigned int count)
+{
+    if (event_batch_length[synth_index] + 5 * count > sizeof(event_batch[0]))
+    {
+        flush_synth_events(synth_index);
+    }
+}
+
+static inline void write_event_byte(int synth_index, uint8_t value, uint32_t time)
+{
+    uint8_t *batch_ptr;
+
+    batch_ptr = &(event_batch[synth_index][event_batch_length[synth_index]]);
+    WRITE_LE_UINT32(batch_ptr, time);
+    batch_ptr[4] = value;
+    event_batch_length[synth_index] += 5;
+}
+
+static void write_event(int synth_index, const uint8_t *event, unsigned int length, uint32_t time)
+{
+    stats_midi_events++;
+
+    for (; length != 0; length--,event++)
+    {
+        reserve_event_space(synth_index, 1);
+        write_event_byte(synth_index, *event, time);
+    }
+
+    // keep space for the next short event, so it's never split from the batch whose running status it uses
+    reserve_event_space(synth_index, 3);
+}
+
+static void write_message(int synth_index, uint8_t status, uint8_t data1, uint8_t data2, unsigned int length, uint32_t time, uint8_t *running_status)
+{
+    stats_midi_events++;
+
+    // the space for one message is always kept in the batch
+    if (status >= 0xF8)
+    {
+        // real-time messages don't change the running status
+        write_event_byte(synth_index, status, time);
+    }
+    else if (status >= 0xF0)
+    {
+        *running_status = 0;
+        write_event_byte(synth_index, status, time);
+    }
+    else if (status != *running_status)
+    {
+        *running_status = status;
+        write_event_byte(synth_index, status, time);
+    }
+
+    if (length > 1)
+    {
+        write_event_byte(synth_index, data1, time);
+    }
+    if (length > 2)
+    {
+        write_event_byte(synth_index, data2, time);
+    }
+
+    reserve_event_space(synth_index, 3);
+}
+
+static void write_message_data(int synth_index, uint8_t data1, uint8_t data2, uint32_t time)
+{
+    // next message with the same status (the caller reserves the space)
+    write_event_byte(synth_index, data1, time);
+    write_event_byte(synth_index, data2, time);
+}
+
+static int get_port_synth(int port)
+{
+    int synth_index;
+
+    for (synth_index = 0; synth_index < num_synths; synth_index++)
+    {
+        if (midi_port_id[synth_index] == port)
+        {
+            return synth_index;
+        }
+    }
+
+    return 0;
 }
 
 static void process_event(snd_seq_event_t *event, uint8_t *running_status)
 {
-    uint8_t data[12];
-    int length;
+    int synth_index;
+    uint32_t time;
+
+    time = get_event_time(event);
+
+    // each port has its own synthesizer
+    synth_index = get_port_synth(event->dest.port);
+    running_status = &(running_status[synth_index]);
 
     switch (event->type)
     {
         case SND_SEQ_EVENT_NOTEON:
-            data[0] = 0x90 | event->data.note.channel;
-            data[1] = event->data.note.note;
-            data[2] = event->data.note.velocity;
-            length = 3;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0x90 | event->data.note.channel, event->data.note.note, event->data.note.velocity, 3, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Note ON, channel:%d note:%d velocity:%d\n", event->data.note.channel, event->data.note.note, event->data.note.velocity);
@@ -190,20 +678,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
 
         case SND_SEQ_EVENT_NOTEOFF:
             // send note off event as note on with zero velocity to increase the chance of using running status
-            data[0] = 0x90 | event->data.note.channel;
-            data[1] = event->data.note.note;
-            data[2] = 0;
-            length = 3;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0x90 | event->data.note.channel, event->data.note.note, 0, 3, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Note OFF, channel:%d note:%d velocity:%d\n", event->data.note.channel, event->data.note.note, event->data.note.velocity);
@@ -214,20 +689,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_KEYPRESS:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xA0 | event->data.note.channel;
-            data[1] = event->data.note.note;
-            data[2] = event->data.note.velocity;
-            length = 3;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0xA0 | event->data.note.channel, event->data.note.note, event->data.note.velocity, 3, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -237,20 +699,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_CONTROLLER:
-            data[0] = 0xB0 | event->data.control.channel;
-            data[1] = event->data.control.param;
-            data[2] = event->data.control.value;
-            length = 3;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0xB0 | event->data.control.channel, event->data.control.param, event->data.control.value, 3, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Controller, channel:%d param:%d value:%d\n", event->data.control.channel, event->data.control.param, event->data.control.value);
@@ -259,19 +708,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_PGMCHANGE:
-            data[0] = 0xC0 | event->data.control.channel;
-            data[1] = event->data.control.value;
-            length = 2;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0xC0 | event->data.control.channel, event->data.control.value, 0, 2, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Program change, channel:%d value:%d\n", event->data.control.channel, event->data.control.value);
@@ -280,19 +717,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_CHANPRESS:
-            data[0] = 0xD0 | event->data.control.channel;
-            data[1] = event->data.control.value;
-            length = 2;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0xD0 | event->data.control.channel, event->data.control.value, 0, 2, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Channel pressure, channel:%d value:%d\n", event->data.control.channel, event->data.control.value);
@@ -301,20 +726,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_PITCHBEND:
-            data[0] = 0xE0 | event->data.control.channel;
-            data[1] = (event->data.control.value + 0x2000) & 0x7f;
-            data[2] = ((event->data.control.value + 0x2000) >> 7) & 0x7f;
-            length = 3;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            write_message(synth_index, 0xE0 | event->data.control.channel, (event->data.control.value + 0x2000) & 0x7f, ((event->data.control.value + 0x2000) >> 7) & 0x7f, 3, time, running_status);
 
 #ifdef PRINT_EVENTS
             printf("Pitch bend, channel:%d value:%d\n", event->data.control.channel, event->data.control.value);
@@ -325,22 +737,10 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_CONTROL14:
             if (event->data.control.param >= 0 && event->data.control.param < 32)
             {
-                data[0] = 0xB0 | event->data.control.channel;
-                data[1] = event->data.control.param;
-                data[2] = (event->data.control.value >> 7) & 0x7f;
-                data[3] = event->data.control.param + 32;
-                data[4] = event->data.control.value & 0x7f;
-                length = 5;
-
-                if (data[0] != *running_status)
-                {
-                    *running_status = data[0];
-                    write_event(data, length);
-                }
-                else
-                {
-                    write_event(data + 1, length - 1);
-                }
+                // both messages are written to the same batch
+                reserve_event_space(synth_index, 5);
+                write_message(synth_index, 0xB0 | event->data.control.channel, event->data.control.param, (event->data.control.value >> 7) & 0x7f, 3, time, running_status);
+                write_message_data(synth_index, event->data.control.param + 32, event->data.control.value & 0x7f, time);
 
 #ifdef PRINT_EVENTS
                 printf("Controller 14-bit, channel:%d param:%d value:%d\n", event->data.control.channel, event->data.control.param, event->data.control.value);
@@ -358,26 +758,13 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_NONREGPARAM:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xB0 | event->data.control.channel;
-            data[1] = 0x63; // NRPN MSB
-            data[2] = (event->data.control.param >> 7) & 0x7f;
-            data[3] = 0x62; // NRPN LSB
-            data[4] = event->data.control.param & 0x7f;
-            data[5] = 0x06; // data entry MSB
-            data[6] = (event->data.control.value >> 7) & 0x7f;
-            data[7] = 0x26; // data entry LSB
-            data[8] = event->data.control.value & 0x7f;
-            length = 9;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            // all messages are written to the same batch
+            reserve_event_space(synth_index, 9);
+            write_message(synth_index, 0xB0 | event->data.control.channel, 0x63, (event->data.control.param >> 7) & 0x7f, 3, time, running_status); // NRPN MSB
+            write_message_data(synth_index, 0x62, event->data.control.param & 0x7f, time); // NRPN LSB
+            write_message_data(synth_index, 0x06, (event->data.control.value >> 7) & 0x7f, time); // data entry MSB
+            write_message_data(synth_index, 0x26, event->data.control.value & 0x7f, time); // data entry LSB
+            reserve_event_space(synth_index, 3);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -387,26 +774,13 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_REGPARAM:
-            data[0] = 0xB0 | event->data.control.channel;
-            data[1] = 0x65; // RPN MSB
-            data[2] = (event->data.control.param >> 7) & 0x7f;
-            data[3] = 0x64; // RPN LSB
-            data[4] = event->data.control.param & 0x7f;
-            data[5] = 0x06; // data entry MSB
-            data[6] = (event->data.control.value >> 7) & 0x7f;
-            data[7] = 0x26; // data entry LSB
-            data[8] = event->data.control.value & 0x7f;
-            length = 9;
-
-            if (data[0] != *running_status)
-            {
-                *running_status = data[0];
-                write_event(data, length);
-            }
-            else
-            {
-                write_event(data + 1, length - 1);
-            }
+            // all messages are written to the same batch
+            reserve_event_space(synth_index, 9);
+            write_message(synth_index, 0xB0 | event->data.control.channel, 0x65, (event->data.control.param >> 7) & 0x7f, 3, time, running_status); // RPN MSB
+            write_message_data(synth_index, 0x64, event->data.control.param & 0x7f, time); // RPN LSB
+            write_message_data(synth_index, 0x06, (event->data.control.value >> 7) & 0x7f, time); // data entry MSB
+            write_message_data(synth_index, 0x26, event->data.control.value & 0x7f, time); // data entry LSB
+            reserve_event_space(synth_index, 3);
 
 #ifdef PRINT_EVENTS
             printf("RPN, channel:%d param:%d value:%d\n", event->data.control.channel, event->data.control.param, event->data.control.value);
@@ -415,10 +789,8 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
             break;
 
         case SND_SEQ_EVENT_SYSEX:
-            length = event->data.ext.len;
-
             *running_status = 0;
-            write_event(event->data.ext.ptr, length);
+            write_event(synth_index, event->data.ext.ptr, event->data.ext.len, time);
 
 #ifdef PRINT_EVENTS
             printf("SysEx (fragment) of size %d\n", event->data.ext.len);
@@ -429,12 +801,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_QFRAME:
             // Not handled by CASIO SW-10
 #if 0
-            data[0] = 0xF1;
-            data[1] = ev->data.control.value;
-            length = 2;
-
-            *running_status = 0;
-            write_event(data, length);
+            write_message(synth_index, 0xF1, event->data.control.value, 0, 2, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -446,13 +813,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_SONGPOS:
             // Not handled by CASIO SW-10
 #if 0
-            data[0] = 0xF2;
-            data[1] = (event->data.control.value + 0x2000) & 0x7f;
-            data[2] = ((event->data.control.value + 0x2000) >> 7) & 0x7f;
-            length = 3;
-
-            *running_status = 0;
-            write_event(data, length);
+            write_message(synth_index, 0xF2, (event->data.control.value + 0x2000) & 0x7f, ((event->data.control.value + 0x2000) >> 7) & 0x7f, 3, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -464,12 +825,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_SONGSEL:
             // Not handled by CASIO SW-10
 #if 0
-            data[0] = 0xF3;
-            data[1] = ev->data.control.value;
-            length = 2;
-
-            *running_status = 0;
-            write_event(data, length);
+            write_message(synth_index, 0xF3, event->data.control.value, 0, 2, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -481,11 +837,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_TUNE_REQUEST:
             // Not handled by CASIO SW-10
 #if 0
-            data[0] = 0xF6;
-            length = 1;
-
-            *running_status = 0;
-            write_event(data, length);
+            write_message(synth_index, 0xF6, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -497,10 +849,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_CLOCK:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xF8;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xF8, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -512,10 +861,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_TICK:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xF9;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xF9, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -527,10 +873,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_START:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xFA;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xFA, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -542,10 +885,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_CONTINUE:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xFB;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xFB, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -557,10 +897,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_STOP:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xFC;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xFC, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -572,10 +909,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_SENSING:
             // Not used by CASIO SW-10
 #if 0
-            data[0] = 0xFE;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xFE, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -587,10 +921,7 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
         case SND_SEQ_EVENT_RESET:
             // Not handled correctly by CASIO SW-10
 #if 0
-            data[0] = 0xFF;
-            length = 1;
-
-            write_event(data, length);
+            write_message(synth_index, 0xFF, 0, 0, 1, time, running_status);
 #endif
 
 #ifdef PRINT_EVENTS
@@ -613,696 +944,3685 @@ static void process_event(snd_seq_event_t *event, uint8_t *running_status)
     }
 }
 
-static void *midi_thread_proc(void *arg)
+static void process_rawmidi_data(const uint8_t *buf, unsigned int length, uint32_t time, uint8_t *running_status)
 {
-    snd_seq_event_t *event;
-    uint8_t running_status;
+    uint8_t value;
 
-    // try setting thread scheduler (only root)
-    set_thread_scheduler();
+    for (; length != 0; length--, buf++)
+    {
+        value = *buf;
+
+        // ignore real-time messages (0xFF is also used by the engine as "no data")
+        if (value >= 0xF8) continue;
+
+        if (value & 0x80)
+        {
+            if (rawmidi_sysex)
+            {
+                static const uint8_t sysex_end = 0xF7;
+
+                // the engine expects the SysEx to be terminated by 0xF7, also when it's ended by another status byte
+                rawmidi_sysex = 0;
+                write_event(0, &sysex_end, 1, time);
+
+                if (value == 0xF7)
+                {
+                    continue;
+                }
+            }
+
+            if (value == 0xF0)
+            {
+                rawmidi_sysex = 1;
+                rawmidi_status = 0;
+                *running_status = 0;
+                write_event(0, &value, 1, time);
+            }
+            else if (value > 0xF0)
+            {
+                // ignore system common messages (they cancel running status)
+                rawmidi_status = 0;
+                rawmidi_skip = (value == 0xF2) ? 2 : (((value == 0xF1) || (value == 0xF3)) ? 1 : 0);
+            }
+            else
+            {
+                rawmidi_status = value;
+                rawmidi_length = 0;
+                rawmidi_expected = ((value & 0xE0) == 0xC0) ? 1 : 2;
+                rawmidi_skip = 0;
+            }
+
+            continue;
+        }
+
+        if (rawmidi_sysex)
+        {
+            write_event(0, &value, 1, time);
+            continue;
+        }
+
+        if (rawmidi_skip != 0)
+        {
+            rawmidi_skip--;
+            continue;
+        }
+
+        // ignore data without status
+        if (rawmidi_status == 0) continue;
+
+        rawmidi_length++;
+        rawmidi_data[rawmidi_length] = value;
+        if (rawmidi_length < rawmidi_expected) continue;
+
+        rawmidi_length = 0;
+
+        if ((rawmidi_status & 0xF0) == 0x80)
+        {
+            // send note off event as note on with zero velocity to increase the chance of using running status
+            write_message(0, 0x90 | (rawmidi_status & 0x0F), rawmidi_data[1], 0, 3, time, running_status);
+        }
+        else
+        {
+            write_message(0, rawmidi_status, rawmidi_data[1], rawmidi_data[2], rawmidi_expected + 1, time, running_status);
+        }
+    }
+}
+
+static void rawmidi_input_loop(uint8_t *running_status)
+{
+    uint8_t buffer[256];
+    ssize_t count;
+    struct pollfd fds[8];
+    int num_fds;
+
+    // the device is opened in non-blocking mode, the stop pipe wakes the thread at exit
+    num_fds = snd_rawmidi_poll_descriptors(midi_rawmidi, fds, 7);
+    if (num_fds < 0)
+    {
+        num_fds = 0;
+    }
+    fds[num_fds].fd = midi_stop_pipe[0];
+    fds[num_fds].events = POLLIN;
+
+    while (midi_init_state > 0)
+    {
+        if (poll(fds, num_fds + 1, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+
+            fprintf(stderr, "Error waiting for raw MIDI input: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[num_fds].revents != 0)
+        {
+            break;
+        }
+
+        // read all available data
+        for (;;)
+        {
+            count = snd_rawmidi_read(midi_rawmidi, buffer, sizeof(buffer));
+            if (count <= 0)
+            {
+                break;
+            }
+
+            process_rawmidi_data(buffer, count, VLSG_GetTime(), running_status);
+        }
+
+        if ((count < 0) && (count != -EAGAIN) && (count != -EINTR))
+        {
+            fprintf(stderr, "Error reading raw MIDI input: %i\n%s\n", (int)count, snd_strerror(count));
+            flush_events();
+            break;
+        }
+
+        flush_events();
+    }
+}
+
+static void *midi_thread_proc(void *arg)
+{
+    snd_seq_event_t *event;
+    uint8_t *running_status;
+    struct pollfd fds[8];
+    int num_fds;
+
+    // try setting thread scheduler (only root)
+    set_thread_scheduler("MIDI");
+    set_thread_affinity(midi_cpu, "MIDI");
 
     // set thread as initialized
     *(int *)arg = 1;
 
     wait_for_midi_initialization();
 
-    running_status = 0;
+    running_status = midi_running_status;
+    memset(running_status, 0, sizeof(midi_running_status));
+
+    if (midi_rawmidi != NULL)
+    {
+        rawmidi_input_loop(&(running_status[0]));
+        return NULL;
+    }
+
+    if (midi_seq == NULL)
+    {
+        return NULL;
+    }
+
+    // the sequencer is in non-blocking mode, the stop pipe wakes the thread at exit
+    num_fds = snd_seq_poll_descriptors(midi_seq, fds, 7, POLLIN);
+    if (num_fds < 0)
+    {
+        num_fds = 0;
+    }
+    fds[num_fds].fd = midi_stop_pipe[0];
+    fds[num_fds].events = POLLIN;
 
     while (midi_init_state > 0)
     {
-        if (snd_seq_event_input(midi_seq, &event) < 0)
+        if (poll(fds, num_fds + 1, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+
+            fprintf(stderr, "Error waiting for MIDI input: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[num_fds].revents != 0)
+        {
+            break;
+        }
+
+        // process all available events
+        while (snd_seq_event_input(midi_seq, &event) >= 0)
+        {
+            process_event(event, running_status);
+        }
+
+        flush_events();
+    }
+
+    return NULL;
+}
+
+static uint32_t get_ingress_time(uint64_t record_time)
+{
+    uint32_t current_time;
+    uint64_t now;
+
+    current_time = VLSG_GetTime();
+    if (record_time == 0)
+    {
+        return current_time;
+    }
+
+    now = sw10_ingress_time_now();
+    if (record_time >= now)
+    {
+        // limit the time to 60 seconds in future
+        if (record_time - now > 60000000)
+        {
+            return current_time + 60000;
+        }
+
+        return current_time + (uint32_t)((record_time - now) / 1000);
+    }
+
+    // late records keep their timing while they are within the synthesizer delay
+    if (now - record_time > 100000)
+    {
+        return current_time;
+    }
+
+    return current_time - (uint32_t)((now - record_time) / 1000);
+}
+
+static void enable_input_locking(void)
+{
+    int index;
+
+    if (input_locking)
+    {
+        return;
+    }
+
+    for (index = 0; index < num_synths; index++)
+    {
+        pthread_mutex_init(&(synth_input_mutex[index]), NULL);
+    }
+    input_locking = 1;
+}
+
+// write complete MIDI message from other thread than MIDI thread (buffer must have space for 5 * length bytes)
+static void write_synth_message(int synth_index, const uint8_t *data, unsigned int length, uint32_t time, uint8_t *buffer)
+{
+    unsigned int index;
+
+    for (index = 0; index < length; index++)
+    {
+        WRITE_LE_UINT32(buffer + 5 * index, time);
+        buffer[5 * index + 4] = data[index];
+    }
+
+    pthread_mutex_lock(&(synth_input_mutex[synth_index]));
+    VLSG_InstanceAddMidiData(synth_instance[synth_index], buffer, 5 * length);
+    if (session_recording)
+    {
+        record_session_midi(synth_index, buffer, 5 * length);
+    }
+    pthread_mutex_unlock(&(synth_input_mutex[synth_index]));
+
+    signal_midi_event();
+}
+
+static int ingress_record_before(const ingress_queued_record *record1, const ingress_queued_record *record2)
+{
+    return (record1->time < record2->time) || ((record1->time == record2->time) && ((int32_t)(record1->sequence - record2->sequence) < 0));
+}
+
+static int queue_ingress_record(const sw10_ingress_header *header, const uint8_t *data, uint64_t now)
+{
+    ingress_queued_record *record;
+    unsigned int index, parent;
+
+    record = (ingress_queued_record *) malloc(sizeof(ingress_queued_record) + header->length);
+    if (record == NULL)
+    {
+        return -1;
+    }
+
+    // limit the time to 60 seconds in future
+    record->time = (header->time - now > 60000000) ? now + 60000000 : header->time;
+    record->port = header->port;
+    record->length = header->length;
+    memcpy(record->data, data, header->length);
+
+    pthread_mutex_lock(&ingress_queue_mutex);
+
+    if (ingress_queue_length >= INGRESS_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&ingress_queue_mutex);
+        free(record);
+        return -2;
+    }
+
+    record->sequence = ingress_queue_sequence++;
+
+    // insert the record into the heap
+    for (index = ingress_queue_length; index != 0; index = parent)
+    {
+        parent = (index - 1) / 2;
+        if (!ingress_record_before(record, ingress_queue[parent])) break;
+
+        ingress_queue[index] = ingress_queue[parent];
+    }
+    ingress_queue[index] = record;
+    ingress_queue_length++;
+
+    // wake the queue thread, if the record is the first one
+    if (index == 0)
+    {
+        pthread_cond_signal(&ingress_queue_cond);
+    }
+
+    pthread_mutex_unlock(&ingress_queue_mutex);
+
+    return 0;
+}
+
+static ingress_queued_record *remove_first_ingress_record(void)
+{
+    ingress_queued_record *first, *last;
+    unsigned int index, child;
+
+    first = ingress_queue[0];
+    ingress_queue_length--;
+    last = ingress_queue[ingress_queue_length];
+
+    // move the last record down from the top of the heap
+    for (index = 0; 2 * index + 1 < ingress_queue_length; index = child)
+    {
+        child = 2 * index + 1;
+        if ((child + 1 < ingress_queue_length) && ingress_record_before(ingress_queue[child + 1], ingress_queue[child])) child++;
+        if (!ingress_record_before(ingress_queue[child], last)) break;
+
+        ingress_queue[index] = ingress_queue[child];
+    }
+    ingress_queue[index] = last;
+
+    return first;
+}
+
+static void *ingress_queue_proc(void *arg)
+{
+    static uint8_t buffer[5 * 2048];
+    ingress_queued_record *record;
+    struct timespec wait_time;
+
+    pthread_mutex_lock(&ingress_queue_mutex);
+
+    while (!__atomic_load_n(&ingress_stopping, __ATOMIC_SEQ_CST))
+    {
+        if (ingress_queue_length == 0)
+        {
+            pthread_cond_wait(&ingress_queue_cond, &ingress_queue_mutex);
+            continue;
+        }
+
+        record = ingress_queue[0];
+        if (record->time > sw10_ingress_time_now())
+        {
+            // wait until the first record is due or an earlier record is queued
+            wait_time.tv_sec = record->time / 1000000;
+            wait_time.tv_nsec = (record->time % 1000000) * 1000;
+            pthread_cond_timedwait(&ingress_queue_cond, &ingress_queue_mutex, &wait_time);
+            continue;
+        }
+
+        remove_first_ingress_record();
+        pthread_mutex_unlock(&ingress_queue_mutex);
+
+        write_synth_message(record->port, record->data, record->length, get_ingress_time(record->time), buffer);
+        free(record);
+
+        pthread_mutex_lock(&ingress_queue_mutex);
+    };
+
+    pthread_mutex_unlock(&ingress_queue_mutex);
+
+    return NULL;
+}
+
+static void write_ingress_record(const sw10_ingress_header *header, const uint8_t *data, uint8_t *buffer)
+{
+    uint64_t now;
+
+    // only complete messages can be written, because other inputs use the same synthesizer
+    if ((header->port >= num_synths) || (header->length == 0) || (header->length > 2048) || (data[0] < 0x80) || (data[0] == 0xF7))
+    {
+        fprintf(stderr, "Invalid ingress record: port %i, length %i\n", header->port, header->length);
+        return;
+    }
+
+    __atomic_fetch_add(&stats_ingress_records, 1, __ATOMIC_RELAXED);
+
+    // records with future time are written when they're due (when the queue is full, they're written immediately)
+    if (header->time != 0)
+    {
+        now = sw10_ingress_time_now();
+        if ((header->time > now) && (queue_ingress_record(header, data, now) == 0))
+        {
+            return;
+        }
+    }
+
+    write_synth_message(header->port, data, header->length, get_ingress_time(header->time), buffer);
+}
+
+static void *ingress_socket_proc(void *arg)
+{
+    struct pollfd fds[2 + MAX_INGRESS_CLIENTS];
+    static uint8_t buffer[5 * 2048];
+    sw10_ingress_header header;
+    unsigned int num_fds, index;
+    ssize_t length, offset;
+    int client;
+
+    // the stop pipe wakes the thread at exit
+    fds[0].fd = ingress_stop_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = ingress_socket;
+    fds[1].events = POLLIN;
+    num_fds = 2;
+
+    while (1)
+    {
+        if (poll(fds, num_fds, -1) < 0)
+        {
+            continue;
+        }
+
+        if (fds[0].revents != 0)
+        {
+            break;
+        }
+
+        for (index = num_fds - 1; index >= 2; index--)
+        {
+            if (fds[index].revents == 0) continue;
+
+            length = recv(fds[index].fd, ingress_packet, sizeof(ingress_packet), 0);
+            if (length <= 0)
+            {
+                // client disconnected
+                close(fds[index].fd);
+                num_fds--;
+                fds[index] = fds[num_fds];
+                continue;
+            }
+
+            // packet contains one or more records
+            for (offset = 0; offset + (ssize_t)sizeof(header) <= length; offset += sizeof(header) + header.length)
+            {
+                memcpy(&header, ingress_packet + offset, sizeof(header));
+                if (offset + (ssize_t)sizeof(header) + header.length > length) break;
+
+                write_ingress_record(&header, ingress_packet + offset + sizeof(header), buffer);
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            client = accept(ingress_socket, NULL, NULL);
+            if (client >= 0)
+            {
+                if (num_fds < 2 + MAX_INGRESS_CLIENTS)
+                {
+                    fds[num_fds].fd = client;
+                    fds[num_fds].events = POLLIN;
+                    fds[num_fds].revents = 0;
+                    num_fds++;
+                }
+                else
+                {
+                    close(client);
+                }
+            }
+        }
+    };
+
+    for (index = 2; index < num_fds; index++)
+    {
+        close(fds[index].fd);
+    }
+
+    return NULL;
+}
+
+static void *ingress_ring_proc(void *arg)
+{
+    static uint8_t buffer[5 * 2048];
+    sw10_ingress_header header;
+    uint32_t read_index, write_index, wakeup;
+
+    while (!__atomic_load_n(&ingress_stopping, __ATOMIC_SEQ_CST))
+    {
+        read_index = ingress_ring->read_index;
+        write_index = __atomic_load_n(&ingress_ring->write_index, __ATOMIC_ACQUIRE);
+
+        if (read_index == write_index)
         {
+            // sleep until the producer writes new data
+            wakeup = __atomic_load_n(&ingress_ring->wakeup, __ATOMIC_ACQUIRE);
+            __atomic_store_n(&ingress_ring->waiting, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+            // the wakeup counter is also incremented at exit, after setting ingress_stopping
+            if ((__atomic_load_n(&ingress_ring->write_index, __ATOMIC_ACQUIRE) == read_index) && !__atomic_load_n(&ingress_stopping, __ATOMIC_SEQ_CST))
+            {
+                syscall(SYS_futex, &ingress_ring->wakeup, FUTEX_WAIT, wakeup, NULL, NULL, 0);
+            }
+
+            __atomic_store_n(&ingress_ring->waiting, 0, __ATOMIC_RELAXED);
             continue;
         }
 
-        process_event(event, &running_status);
+        while (write_index - read_index >= sizeof(header))
+        {
+            sw10_ingress_ring_copy_out(ingress_ring, read_index, &header, sizeof(header));
+            if (write_index - read_index < sizeof(header) + header.length)
+            {
+                // producer never writes partial records - skip the invalid data
+                read_index = write_index;
+                break;
+            }
+
+            sw10_ingress_ring_copy_out(ingress_ring, read_index + sizeof(header), ingress_ring_record, header.length);
+            write_ingress_record(&header, ingress_ring_record, buffer);
+
+            read_index += sizeof(header) + header.length;
+        }
+
+        __atomic_store_n(&ingress_ring->read_index, read_index, __ATOMIC_RELEASE);
+    };
+
+    return NULL;
+}
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "sw10_alsadrv";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - CASIO Software Sound Generator SW-10\n"
+        "Usage: %s [OPTIONS]...\n"
+        "  -f NUM   Frequency (0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz)\n"
+        "  -p NUM   Polyphony (0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices)\n"
+        "  -e NUM   Reverb effect (0 = off, 1 = reverb 1, 2 = reverb 2)\n"
+        "  -r PATH  Rom path (path to ROMSXGM.BIN)\n"
+        "  -R NAME  Raw MIDI input device instead of sequencer port (e.g. hw:1,0)\n"
+        "  -o NAME  Output (alsa = ALSA PCM device, null = discard, unpaced = discard as fast as possible, PATH = .wav or raw file)\n"
+        "  -D NAME  ALSA PCM device (default = default, e.g. hw:0,0)\n"
+        "  -Q NUM   Resample to the device rate in the program (0 = off, 1 = low quality, 2 = medium quality, 3 = high quality)\n"
+        "  -F NUM   Output rate in Hz, resampled in the program (8000 - 192000)\n"
+        "  -N NUM   Number of sequencer ports, each with its own synthesizer (1 - %i)\n"
+        "  -a NUM   Render up to NUM blocks ahead in a separate thread (1 - 15)\n"
+        "  -S PATH  Unix socket for reading statistics (statistics are also printed on SIGUSR1)\n"
+        "  -U PATH  Unix socket for MIDI input from local applications\n"
+        "  -M NAME  Shared memory ring for MIDI input from local applications (e.g. /sw10)\n"
+        "  -K PATH  Unix socket for changing the configuration while running\n"
+        "  -L PATH  Record the synthesizer input to a session log (for sw10_replay)\n"
+        "  -l NUM   Target output latency in milliseconds (1 - 1000)\n"
+        "  -s NUM   Period size in frames (16 - 16384)\n"
+        "  -n NUM   Number of periods (2 - 64)\n"
+        "  -E NUM   MIDI event delay in milliseconds (0 - 1000, default = 100, with -l/-s/-n = period size)\n"
+        "  -P NUM   Real-time (SCHED_FIFO) priority of render and MIDI threads (1 - 99)\n"
+        "  -c NUM   Pin render thread to CPU\n"
+        "  -C NUM   Pin MIDI thread to CPU\n"
+        "  -m       Lock and prefault memory\n"
+        "  -d       Daemonize\n"
+        "  -h       Help\n",
+        basename,
+        progname,
+        MAX_SYNTHS
+    );
+    exit(1);
+}
+
+static void read_arguments(int argc, char *argv[]) __attribute__((noinline));
+static void read_arguments(int argc, char *argv[])
+{
+    int i, j;
+
+    // frequency: 0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz
+    frequency = 2;
+
+    // polyphony: 0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices
+    polyphony = 3;
+
+    // reverb effect: 0 = off, 1 = reverb 1, 2 = reverb 2
+    reverb_effect = 0;
+
+    daemonize = 0;
+
+    // number of ports / synthesizers
+    num_synths = 1;
+
+    // render ahead: 0 = render in main loop
+    render_ahead = 0;
+
+    output_type = OUTPUT_ALSA;
+    output_filepath = NULL;
+
+    // resampling: 0 = rate conversion by ALSA
+    requested_rate = 0;
+    resample_quality = 0;
+
+    // output latency: 0 = default buffer (16 blocks)
+    target_latency = 0;
+
+    // MIDI event delay: -1 = depends on the output buffer
+    event_delay = -1;
+    period_frames = 0;
+    num_periods = 0;
+
+    // real-time settings: 0 / -1 = not used
+    rt_priority = 0;
+    render_cpu = -1;
+    midi_cpu = -1;
+    lock_memory = 0;
+
+    if (argc <= 1)
+    {
+        return;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'r': // rom
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        rom_filepath = argv[i];
+                    }
+                    break;
+                case 'R': // raw midi device
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        rawmidi_device = argv[i];
+                    }
+                    break;
+                case 'U': // ingress socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        ingress_socket_path = argv[i];
+                    }
+                    break;
+                case 'M': // ingress shared memory ring
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        ingress_ring_name = argv[i];
+                    }
+                    break;
+                case 'D': // pcm device
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        pcm_device = argv[i];
+                    }
+                    break;
+                case 'Q': // resampling quality
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= SW10_RESAMPLER_QUALITY_HIGH)
+                        {
+                            resample_quality = j;
+                        }
+                    }
+                    break;
+                case 'F': // output rate
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 8000 && j <= 192000)
+                        {
+                            requested_rate = j;
+                        }
+                    }
+                    break;
+                case 'K': // control socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        control_socket_path = argv[i];
+                    }
+                    break;
+                case 'L': // session log
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        session_log_path = argv[i];
+                    }
+                    break;
+                case 'S': // statistics socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        stats_socket_path = argv[i];
+                    }
+                    break;
+                case 'o': // output
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        if (strcmp(argv[i], "alsa") == 0)
+                        {
+                            output_type = OUTPUT_ALSA;
+                        }
+                        else if (strcmp(argv[i], "null") == 0)
+                        {
+                            output_type = OUTPUT_NULL;
+                        }
+                        else if (strcmp(argv[i], "unpaced") == 0)
+                        {
+                            output_type = OUTPUT_UNPACED;
+                        }
+                        else
+                        {
+                            size_t len;
+
+                            output_filepath = argv[i];
+                            len = strlen(output_filepath);
+                            output_type = ((len > 4) && (strcasecmp(output_filepath + len - 4, ".wav") == 0)) ? OUTPUT_WAV : OUTPUT_RAW;
+                        }
+                    }
+                    break;
+                case 'a': // render ahead
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= 15)
+                        {
+                            render_ahead = j;
+                        }
+                    }
+                    break;
+                case 'N': // number of ports
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= MAX_SYNTHS)
+                        {
+                            num_synths = j;
+                        }
+                    }
+                    break;
+                case 'f': // frequency
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 2)
+                        {
+                            frequency = j;
+                        }
+                    }
+                    break;
+                case 'p': // polyphony
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 3)
+                        {
+                            polyphony = j;
+                        }
+                    }
+                    break;
+                case 'e': // reverb effect
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 2)
+                        {
+                            reverb_effect = j;
+                        }
+                    }
+                    break;
+                case 'l': // target latency
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= 1000)
+                        {
+                            target_latency = j;
+                        }
+                    }
+                    break;
+                case 'E': // MIDI event delay
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 1000)
+                        {
+                            event_delay = j;
+                        }
+                    }
+                    break;
+                case 's': // period size
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 16 && j <= 16384)
+                        {
+                            period_frames = j;
+                        }
+                    }
+                    break;
+                case 'n': // number of periods
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 2 && j <= 64)
+                        {
+                            num_periods = j;
+                        }
+                    }
+                    break;
+                case 'P': // real-time priority
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= 99)
+                        {
+                            rt_priority = j;
+                        }
+                    }
+                    break;
+                case 'c': // render thread cpu
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j < CPU_SETSIZE)
+                        {
+                            render_cpu = j;
+                        }
+                    }
+                    break;
+                case 'C': // midi thread cpu
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j < CPU_SETSIZE)
+                        {
+                            midi_cpu = j;
+                        }
+                    }
+                    break;
+                case 'm': // lock memory
+                    lock_memory = 1;
+                    break;
+                case 'd': // daemonize
+                    daemonize = 1;
+                    break;
+                case 'h': // help
+                    usage(argv[0]);
+                default:
+                    break;
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+        }
+    }
+
+    custom_buffer = (target_latency != 0 || period_frames != 0 || num_periods != 0) ? 1 : 0;
+
+    if ((rawmidi_device != NULL) && (num_synths > 1))
+    {
+        fprintf(stderr, "Raw MIDI input uses only one synthesizer\n");
+        num_synths = 1;
+    }
+
+    // output rate is always resampled in the program
+    if ((requested_rate != 0) && (resample_quality == 0))
+    {
+        resample_quality = SW10_RESAMPLER_QUALITY_MEDIUM;
+    }
+}
+
+
+static int load_rom_file(const char *filepath, uint8_t **address)
+{
+    int rom_fd;
+    uint8_t *rom;
+
+    rom_fd = open(filepath, O_RDONLY);
+    if (rom_fd < 0)
+    {
+        char *rompathcopy, *slash, *filename;
+        DIR *dir;
+        struct dirent *entry;
+
+        rompathcopy = strdup(filepath);
+        if (rompathcopy == NULL) return -1;
+
+        slash = strrchr(rompathcopy, '/');
+        if (slash != NULL)
+        {
+            filename = slash + 1;
+            if (slash != rompathcopy)
+            {
+                *slash = 0;
+                dir = opendir(rompathcopy);
+                *slash = '/';
+            }
+            else
+            {
+                dir = opendir("/");
+            }
+        }
+        else
+        {
+            filename = rompathcopy;
+            dir = opendir(".");
+        }
+
+        if (dir == NULL)
+        {
+            free(rompathcopy);
+            return -2;
+        }
+
+        while (1)
+        {
+            entry = readdir(dir);
+            if (entry == NULL) break;
+
+            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) continue;
+
+            if (0 != strcasecmp(filename, entry->d_name)) continue;
+
+            strcpy(filename, entry->d_name);
+            break;
+        };
+
+        closedir(dir);
+
+        if (entry == NULL)
+        {
+            free(rompathcopy);
+            return -3;
+        }
+
+        rom_fd = open(rompathcopy, O_RDONLY);
+
+        free(rompathcopy);
+
+        if (rom_fd < 0)
+        {
+            return -4;
+        }
+    }
+
+#if defined(MAP_LOCKED) && (MAP_LOCKED != 0)
+    rom = mmap(NULL, ROMSIZE, PROT_READ, MAP_PRIVATE | MAP_LOCKED, rom_fd, 0);
+    if (rom == MAP_FAILED)
+#endif
+    {
+        rom = mmap(NULL, ROMSIZE, PROT_READ, MAP_PRIVATE, rom_fd, 0);
+    }
+
+    close(rom_fd);
+
+    if (rom == MAP_FAILED)
+    {
+        return -5;
+    }
+
+    *address = rom;
+    return 0;
+}
+
+
+static unsigned int requested_period_size(unsigned int rate)
+{
+    unsigned int period;
+
+    if (period_frames != 0)
+    {
+        return period_frames;
+    }
+
+    // without explicit period size, the target latency (or 10 ms) is split into the periods (2 by default)
+    period = ((target_latency ? target_latency : 10) * rate) / (1000 * (num_periods ? num_periods : 2));
+    return (period < 16) ? 16 : period;
+}
+
+static unsigned int get_sub_blocks(int synth_frequency)
+{
+    unsigned int period;
+
+    // with small periods generate smaller blocks (1 sub-block = 64 << frequency samples)
+    if (custom_buffer)
+    {
+        period = requested_period_size(11025 << synth_frequency);
+        if (period < (128 << synth_frequency))
+        {
+            return 1;
+        }
+        else if (period < (256 << synth_frequency))
+        {
+            return 2;
+        }
+    }
+
+    return 4;
+}
+
+static unsigned int get_event_delay(int synth_frequency)
+{
+    unsigned int rate, frames;
+
+    if (event_delay >= 0)
+    {
+        return event_delay;
+    }
+
+    // events are evenly spaced when they're delayed at least by the time between render calls (a period or a block), with small periods this is much less than 100 ms
+    if (custom_buffer)
+    {
+        rate = 11025 << synth_frequency;
+        frames = requested_period_size(rate);
+        if (frames < (64u << synth_frequency) * get_sub_blocks(synth_frequency))
+        {
+            frames = (64u << synth_frequency) * get_sub_blocks(synth_frequency);
+        }
+        return (frames * 1000 + rate - 1) / rate;
+    }
+
+    return 100;
+}
+
+static int setup_synth_instance(VLSG_Instance *instance, int synth_index, int synth_frequency, const uint8_t *rom, uint8_t *buffer, unsigned int blocks)
+{
+    int result;
+
+    // set frequency
+    VLSG_InstanceSetParameter(instance, PARAMETER_Frequency, synth_frequency);
+
+    // set polyphony
+    VLSG_InstanceSetParameter(instance, PARAMETER_Polyphony, 0x10 + polyphony);
+
+    // set reverb effect
+    VLSG_InstanceSetParameter(instance, PARAMETER_Effect, 0x20 + reverb_effect);
+
+    // set address of ROM file
+    VLSG_InstanceSetParameter(instance, PARAMETER_ROMAddress, (uintptr_t)rom);
+
+    // set output buffer
+    VLSG_InstanceSetParameter(instance, PARAMETER_OutputBuffer, (uintptr_t)buffer);
+
+    // set delay of MIDI events
+    VLSG_InstanceSetParameter(instance, PARAMETER_EventDelay, get_event_delay(synth_frequency));
+
+    result = VLSG_InstanceSetParameter(instance, PARAMETER_SubBlocks, blocks);
+
+    // set function GetTime
+    VLSG_InstanceSetFunc_GetTime(instance, &get_synth_time, (void *)(intptr_t)synth_index);
+
+    return result;
+}
+
+static void split_output_buffer(void)
+{
+    int i;
+
+    // split output buffer to 16 subbuffers
+    samples_per_call = (64 << frequency) * sub_blocks;
+    bytes_per_call = 4 * samples_per_call;
+
+    for (i = 0; i < 16; i++)
+    {
+        midi_buf[i] = &(midi_buffer[i * bytes_per_call]);
+    }
+}
+
+static int start_synth(void) __attribute__((noinline));
+static int start_synth(void)
+{
+    if (load_rom_file(rom_filepath, &rom_address) < 0)
+    {
+        fprintf(stderr, "Error opening ROM file: %s\n", rom_filepath);
+        return -1;
+    }
+
+    // first synthesizer renders directly into the output buffer, other synthesizers are mixed into it
+    outbuf_counter = 0;
+    memset(midi_buffer, 0, 65536);
+    synth_buffer[0] = midi_buffer;
+
+    sub_blocks = get_sub_blocks(frequency);
+
+    int index;
+    for (index = 0; index < num_synths; index++)
+    {
+        if (index != 0)
+        {
+            synth_buffer[index] = (uint8_t *) calloc(1, 65536);
+        }
+
+        synth_instance[index] = VLSG_CreateInstance();
+        if ((synth_instance[index] == NULL) || (synth_buffer[index] == NULL))
+        {
+            fprintf(stderr, "Error allocating synthesizer\n");
+            for (; index >= 0; index--)
+            {
+                if (index != 0) free(synth_buffer[index]);
+                if (synth_instance[index] != NULL) VLSG_DestroyInstance(synth_instance[index]);
+            }
+            munmap(rom_address, ROMSIZE);
+            return -2;
+        }
+
+        if (!setup_synth_instance(synth_instance[index], index, frequency, rom_address, synth_buffer[index], sub_blocks))
+        {
+            sub_blocks = 4;
+        }
+    }
+
+    split_output_buffer();
+
+
+    // initialize time
+#if defined(CLOCK_MONOTONIC_RAW)
+    if (clock_gettime(CLOCK_MONOTONIC_RAW, &start_time))
+    {
+        monotonic_clock_id = CLOCK_MONOTONIC;
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+    }
+    else
+    {
+        monotonic_clock_id = CLOCK_MONOTONIC_RAW;
+    }
+#else
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+#endif
+
+    if (start_time.tv_sec != 0)
+    {
+        start_time.tv_sec--;
+    }
+    else
+    {
+        start_time.tv_nsec = 0;
+    }
+
+
+    // start playback
+    for (index = 0; index < num_synths; index++)
+    {
+        VLSG_InstancePlaybackStart(synth_instance[index]);
+    }
+
+    return 0;
+}
+
+static void stop_synth(void)
+{
+    int index;
+
+    for (index = 0; index < num_synths; index++)
+    {
+        VLSG_InstancePlaybackStop(synth_instance[index]);
+        VLSG_DestroyInstance(synth_instance[index]);
+        if (retired_instance[index] != NULL)
+        {
+            VLSG_DestroyInstance(retired_instance[index]);
+        }
+        free(fade_buffer[index]);
+        if (index != 0)
+        {
+            free(synth_buffer[index]);
+        }
+    }
+    munmap(rom_address, ROMSIZE);
+}
+
+static int run_as_daemon(void) __attribute__((noinline));
+static int run_as_daemon(void)
+{
+    int err;
+
+    printf("Running as daemon...\n");
+
+    err = daemon(0, 0);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error running as daemon: %i\n", err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void stop_midi_thread(void)
+{
+    static const uint8_t stop = 0;
+
+    midi_init_state = -1;
+
+    if (!midi_thread_started)
+    {
+        return;
+    }
+
+    // wake the MIDI thread, if it's waiting for input, and wait until it stops using the MIDI port
+    write(midi_stop_pipe[1], &stop, 1);
+    pthread_join(midi_thread, NULL);
+    midi_thread_started = 0;
+
+    close(midi_stop_pipe[0]);
+    close(midi_stop_pipe[1]);
+    midi_stop_pipe[0] = midi_stop_pipe[1] = -1;
+}
+
+static int open_rawmidi_port(void) __attribute__((noinline));
+static int open_rawmidi_port(void)
+{
+    int err;
+
+    err = snd_rawmidi_open(&midi_rawmidi, NULL, rawmidi_device, SND_RAWMIDI_NONBLOCK);
+    if (err < 0)
+    {
+        midi_rawmidi = NULL;
+        fprintf(stderr, "Error opening raw MIDI device %s: %i\n%s\n", rawmidi_device, err, snd_strerror(err));
+        return -1;
+    }
+
+    printf("%s raw MIDI input is %s\n", midi_name, rawmidi_device);
+
+    return 0;
+}
+
+static int open_midi_port(void) __attribute__((noinline));
+static int open_midi_port(void)
+{
+    int err, index;
+    unsigned int caps, type;
+    snd_seq_port_info_t *pinfo;
+    char name[64];
+
+    if (rawmidi_device != NULL)
+    {
+        return open_rawmidi_port();
+    }
+
+    err = snd_seq_open(&midi_seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error opening ALSA sequencer: %i\n%s\n", err, snd_strerror(err));
+        return -1;
+    }
+
+    err = snd_seq_set_client_name(midi_seq, midi_name);
+    if (err < 0)
+    {
+        snd_seq_close(midi_seq);
+        fprintf(stderr, "Error setting sequencer client name: %i\n%s\n", err, snd_strerror(err));
+        return -2;
+    }
+
+    // queue is used only for timestamping incoming events
+    midi_queue_id = snd_seq_alloc_named_queue(midi_seq, midi_name);
+    if (midi_queue_id < 0)
+    {
+        fprintf(stderr, "Error allocating sequencer queue: %i\n%s\n", midi_queue_id, snd_strerror(midi_queue_id));
+        fprintf(stderr, "Using event arrival time\n");
+        midi_queue_id = -1;
+    }
+
+    caps = SND_SEQ_PORT_CAP_SUBS_WRITE | SND_SEQ_PORT_CAP_WRITE;
+    type = SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_MIDI_GM | SND_SEQ_PORT_TYPE_SYNTHESIZER;
+
+    snd_seq_port_info_alloca(&pinfo);
+
+    for (index = 0; index < num_synths; index++)
+    {
+        if (num_synths > 1)
+        {
+            snprintf(name, sizeof(name), "%s %i", port_name, index + 1);
+        }
+        else
+        {
+            strcpy(name, port_name);
+        }
+
+        snd_seq_port_info_set_name(pinfo, name);
+        snd_seq_port_info_set_capability(pinfo, caps);
+        snd_seq_port_info_set_type(pinfo, type);
+        snd_seq_port_info_set_midi_channels(pinfo, 16);
+        if (midi_queue_id >= 0)
+        {
+            snd_seq_port_info_set_timestamping(pinfo, 1);
+            snd_seq_port_info_set_timestamp_real(pinfo, 1);
+            snd_seq_port_info_set_timestamp_queue(pinfo, midi_queue_id);
+        }
+
+        err = snd_seq_create_port(midi_seq, pinfo);
+        if (err < 0)
+        {
+            for (index--; index >= 0; index--)
+            {
+                snd_seq_delete_port(midi_seq, midi_port_id[index]);
+            }
+            if (midi_queue_id >= 0) snd_seq_free_queue(midi_seq, midi_queue_id);
+            snd_seq_close(midi_seq);
+            fprintf(stderr, "Error creating sequencer port: %i\n%s\n", err, snd_strerror(err));
+            return -3;
+        }
+        midi_port_id[index] = snd_seq_port_info_get_port(pinfo);
+    }
+
+    if (midi_queue_id >= 0)
+    {
+        err = snd_seq_start_queue(midi_seq, midi_queue_id, NULL);
+        if (err >= 0)
+        {
+            err = snd_seq_drain_output(midi_seq);
+        }
+
+        if (err < 0)
+        {
+            fprintf(stderr, "Error starting sequencer queue: %i\n%s\n", err, snd_strerror(err));
+            fprintf(stderr, "Using event arrival time\n");
+            snd_seq_free_queue(midi_seq, midi_queue_id);
+            midi_queue_id = -1;
+        }
+        else
+        {
+            sync_queue_time();
+        }
+    }
+
+    // the MIDI thread polls the sequencer, so it can be stopped at exit
+    snd_seq_nonblock(midi_seq, 1);
+
+    if (num_synths > 1)
+    {
+        for (index = 0; index < num_synths; index++)
+        {
+            printf("%s port %i ALSA address is %i:%i\n", midi_name, index + 1, snd_seq_client_id(midi_seq), midi_port_id[index]);
+        }
+    }
+    else
+    {
+        printf("%s ALSA address is %i:%i\n", midi_name, snd_seq_client_id(midi_seq), midi_port_id[0]);
+    }
+
+    return 0;
+}
+
+static void close_midi_port(void)
+{
+    int index;
+
+    if (midi_rawmidi != NULL)
+    {
+        snd_rawmidi_close(midi_rawmidi);
+        return;
+    }
+
+    for (index = 0; index < num_synths; index++)
+    {
+        snd_seq_delete_port(midi_seq, midi_port_id[index]);
+    }
+    if (midi_queue_id >= 0)
+    {
+        snd_seq_stop_queue(midi_seq, midi_queue_id, NULL);
+        snd_seq_free_queue(midi_seq, midi_queue_id);
+    }
+    snd_seq_close(midi_seq);
+}
+
+
+static void set_output_block_frames(void)
+{
+    unsigned int synth_rate;
+
+    // size of the synthesis block at the output rate
+    synth_rate = 11025 << frequency;
+    if ((resample_quality == 0) || (output_rate == synth_rate))
+    {
+        output_block_frames = samples_per_call;
+    }
+    else
+    {
+        output_block_frames = ((uint64_t)samples_per_call * output_rate + synth_rate - 1) / synth_rate;
+    }
+}
+
+static int create_resampler(void)
+{
+    unsigned int synth_rate;
+
+    synth_rate = 11025 << frequency;
+    if ((resample_quality == 0) || (output_rate == synth_rate))
+    {
+        return 0;
+    }
+
+    resampler = sw10_resampler_create(synth_rate, output_rate, resample_quality, samples_per_call);
+    if (resampler == NULL)
+    {
+        fprintf(stderr, "Error creating resampler\n");
+        return -1;
+    }
+
+    resample_buffer = (uint8_t *) malloc(4 * sw10_resampler_max_output(resampler, samples_per_call));
+    if (resample_buffer == NULL)
+    {
+        sw10_resampler_destroy(resampler);
+        resampler = NULL;
+        fprintf(stderr, "Error allocating resampling buffer\n");
+        return -2;
+    }
+
+    printf("Resampling: %u Hz -> %u Hz (quality %i)\n", synth_rate, output_rate, resample_quality);
+
+    return 0;
+}
+
+static void destroy_resampler(void)
+{
+    if (resampler != NULL)
+    {
+        sw10_resampler_destroy(resampler);
+        resampler = NULL;
+    }
+
+    free(resample_buffer);
+    resample_buffer = NULL;
+}
+
+static int set_hw_params(void)
+{
+    int err, dir;
+    unsigned int rate;
+    snd_pcm_uframes_t buffer_size, period_size;
+    snd_pcm_hw_params_t *pcm_hwparams;
+
+    snd_pcm_hw_params_alloca(&pcm_hwparams);
+
+    err = snd_pcm_hw_params_any(midi_pcm, pcm_hwparams);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error getting hwparams: %i\n%s\n", err, snd_strerror(err));
+        return -1;
+    }
+
+    err = snd_pcm_hw_params_set_access(midi_pcm, pcm_hwparams, SND_PCM_ACCESS_RW_INTERLEAVED);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting access: %i\n%s\n", err, snd_strerror(err));
+        return -2;
+    }
+
+    err = snd_pcm_hw_params_set_format(midi_pcm, pcm_hwparams, SND_PCM_FORMAT_S16);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting format: %i\n%s\n", err, snd_strerror(err));
+        return -3;
+    }
+
+    err = snd_pcm_hw_params_set_channels(midi_pcm, pcm_hwparams, 2);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting channels: %i\n%s\n", err, snd_strerror(err));
+        return -4;
+    }
+
+    if (resample_quality)
+    {
+        // the program resamples to a rate supported by the device, so ALSA doesn't have to
+        err = snd_pcm_hw_params_set_rate_resample(midi_pcm, pcm_hwparams, 0);
+        if (err < 0)
+        {
+            fprintf(stderr, "Error disabling ALSA resampling: %i\n%s\n", err, snd_strerror(err));
+        }
+    }
+
+    rate = requested_rate ? requested_rate : (11025 << frequency);
+    dir = 0;
+    err = snd_pcm_hw_params_set_rate_near(midi_pcm, pcm_hwparams, &rate, &dir);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting rate: %i\n%s\n", err, snd_strerror(err));
+        return -5;
+    }
+
+    output_rate = rate;
+    set_output_block_frames();
+
+    if (!custom_buffer)
+    {
+        // default: buffer of 16 blocks, period of 1 block
+        buffer_size = output_block_frames * 16;
+        err = snd_pcm_hw_params_set_buffer_size_near(midi_pcm, pcm_hwparams, &buffer_size);
+        if (err < 0)
+        {
+            fprintf(stderr, "Error setting buffer size: %i\n%s\n", err, snd_strerror(err));
+            return -6;
+        }
+
+        period_size = output_block_frames;
+        dir = 0;
+        err = snd_pcm_hw_params_set_period_size_near(midi_pcm, pcm_hwparams, &period_size, &dir);
+        if (err < 0)
+        {
+            fprintf(stderr, "Error setting period size: %i\n%s\n", err, snd_strerror(err));
+            return -7;
+        }
+    }
+    else
+    {
+        unsigned int periods;
+
+        periods = num_periods ? num_periods : 2;
+        period_size = requested_period_size(rate);
+
+        dir = 0;
+        err = snd_pcm_hw_params_set_period_size_near(midi_pcm, pcm_hwparams, &period_size, &dir);
+        if (err < 0)
+        {
+            fprintf(stderr, "Error setting period size: %i\n%s\n", err, snd_strerror(err));
+            return -7;
+        }
+
+        dir = 0;
+        err = snd_pcm_hw_params_set_periods_near(midi_pcm, pcm_hwparams, &periods, &dir);
+        if (err < 0)
+        {
+            fprintf(stderr, "Error setting number of periods: %i\n%s\n", err, snd_strerror(err));
+            return -9;
+        }
+    }
+
+    err = snd_pcm_hw_params(midi_pcm, pcm_hwparams);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting hwparams: %i\n%s\n", err, snd_strerror(err));
+        return -8;
+    }
+
+    // read back the values accepted by the device
+    snd_pcm_hw_params_get_buffer_size(pcm_hwparams, &buffer_size);
+    snd_pcm_hw_params_get_period_size(pcm_hwparams, &period_size, &dir);
+    snd_pcm_hw_params_get_rate(pcm_hwparams, &rate, &dir);
+
+    if (custom_buffer)
+    {
+        // write whenever there's space for a period (blocks larger than the free space are written in parts)
+        write_threshold = period_size;
+    }
+    else
+    {
+        write_threshold = 3 * output_block_frames;
+    }
+
+    pcm_buffer_size = buffer_size;
+    pcm_period_size = period_size;
+
+    printf("Output latency: %.1f ms (buffer %lu frames, %lu frames per period, %u Hz)\n", (buffer_size * 1000.0) / rate, (unsigned long)buffer_size, (unsigned long)period_size, rate);
+    printf("Synthesis block: %.1f ms (%u frames)\n", (samples_per_call * 1000.0) / (11025 << frequency), samples_per_call);
+    printf("MIDI latency: %.1f ms (event delay %u ms + output latency)\n", get_event_delay(frequency) + (buffer_size * 1000.0) / rate, get_event_delay(frequency));
+    if (target_latency != 0 && buffer_size * 1000 > (snd_pcm_uframes_t)target_latency * rate)
+    {
+        fprintf(stderr, "Target latency (%u ms) not achieved\n", target_latency);
+    }
+
+    return 0;
+}
+
+static int set_sw_params(void)
+{
+    snd_pcm_sw_params_t *swparams;
+    int err;
+
+    snd_pcm_sw_params_alloca(&swparams);
+
+    err = snd_pcm_sw_params_current(midi_pcm, swparams);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error getting swparams: %i\n%s\n", err, snd_strerror(err));
+        return -1;
+    }
+
+    err = snd_pcm_sw_params_set_avail_min(midi_pcm, swparams, custom_buffer ? pcm_period_size : output_block_frames);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting avail min: %i\n%s\n", err, snd_strerror(err));
+        return -2;
+    }
+
+    err = snd_pcm_sw_params(midi_pcm, swparams);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error setting sw params: %i\n%s\n", err, snd_strerror(err));
+        return -3;
+    }
+
+    return 0;
+}
+
+static void write_wav_header(uint32_t data_size)
+{
+    uint8_t header[44];
+
+    memcpy(header, "RIFF", 4);
+    WRITE_LE_UINT32(header + 4, data_size + 36);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    WRITE_LE_UINT32(header + 16, 16);           // fmt chunk size
+    WRITE_LE_UINT32(header + 20, 1 | (2 << 16)); // PCM, 2 channels
+    WRITE_LE_UINT32(header + 24, output_rate);
+    WRITE_LE_UINT32(header + 28, output_rate * 4);
+    WRITE_LE_UINT32(header + 32, 4 | (16 << 16)); // block align, bits per sample
+    memcpy(header + 36, "data", 4);
+    WRITE_LE_UINT32(header + 40, data_size);
+
+    fwrite(header, 1, 44, output_file);
+}
+
+static int open_sink_output(void)
+{
+    unsigned int periods;
+
+    output_rate = requested_rate ? requested_rate : (11025 << frequency);
+    set_output_block_frames();
+
+    // virtual device with the same buffer layout as the ALSA device
+    if (!custom_buffer)
+    {
+        pcm_period_size = output_block_frames;
+        pcm_buffer_size = output_block_frames * 16;
+        write_threshold = 3 * output_block_frames;
+    }
+    else
+    {
+        periods = num_periods ? num_periods : 2;
+        pcm_period_size = requested_period_size(output_rate);
+        pcm_buffer_size = pcm_period_size * periods;
+        write_threshold = pcm_period_size;
+    }
+
+    if ((output_type == OUTPUT_WAV) || (output_type == OUTPUT_RAW))
+    {
+        output_file = fopen(output_filepath, "wb");
+        if (output_file == NULL)
+        {
+            fprintf(stderr, "Error opening output file: %s\n", output_filepath);
+            return -1;
+        }
+
+        if (output_type == OUTPUT_WAV)
+        {
+            write_wav_header(0);
+        }
+
+        printf("Output file: %s\n", output_filepath);
+    }
+    else
+    {
+        printf("Output: %s\n", (output_type == OUTPUT_NULL) ? "null" : "null (unpaced)");
+    }
+
+    output_file_frames = 0;
+    output_queued_frames = 0;
+    output_underruns = 0;
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &output_start_time);
+
+    if (output_type != OUTPUT_UNPACED)
+    {
+        printf("Output latency: %.1f ms (buffer %lu frames, %lu frames per period, %u Hz)\n", (pcm_buffer_size * 1000.0) / output_rate, (unsigned long)pcm_buffer_size, (unsigned long)pcm_period_size, output_rate);
+    }
+    printf("Synthesis block: %.1f ms (%u frames)\n", (samples_per_call * 1000.0) / (11025 << frequency), samples_per_call);
+    if (output_type != OUTPUT_UNPACED)
+    {
+        printf("MIDI latency: %.1f ms (event delay %u ms + output latency)\n", get_event_delay(frequency) + (pcm_buffer_size * 1000.0) / output_rate, get_event_delay(frequency));
+    }
+
+    return 0;
+}
+
+static void close_sink_output(void)
+{
+    if (output_file != NULL)
+    {
+        if (output_type == OUTPUT_WAV)
+        {
+            fseek(output_file, 0, SEEK_SET);
+            write_wav_header(output_file_frames * 4);
+        }
+
+        fclose(output_file);
+        output_file = NULL;
+    }
+
+    if (output_type != OUTPUT_UNPACED)
+    {
+        printf("Buffer underruns: %lu\n", output_underruns);
+    }
+}
+
+static int open_pcm_output(void) __attribute__((noinline));
+static int open_pcm_output(void)
+{
+    int err;
+
+    if (output_type != OUTPUT_ALSA)
+    {
+        if (open_sink_output() < 0)
+        {
+            return -1;
+        }
+
+        return create_resampler();
+    }
+
+    err = snd_pcm_open(&midi_pcm, pcm_device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error opening PCM device: %i\n%s\n", err, snd_strerror(err));
+        return -1;
+    }
+
+    if (set_hw_params() < 0)
+    {
+        return -2;
+    }
+
+    if (set_sw_params() < 0)
+    {
+        return -3;
+    }
+
+    if (create_resampler() < 0)
+    {
+        return -4;
+    }
+
+    // set nonblock mode
+    snd_pcm_nonblock(midi_pcm, 1);
+
+    snd_pcm_prepare(midi_pcm);
+
+    return 0;
+}
+
+static void close_pcm_output(void)
+{
+    destroy_resampler();
+
+    if (output_type != OUTPUT_ALSA)
+    {
+        close_sink_output();
+        return;
+    }
+
+    snd_pcm_close(midi_pcm);
+}
+
+
+static int drop_privileges(void)
+{
+    uid_t uid;
+    gid_t gid;
+    const char *sudo_id;
+    long long int llid;
+    const char *xdg_dir;
+    char buf[32];
+    struct stat statbuf;
+    struct passwd *passwdbuf;
+
+    if (getuid() != 0)
+    {
+        return 0;
+    }
+
+    sudo_id = secure_getenv("SUDO_UID");
+    if (sudo_id == NULL)
+    {
+        sudo_id = secure_getenv("PKEXEC_UID");
+        if (sudo_id == NULL)
+        {
+            return -1;
+        }
+    }
+
+    errno = 0;
+    llid = strtoll(sudo_id, NULL, 10);
+    uid = (uid_t) llid;
+    if (errno != 0 || uid == 0 || llid != (long long int)uid)
+    {
+        return -2;
+    }
+
+    gid = getgid();
+    if (gid == 0)
+    {
+        sudo_id = secure_getenv("SUDO_GID");
+        if (sudo_id == NULL)
+        {
+            passwdbuf = getpwuid(uid);
+            if (passwdbuf != NULL)
+            {
+                gid = passwdbuf->pw_gid;
+            }
+
+            if (gid == 0)
+            {
+                return -3;
+            }
+        }
+        else
+        {
+            errno = 0;
+            llid = strtoll(sudo_id, NULL, 10);
+            gid = (gid_t) llid;
+            if (errno != 0 || gid == 0 || llid != (long long int)gid)
+            {
+                return -4;
+            }
+        }
+    }
+
+    if (setgid(gid) != 0)
+    {
+        return -5;
+    }
+    if (setuid(uid) != 0)
+    {
+        return -6;
+    }
+
+    printf("Dropped root privileges\n");
+
+    chdir("/");
+
+    // define some environment variables
+
+    xdg_dir = getenv("XDG_RUNTIME_DIR");
+    if ((xdg_dir == NULL) || (*xdg_dir == 0))
+    {
+        snprintf(buf, 32, "/run/user/%lli", (long long int)uid);
+
+        if ((stat(buf, &statbuf) == 0) && ((statbuf.st_mode & S_IFMT) == S_IFDIR) && (statbuf.st_uid == uid))
+        {
+            // if XDG_RUNTIME_DIR is not defined and directory /run/user/$USER exists then use it for XDG_RUNTIME_DIR
+            setenv("XDG_RUNTIME_DIR", buf, 1);
+
+            xdg_dir = getenv("XDG_CONFIG_HOME");
+            if ((xdg_dir == NULL) || (*xdg_dir == 0))
+            {
+                passwdbuf = getpwuid(uid);
+                if (passwdbuf != NULL)
+                {
+                    // also if XDG_CONFIG_HOME is not defined then define it as user's home directory
+                    setenv("XDG_CONFIG_HOME", passwdbuf->pw_dir, 1);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void *render_thread_proc(void *arg)
+{
+    int synth_index;
+
+    synth_index = (intptr_t)arg;
+
+    while (1)
+    {
+        while (sem_wait(&(render_start[synth_index])) < 0);
+
+        VLSG_InstanceFillOutputBuffer(synth_instance[synth_index], render_counter);
+
+        sem_post(&render_done);
+    };
+
+    return NULL;
+}
+
+static int start_render_threads(void)
+{
+    pthread_attr_t attr;
+    int err, index;
+
+    if (num_synths <= 1)
+    {
+        return 0;
+    }
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -1;
+    }
+
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    sem_init(&render_done, 0, 0);
+
+    // render threads inherit priority and scheduler of the main (render) thread
+    for (index = 1; index < num_synths; index++)
+    {
+        sem_init(&(render_start[index]), 0, 0);
+
+        err = pthread_create(&(render_thread[index]), &attr, &render_thread_proc, (void *)(intptr_t)index);
+        if (err != 0)
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error creating render thread: %i\n", err);
+            return -2;
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return 0;
+}
+
+static uint32_t record_render_time(int64_t start_time) __attribute__((noinline));
+static uint32_t record_render_time(int64_t start_time)
+{
+    uint32_t render_time;
+    int index;
+
+    render_time = get_time_us() - start_time;
+    if (render_time > stats_render_time_max)
+    {
+        stats_render_time_max = render_time;
+    }
+
+    // buckets: < 0.25 ms, < 0.5 ms, < 1 ms, ..., < 64 ms, >= 64 ms
+    for (index = 0; (index < RENDER_TIME_BUCKETS - 1) && (render_time >= (250u << index)); index++);
+
+    stats_render_time[index]++;
+    stats_blocks++;
+
+    return render_time;
+}
+
+static void record_session_block(uint32_t counter, uint32_t render_time)
+{
+    uint32_t data[3];
+
+    data[0] = counter;
+    data[1] = render_time;
+    data[2] = sw10_session_checksum(SW10_SESSION_CHECKSUM_INIT, midi_buf[counter & 15], bytes_per_call);
+
+    append_session_record(SW10_SESSION_BLOCK_END, 0, data, sizeof(data));
+}
+
+static void finish_control_request(int result)
+{
+    control_result = result;
+    __atomic_store_n(&control_pending, CONTROL_NONE, __ATOMIC_RELEASE);
+    sem_post(&control_done);
+}
+
+static void swap_synth_instances(uint32_t counter)
+{
+    VLSG_Instance *old_instance;
+    int index;
+
+    for (index = 0; index < num_synths; index++)
+    {
+        old_instance = synth_instance[index];
+
+        // last block of the old instance is rendered into the fade buffer
+        VLSG_InstanceSetParameter(old_instance, PARAMETER_OutputBuffer, (uintptr_t)fade_buffer[index]);
+        VLSG_InstanceFillOutputBuffer(old_instance, counter);
+
+        pthread_mutex_lock(&(synth_input_mutex[index]));
+        VLSG_InstanceMoveState(control_instance[index], old_instance);
+        synth_instance[index] = control_instance[index];
+        pthread_mutex_unlock(&(synth_input_mutex[index]));
+
+        control_instance[index] = old_instance;
+    }
+}
+
+static void crossfade_block(uint32_t counter)
+{
+    int index;
+    unsigned int frame;
+    int32_t old_value, new_value;
+    int16_t *output_ptr;
+
+    output_ptr = (int16_t *)midi_buf[counter & 15];
+    for (frame = 0; frame < samples_per_call; frame++)
+    {
+        for (int channel = 0; channel < 2; channel++)
+        {
+            old_value = 0;
+            for (index = 0; index < num_synths; index++)
+            {
+                old_value += ((const int16_t *)&(fade_buffer[index][(counter & 15) * bytes_per_call]))[2 * frame + channel];
+            }
+
+            if (old_value > 32767) old_value = 32767;
+            else if (old_value < -32768) old_value = -32768;
+
+            // linear crossfade from the old instances to the new instances
+            new_value = output_ptr[2 * frame + channel];
+            output_ptr[2 * frame + channel] = (old_value * (int32_t)(samples_per_call - frame) + new_value * (int32_t)frame) / (int32_t)samples_per_call;
+        }
+    }
+}
+
+static void render_block(uint32_t counter)
+{
+    int index, crossfade, silent;
+    unsigned int sample;
+    int32_t value;
+    int16_t *output_ptr;
+    int64_t start_time;
+    uint32_t render_time;
+
+    start_time = get_time_us();
+
+    // swap synthesizer instances between blocks
+    crossfade = 0;
+    if (__atomic_load_n(&control_pending, __ATOMIC_ACQUIRE) == CONTROL_SWAP)
+    {
+        // the new instances don't continue the recorded session
+        stop_session_log(SW10_SESSION_END_RECONFIGURED);
+
+        swap_synth_instances(counter);
+        crossfade = 1;
+    }
+
+    if (session_recording)
+    {
+        append_session_record(SW10_SESSION_BLOCK, 0, &counter, 4);
+    }
+
+    if (num_synths <= 1)
+    {
+        VLSG_InstanceFillOutputBuffer(synth_instance[0], counter);
+    }
+    else
+    {
+        // render all synthesizers in parallel
+        render_counter = counter;
+        for (index = 1; index < num_synths; index++)
+        {
+            sem_post(&(render_start[index]));
+        }
+
+        VLSG_InstanceFillOutputBuffer(synth_instance[0], counter);
+
+        for (index = 1; index < num_synths; index++)
+        {
+            while (sem_wait(&render_done) < 0);
+        }
+
+        // mix output of other synthesizers into the output buffer
+        output_ptr = (int16_t *)midi_buf[counter & 15];
+        for (sample = 0; sample < 2 * samples_per_call; sample++)
+        {
+            value = output_ptr[sample];
+            for (index = 1; index < num_synths; index++)
+            {
+                value += ((const int16_t *)&(synth_buffer[index][(counter & 15) * bytes_per_call]))[sample];
+            }
+
+            if (value > 32767) value = 32767;
+            else if (value < -32768) value = -32768;
+
+            output_ptr[sample] = value;
+        }
+    }
+
+    if (crossfade)
+    {
+        crossfade_block(counter);
+        finish_control_request(0);
+    }
+
+    // the output can be suspended after enough silent blocks
+    silent = !crossfade;
+    for (index = 0; silent && (index < num_synths); index++)
+    {
+        silent = VLSG_InstanceIsSilent(synth_instance[index]);
+    }
+    block_silent[counter & 15] = silent;
+
+    render_time = record_render_time(start_time);
+    if (session_recording)
+    {
+        record_session_block(counter, render_time);
+    }
+}
+
+static void *render_ahead_proc(void *arg)
+{
+    uint32_t produced;
+
+    while (1)
+    {
+        __atomic_store_n(&ahead_idle, 1, __ATOMIC_SEQ_CST);
+        while (sem_wait(&ahead_wakeup) < 0);
+        if (__atomic_load_n(&ahead_stop, __ATOMIC_SEQ_CST)) break;
+        __atomic_store_n(&ahead_idle, 0, __ATOMIC_SEQ_CST);
+
+        // the position is reset when the output is reconfigured
+        produced = __atomic_load_n(&ahead_produced, __ATOMIC_ACQUIRE);
+
+        // keep the ring filled up to the current lead (ring slots are the 16 engine output subbuffers)
+        while (produced - __atomic_load_n(&ahead_consumed, __ATOMIC_ACQUIRE) < __atomic_load_n(&ahead_lead, __ATOMIC_SEQ_CST))
+        {
+            render_block(produced);
+            produced++;
+
+            __atomic_store_n(&ahead_produced, produced, __ATOMIC_SEQ_CST);
+
+            // the consumer is only woken when it's waiting for an empty ring, otherwise the semaphore count would grow
+            if (__atomic_exchange_n(&ahead_waiting, 0, __ATOMIC_SEQ_CST))
+            {
+                sem_post(&ahead_ready);
+            }
+        }
+    };
+
+    return NULL;
+}
+
+static int start_render_ahead_thread(void)
+{
+    pthread_attr_t attr;
+    int err;
+
+    if (render_ahead == 0)
+    {
+        return 0;
+    }
+
+    // start with the maximal lead, it's reduced while there are no MIDI events
+    ahead_lead = render_ahead;
+    ahead_min_level = render_ahead;
+    ahead_produced = 0;
+    ahead_consumed = 0;
+    ahead_waiting = 0;
+    ahead_stop = 0;
+    sem_init(&ahead_wakeup, 0, 0);
+    sem_init(&ahead_ready, 0, 0);
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -1;
+    }
+
+    // render ahead thread inherits priority and scheduler of the main thread
+    // the thread is joined at exit, before destroying the synth instances
+    err = pthread_create(&ahead_thread, &attr, &render_ahead_proc, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating render ahead thread: %i\n", err);
+        return -2;
+    }
+    ahead_thread_started = 1;
+
+    return 0;
+}
+
+static void stop_render_ahead_thread(void)
+{
+    if (!ahead_thread_started)
+    {
+        return;
+    }
+
+    // finish the block which is being rendered and stop the thread
+    __atomic_store_n(&ahead_lead, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ahead_stop, 1, __ATOMIC_SEQ_CST);
+    sem_post(&ahead_wakeup);
+    pthread_join(ahead_thread, NULL);
+    ahead_thread_started = 0;
+
+    sem_destroy(&ahead_ready);
+    sem_destroy(&ahead_wakeup);
+}
+
+static void print_render_ahead_state(const char *reason)
+{
+    printf("Render ahead %s: lead %u blocks, lowest ring level %u blocks, near misses %lu\n", reason, ahead_lead, ahead_min_level, ahead_near_misses);
+    ahead_min_level = ahead_lead;
+}
+
+static const uint8_t *get_output_block(void)
+{
+    const uint8_t *block_ptr;
+    uint32_t level;
+
+    if (render_ahead == 0)
+    {
+        render_block(outbuf_counter);
+
+        block_ptr = midi_buf[outbuf_counter & 15];
+        outbuf_counter++;
+        return block_ptr;
+    }
+
+    level = __atomic_load_n(&ahead_produced, __ATOMIC_ACQUIRE) - outbuf_counter;
+    if (level == 0)
+    {
+        // ring is empty - grow the lead and wait for the render ahead thread
+        ahead_near_misses++;
+        if (ahead_lead < render_ahead)
+        {
+            ahead_lead++;
+            print_render_ahead_state("increased");
+        }
+
+        __atomic_store_n(&ahead_waiting, 1, __ATOMIC_SEQ_CST);
+        sem_post(&ahead_wakeup);
+        while (__atomic_load_n(&ahead_produced, __ATOMIC_SEQ_CST) == outbuf_counter)
+        {
+            sem_wait(&ahead_ready);
+        }
+        __atomic_store_n(&ahead_waiting, 0, __ATOMIC_SEQ_CST);
+    }
+    else if (level < ahead_min_level)
+    {
+        ahead_min_level = level;
+    }
+
+    stats_ring_level[(level < 16) ? level : 15]++;
+
+    block_ptr = midi_buf[outbuf_counter & 15];
+    outbuf_counter++;
+
+    // free the ring slot (the block is still used, so the lead must be smaller than 16)
+    __atomic_store_n(&ahead_consumed, outbuf_counter, __ATOMIC_RELEASE);
+    sem_post(&ahead_wakeup);
+
+    return block_ptr;
+}
+
+static const uint8_t *get_device_block(unsigned int *frames)
+{
+    const uint8_t *block_ptr;
+
+    block_ptr = get_output_block();
+    if (resampler == NULL)
+    {
+        *frames = samples_per_call;
+        return block_ptr;
+    }
+
+    // the resampled block is used until the next block is requested
+    *frames = sw10_resampler_process(resampler, (const int16_t *)block_ptr, samples_per_call, (int16_t *)resample_buffer);
+    return resample_buffer;
+}
+
+static void print_histogram(FILE *f, const uint32_t *histogram, int count, const char *const *labels)
+{
+    int index;
+
+    for (index = 0; index < count; index++)
+    {
+        fprintf(f, "%s%s: %u", (index == 0) ? "" : ", ", labels[index], histogram[index]);
+    }
+    fprintf(f, "\n");
+}
+
+static void print_statistics(FILE *f)
+{
+    static const char *const render_time_labels[RENDER_TIME_BUCKETS] = { "<0.25ms", "<0.5ms", "<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<32ms", "<64ms", ">=64ms" };
+    static const char *const output_fill_labels[OUTPUT_FILL_BUCKETS] = { "<12%", "<25%", "<37%", "<50%", "<62%", "<75%", "<87%", "<=100%" };
+    static const char *const event_delay_labels[8] = { "<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<32ms", "<64ms", ">=64ms" };
+    static const char *const ring_level_labels[16] = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15" };
+    struct timespec current_time;
+    VLSG_Statistics synth_stats;
+    int synth_index;
+
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &current_time);
+
+    fprintf(f, "Uptime: %li s\n", (long)(current_time.tv_sec - stats_start_time.tv_sec));
+    fprintf(f, "MIDI events: %u\n", stats_midi_events);
+    if (ingress_enabled)
+    {
+        fprintf(f, "Ingress records: %u\n", stats_ingress_records);
+    }
+    fprintf(f, "Rendered blocks: %u (%.1f ms per block)\n", stats_blocks, (samples_per_call * 1000.0) / (11025 << frequency));
+    fprintf(f, "Render time: max %.2f ms, ", stats_render_time_max / 1000.0);
+    print_histogram(f, stats_render_time, RENDER_TIME_BUCKETS, render_time_labels);
+    fprintf(f, "Output buffer fill: ");
+    print_histogram(f, stats_output_fill, OUTPUT_FILL_BUCKETS, output_fill_labels);
+    if (render_ahead)
+    {
+        fprintf(f, "Render ahead ring level: lead %u blocks, near misses %lu, ", ahead_lead, ahead_near_misses);
+        print_histogram(f, stats_ring_level, render_ahead + 1, ring_level_labels);
+    }
+    fprintf(f, "Buffer underruns: %lu\n", output_underruns);
+
+    for (synth_index = 0; synth_index < num_synths; synth_index++)
+    {
+        VLSG_InstanceGetStatistics(synth_instance[synth_index], &synth_stats);
+
+        fprintf(f, "Synthesizer %i: voices %i (peak %i, maximum %i), stolen voices %u, polyphony reductions %u\n", synth_index, synth_stats.active_voices, synth_stats.peak_voices, synth_stats.maximum_polyphony, synth_stats.voices_stolen, synth_stats.polyphony_reductions);
+        fprintf(f, "Synthesizer %i: events %u, event delay ", synth_index, synth_stats.events);
+        print_histogram(f, synth_stats.event_delay, 8, event_delay_labels);
+    }
+
+    fflush(f);
+}
+
+static void *stats_thread_proc(void *arg)
+{
+    int client;
+    FILE *f;
+
+    while (1)
+    {
+        client = accept(stats_socket, NULL, NULL);
+        if (client < 0)
+        {
+            if (stats_socket < 0) break;
+            continue;
+        }
+
+        // every connection gets one snapshot of the statistics
+        f = fdopen(client, "w");
+        if (f == NULL)
+        {
+            close(client);
+            continue;
+        }
+
+        print_statistics(f);
+        fclose(f);
+    };
+
+    return NULL;
+}
+
+static int open_stats_socket(void) __attribute__((noinline));
+static int open_stats_socket(void)
+{
+    struct sockaddr_un addr;
+    pthread_attr_t attr;
+    struct sched_param param;
+    int err;
+
+    if (stats_socket_path == NULL)
+    {
+        return 0;
+    }
+
+    if (strlen(stats_socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Statistics socket path is too long: %s\n", stats_socket_path);
+        return -1;
+    }
+
+    stats_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (stats_socket < 0)
+    {
+        fprintf(stderr, "Error creating statistics socket\n");
+        return -2;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, stats_socket_path);
+
+    // remove socket left by previous run
+    unlink(stats_socket_path);
+
+    if ((bind(stats_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(stats_socket, 4) < 0))
+    {
+        close(stats_socket);
+        stats_socket = -1;
+        fprintf(stderr, "Error binding statistics socket: %s\n", stats_socket_path);
+        return -3;
+    }
+
+    // closed connections mustn't terminate the program
+    signal(SIGPIPE, SIG_IGN);
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -4;
+    }
+
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    // statistics thread doesn't inherit real-time priority of the main thread
+    param.sched_priority = 0;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    err = pthread_create(&stats_thread, &attr, &stats_thread_proc, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating statistics thread: %i\n", err);
+        return -5;
+    }
+
+    return 0;
+}
+
+static void close_stats_socket(void)
+{
+    int socket_fd;
+
+    if (stats_socket < 0)
+    {
+        return;
+    }
+
+    socket_fd = stats_socket;
+    stats_socket = -1;
+    shutdown(socket_fd, SHUT_RDWR);
+    close(socket_fd);
+    unlink(stats_socket_path);
+}
+
+static int open_ingress(void) __attribute__((noinline));
+static int open_ingress(void)
+{
+    struct sockaddr_un addr;
+    pthread_attr_t attr;
+    pthread_condattr_t cond_attr;
+    int err, ring_fd;
+
+    if ((ingress_socket_path == NULL) && (ingress_ring_name == NULL))
+    {
+        return 0;
+    }
+
+    enable_input_locking();
+    ingress_enabled = 1;
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -1;
+    }
+
+    // ingress threads inherit priority and scheduler of the main thread
+    // the threads are joined at exit, before destroying the synth instances
+    if (pipe(ingress_stop_pipe) < 0)
+    {
+        pthread_attr_destroy(&attr);
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        return -11;
+    }
+    ingress_stopping = 0;
+
+    // record time uses CLOCK_MONOTONIC
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ingress_queue_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    err = pthread_create(&ingress_queue_thread, &attr, &ingress_queue_proc, NULL);
+    if (err != 0)
+    {
+        pthread_attr_destroy(&attr);
+        fprintf(stderr, "Error creating ingress queue thread: %i\n", err);
+        return -10;
+    }
+    ingress_queue_started = 1;
+
+    if (ingress_socket_path != NULL)
+    {
+        if (strlen(ingress_socket_path) >= sizeof(addr.sun_path))
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Ingress socket path is too long: %s\n", ingress_socket_path);
+            return -2;
+        }
+
+        ingress_socket = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (ingress_socket < 0)
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error creating ingress socket\n");
+            return -3;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, ingress_socket_path);
+
+        // remove socket left by previous run
+        unlink(ingress_socket_path);
+
+        if ((bind(ingress_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(ingress_socket, 4) < 0))
+        {
+            close(ingress_socket);
+            ingress_socket = -1;
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error binding ingress socket: %s\n", ingress_socket_path);
+            return -4;
+        }
+
+        err = pthread_create(&ingress_socket_thread, &attr, &ingress_socket_proc, NULL);
+        if (err != 0)
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error creating ingress socket thread: %i\n", err);
+            return -5;
+        }
+        ingress_socket_started = 1;
+
+        printf("Ingress socket: %s\n", ingress_socket_path);
+    }
+
+    if (ingress_ring_name != NULL)
+    {
+        ring_fd = shm_open(ingress_ring_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (ring_fd < 0)
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error creating ingress ring: %s\n", ingress_ring_name);
+            return -6;
+        }
+
+        if (ftruncate(ring_fd, sizeof(sw10_ingress_ring)) < 0)
+        {
+            close(ring_fd);
+            shm_unlink(ingress_ring_name);
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error resizing ingress ring: %s\n", ingress_ring_name);
+            return -7;
+        }
+
+        ingress_ring = (sw10_ingress_ring *) mmap(NULL, sizeof(sw10_ingress_ring), PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+        close(ring_fd);
+
+        if (ingress_ring == MAP_FAILED)
+        {
+            ingress_ring = NULL;
+            shm_unlink(ingress_ring_name);
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error mapping ingress ring: %s\n", ingress_ring_name);
+            return -8;
+        }
+
+        ingress_ring->size = SW10_INGRESS_RING_SIZE;
+        __atomic_store_n(&ingress_ring->magic, SW10_INGRESS_MAGIC, __ATOMIC_RELEASE);
+
+        err = pthread_create(&ingress_ring_thread, &attr, &ingress_ring_proc, NULL);
+        if (err != 0)
+        {
+            pthread_attr_destroy(&attr);
+            fprintf(stderr, "Error creating ingress ring thread: %i\n", err);
+            return -9;
+        }
+        ingress_ring_started = 1;
+
+        printf("Ingress ring: %s\n", ingress_ring_name);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return 0;
+}
+
+static void close_ingress(void)
+{
+    static const uint8_t stop = 0;
+
+    // wake the ingress threads and wait until they stop writing to the synthesizer
+    __atomic_store_n(&ingress_stopping, 1, __ATOMIC_SEQ_CST);
+
+    if (ingress_socket_started)
+    {
+        write(ingress_stop_pipe[1], &stop, 1);
+        pthread_join(ingress_socket_thread, NULL);
+        ingress_socket_started = 0;
+    }
+
+    if (ingress_ring_started)
+    {
+        __atomic_fetch_add(&ingress_ring->wakeup, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &ingress_ring->wakeup, FUTEX_WAKE, 1, NULL, NULL, 0);
+        pthread_join(ingress_ring_thread, NULL);
+        ingress_ring_started = 0;
+    }
+
+    if (ingress_queue_started)
+    {
+        pthread_mutex_lock(&ingress_queue_mutex);
+        pthread_cond_signal(&ingress_queue_cond);
+        pthread_mutex_unlock(&ingress_queue_mutex);
+        pthread_join(ingress_queue_thread, NULL);
+        ingress_queue_started = 0;
+
+        // records which aren't due yet are discarded
+        while (ingress_queue_length != 0)
+        {
+            free(remove_first_ingress_record());
+        }
+        pthread_cond_destroy(&ingress_queue_cond);
+    }
+
+    if (ingress_stop_pipe[0] >= 0)
+    {
+        close(ingress_stop_pipe[0]);
+        close(ingress_stop_pipe[1]);
+        ingress_stop_pipe[0] = ingress_stop_pipe[1] = -1;
+    }
+
+    if (ingress_socket >= 0)
+    {
+        close(ingress_socket);
+        ingress_socket = -1;
+        unlink(ingress_socket_path);
+    }
+
+    if (ingress_ring != NULL)
+    {
+        munmap(ingress_ring, sizeof(sw10_ingress_ring));
+        ingress_ring = NULL;
+        shm_unlink(ingress_ring_name);
     }
-
-    return NULL;
 }
 
-static void usage(const char *progname)
+static int create_control_instances(int synth_frequency, const uint8_t *rom, unsigned int blocks)
 {
-    static const char basename[] = "sw10_alsadrv";
+    int index;
 
-    if (progname == NULL)
-    {
-        progname = basename;
-    }
-    else
+    for (index = 0; index < num_synths; index++)
     {
-        const char *slash;
+        if (fade_buffer[index] == NULL)
+        {
+            fade_buffer[index] = (uint8_t *) calloc(1, 65536);
+        }
 
-        slash = strrchr(progname, '/');
-        if (slash != NULL)
+        control_instance[index] = VLSG_CreateInstance();
+        if ((control_instance[index] == NULL) || (fade_buffer[index] == NULL))
         {
-            progname = slash + 1;
+            for (; index >= 0; index--)
+            {
+                if (control_instance[index] != NULL) VLSG_DestroyInstance(control_instance[index]);
+                control_instance[index] = NULL;
+            }
+            return -1;
         }
+
+        setup_synth_instance(control_instance[index], index, synth_frequency, rom, synth_buffer[index], blocks);
+        VLSG_InstancePlaybackStart(control_instance[index]);
     }
 
-    printf(
-        "%s - CASIO Software Sound Generator SW-10\n"
-        "Usage: %s [OPTIONS]...\n"
-        "  -f NUM   Frequency (0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz)\n"
-        "  -p NUM   Polyphony (0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices)\n"
-        "  -e NUM   Reverb effect (0 = off, 1 = reverb 1, 2 = reverb 2)\n"
-        "  -r PATH  Rom path (path to ROMSXGM.BIN)\n"
-        "  -d       Daemonize\n"
-        "  -h       Help\n",
-        basename,
-        progname
-    );
-    exit(1);
+    return 0;
 }
 
-static void read_arguments(int argc, char *argv[]) __attribute__((noinline));
-static void read_arguments(int argc, char *argv[])
+static void retire_control_instances(void)
 {
-    int i, j;
-
-    // frequency: 0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz
-    frequency = 2;
-
-    // polyphony: 0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices
-    polyphony = 3;
+    int index;
 
-    // reverb effect: 0 = off, 1 = reverb 1, 2 = reverb 2
-    reverb_effect = 0;
+    // old instances aren't destroyed immediately, because other threads could still be reading their statistics
+    for (index = 0; index < num_synths; index++)
+    {
+        if (retired_instance[index] != NULL)
+        {
+            VLSG_DestroyInstance(retired_instance[index]);
+        }
 
-    daemonize = 0;
+        VLSG_InstancePlaybackStop(control_instance[index]);
+        retired_instance[index] = control_instance[index];
+        control_instance[index] = NULL;
+    }
+}
 
-    if (argc <= 1)
+static int send_control_request(int request)
+{
+    __atomic_store_n(&control_pending, request, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&output_suspended, __ATOMIC_SEQ_CST))
     {
-        return;
+        sem_post(&resume_wakeup);
     }
+    while (sem_wait(&control_done) < 0);
 
-    for (i = 1; i < argc; i++)
+    return control_result;
+}
+
+static void write_control_sysex(uint8_t value)
+{
+    static uint8_t buffer[5 * 6];
+    uint8_t sysex[6];
+    uint32_t time;
+    int index;
+
+    // CASIO SW-10 system exclusive message for changing polyphony / reverb
+    sysex[0] = 0xF0;
+    sysex[1] = 0x44;
+    sysex[2] = 0x0E;
+    sysex[3] = 0x03;
+    sysex[4] = value;
+    sysex[5] = 0xF7;
+
+    time = VLSG_GetTime();
+    for (index = 0; index < num_synths; index++)
     {
-        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
-        {
-            switch (argv[i][1])
-            {
-                case 'r': // rom
-                    if ((i + 1) < argc)
-                    {
-                        i++;
-                        rom_filepath = argv[i];
-                    }
-                    break;
-                case 'f': // frequency
-                    if ((i + 1) < argc)
-                    {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 2)
-                        {
-                            frequency = j;
-                        }
-                    }
-                    break;
-                case 'p': // polyphony
-                    if ((i + 1) < argc)
-                    {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 3)
-                        {
-                            polyphony = j;
-                        }
-                    }
-                    break;
-                case 'e': // reverb effect
-                    if ((i + 1) < argc)
-                    {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 2)
-                        {
-                            reverb_effect = j;
-                        }
-                    }
-                    break;
-                case 'd': // daemonize
-                    daemonize = 1;
-                    break;
-                case 'h': // help
-                    usage(argv[0]);
-                default:
-                    break;
-            }
-        }
-        else if (strcmp(argv[i], "--help") == 0)
-        {
-            usage(argv[0]);
-        }
+        write_synth_message(index, sysex, 6, time, buffer);
     }
 }
 
-
-static int load_rom_file(void)
+static void process_control_command(char *line, FILE *f)
 {
-    int rom_fd;
+    static char *rom_path_copy;
+    char command[16], *argument, *end;
+    int offset, value;
+    uint8_t *new_rom, *old_rom;
 
-    rom_fd = open(rom_filepath, O_RDONLY);
-    if (rom_fd < 0)
+    offset = 0;
+    if (sscanf(line, "%15s %n", command, &offset) < 1)
     {
-        char *rompathcopy, *slash, *filename;
-        DIR *dir;
-        struct dirent *entry;
+        return;
+    }
 
-        rompathcopy = strdup(rom_filepath);
-        if (rompathcopy == NULL) return -1;
+    argument = line + offset;
+    end = argument + strlen(argument);
+    while ((end != argument) && ((end[-1] == '\n') || (end[-1] == '\r') || (end[-1] == ' ')))
+    {
+        end--;
+    }
+    *end = 0;
+    value = atoi(argument);
 
-        slash = strrchr(rompathcopy, '/');
-        if (slash != NULL)
+    if (0 == strcmp(command, "status"))
+    {
+        fprintf(f, "frequency %i\npolyphony %i\nreverb %i\nrom %s\nOK\n", frequency, polyphony, reverb_effect, rom_filepath);
+    }
+    else if (0 == strcmp(command, "polyphony"))
+    {
+        if ((*argument == 0) || (value < 0) || (value > 3))
         {
-            filename = slash + 1;
-            if (slash != rompathcopy)
-            {
-                *slash = 0;
-                dir = opendir(rompathcopy);
-                *slash = '/';
-            }
-            else
-            {
-                dir = opendir("/");
-            }
+            fprintf(f, "ERROR invalid polyphony\n");
+            return;
         }
-        else
+
+        // polyphony is changed by the synthesizer between sub-blocks
+        polyphony = value;
+        write_control_sysex(0x10 + value);
+        fprintf(f, "OK\n");
+    }
+    else if (0 == strcmp(command, "reverb"))
+    {
+        if ((*argument == 0) || (value < 0) || (value > 2))
         {
-            filename = rompathcopy;
-            dir = opendir(".");
+            fprintf(f, "ERROR invalid reverb effect\n");
+            return;
         }
 
-        if (dir == NULL)
+        reverb_effect = value;
+        write_control_sysex(0x20 + value);
+        fprintf(f, "OK\n");
+    }
+    else if (0 == strcmp(command, "rom"))
+    {
+        if ((*argument == 0) || (load_rom_file(argument, &new_rom) < 0))
         {
-            free(rompathcopy);
-            return -2;
+            fprintf(f, "ERROR opening ROM file\n");
+            return;
         }
 
-        while (1)
+        if (create_control_instances(frequency, new_rom, sub_blocks) < 0)
         {
-            entry = readdir(dir);
-            if (entry == NULL) break;
+            munmap(new_rom, ROMSIZE);
+            fprintf(f, "ERROR allocating synthesizer\n");
+            return;
+        }
 
-            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) continue;
+        // new instances replace the old instances with a crossfade
+        send_control_request(CONTROL_SWAP);
+        retire_control_instances();
 
-            if (0 != strcasecmp(filename, entry->d_name)) continue;
+        old_rom = rom_address;
+        rom_address = new_rom;
+        munmap(old_rom, ROMSIZE);
 
-            strcpy(filename, entry->d_name);
-            break;
-        };
+        free(rom_path_copy);
+        rom_path_copy = strdup(argument);
+        if (rom_path_copy != NULL)
+        {
+            rom_filepath = rom_path_copy;
+        }
 
-        closedir(dir);
+        printf("ROM file changed to %s\n", argument);
+        fprintf(f, "OK\n");
+    }
+    else if (0 == strcmp(command, "frequency"))
+    {
+        if ((*argument == 0) || (value < 0) || (value > 2))
+        {
+            fprintf(f, "ERROR invalid frequency\n");
+            return;
+        }
 
-        if (entry == NULL)
+        if ((output_type == OUTPUT_WAV) || (output_type == OUTPUT_RAW))
         {
-            free(rompathcopy);
-            return -3;
+            fprintf(f, "ERROR frequency of output file can't be changed\n");
+            return;
         }
 
-        rom_fd = open(rompathcopy, O_RDONLY);
+        if (value != frequency)
+        {
+            control_frequency = value;
+            control_sub_blocks = get_sub_blocks(value);
 
-        free(rompathcopy);
+            if (create_control_instances(control_frequency, rom_address, control_sub_blocks) < 0)
+            {
+                fprintf(f, "ERROR allocating synthesizer\n");
+                return;
+            }
 
-        if (rom_fd < 0)
-        {
-            return -4;
+            // output is reopened by the main thread
+            value = send_control_request(CONTROL_FREQUENCY);
+            retire_control_instances();
+
+            if (value < 0)
+            {
+                fprintf(f, "ERROR reopening output\n");
+                return;
+            }
         }
-    }
 
-#if defined(MAP_LOCKED) && (MAP_LOCKED != 0)
-    rom_address = mmap(NULL, ROMSIZE, PROT_READ, MAP_PRIVATE | MAP_LOCKED, rom_fd, 0);
-    if (rom_address == MAP_FAILED)
-#endif
-    {
-        rom_address = mmap(NULL, ROMSIZE, PROT_READ, MAP_PRIVATE, rom_fd, 0);
+        fprintf(f, "OK\n");
     }
-
-    close(rom_fd);
-
-    if (rom_address == MAP_FAILED)
+    else
     {
-        return -5;
+        fprintf(f, "ERROR unknown command\n");
     }
-
-    return 0;
 }
 
-
-static int start_synth(void) __attribute__((noinline));
-static int start_synth(void)
+static void *control_thread_proc(void *arg)
 {
-    if (load_rom_file() < 0)
-    {
-        fprintf(stderr, "Error opening ROM file: %s\n", rom_filepath);
-        return -1;
-    }
+    char line[1024];
+    int client, client_copy;
+    FILE *input, *output;
 
-    // set frequency
-    VLSG_SetParameter(PARAMETER_Frequency, frequency);
+    while (1)
+    {
+        client = accept(control_socket, NULL, NULL);
+        if (client < 0)
+        {
+            if (control_socket < 0) break;
+            continue;
+        }
 
-    // set polyphony
-    VLSG_SetParameter(PARAMETER_Polyphony, 0x10 + polyphony);
+        client_copy = dup(client);
+        input = fdopen(client, "r");
+        output = (client_copy >= 0) ? fdopen(client_copy, "w") : NULL;
+        if ((input == NULL) || (output == NULL))
+        {
+            if (input != NULL) fclose(input); else close(client);
+            if (output != NULL) fclose(output); else if (client_copy >= 0) close(client_copy);
+            continue;
+        }
 
-    // set reverb effect
-    VLSG_SetParameter(PARAMETER_Effect, 0x20 + reverb_effect);
+        // one command per line
+        while (fgets(line, sizeof(line), input) != NULL)
+        {
+            process_control_command(line, output);
+            fflush(output);
+        };
 
-    // set address of ROM file
-    VLSG_SetParameter(PARAMETER_ROMAddress, (uintptr_t)rom_address);
+        fclose(output);
+        fclose(input);
+    };
 
-    // set output buffer
-    outbuf_counter = 0;
-    memset(midi_buffer, 0, 65536);
-    VLSG_SetParameter(PARAMETER_OutputBuffer, (uintptr_t)midi_buffer);
+    return NULL;
+}
 
-    // split output buffer to 16 subbuffers
-    samples_per_call = 256 << frequency;
-    bytes_per_call = 4 * samples_per_call;
+static int open_control_socket(void) __attribute__((noinline));
+static int open_control_socket(void)
+{
+    struct sockaddr_un addr;
+    pthread_attr_t attr;
+    struct sched_param param;
+    int err;
 
-    int i;
-    for (i = 0; i < 16; i++)
+    if (control_socket_path == NULL)
     {
-        midi_buf[i] = &(midi_buffer[i * bytes_per_call]);
+        return 0;
     }
 
-
-    // initialize time
-#if defined(CLOCK_MONOTONIC_RAW)
-    if (clock_gettime(CLOCK_MONOTONIC_RAW, &start_time))
+    if (strlen(control_socket_path) >= sizeof(addr.sun_path))
     {
-        monotonic_clock_id = CLOCK_MONOTONIC;
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        fprintf(stderr, "Control socket path is too long: %s\n", control_socket_path);
+        return -1;
     }
-    else
+
+    control_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control_socket < 0)
     {
-        monotonic_clock_id = CLOCK_MONOTONIC_RAW;
+        fprintf(stderr, "Error creating control socket\n");
+        return -2;
     }
-#else
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
 
-    if (start_time.tv_sec != 0)
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, control_socket_path);
+
+    // remove socket left by previous run
+    unlink(control_socket_path);
+
+    if ((bind(control_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(control_socket, 4) < 0))
     {
-        start_time.tv_sec--;
+        close(control_socket);
+        control_socket = -1;
+        fprintf(stderr, "Error binding control socket: %s\n", control_socket_path);
+        return -3;
     }
-    else
+
+    // control commands write to the synthesizers from the control thread
+    enable_input_locking();
+    sem_init(&control_done, 0, 0);
+
+    // closed connections mustn't terminate the program
+    signal(SIGPIPE, SIG_IGN);
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
     {
-        start_time.tv_nsec = 0;
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -4;
     }
 
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-    // set function GetTime
-    VLSG_SetFunc_GetTime(&VLSG_GetTime);
+    // control thread (loading ROM, creating instances) doesn't inherit real-time priority of the main thread
+    param.sched_priority = 0;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
 
-    // start playback
-    VLSG_PlaybackStart();
+    err = pthread_create(&control_thread, &attr, &control_thread_proc, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
+    {
+        fprintf(stderr, "Error creating control thread: %i\n", err);
+        return -5;
+    }
+
+    printf("Control socket: %s\n", control_socket_path);
 
     return 0;
 }
 
-static void stop_synth(void)
+static void close_control_socket(void)
 {
-    VLSG_PlaybackStop();
-    munmap(rom_address, ROMSIZE);
+    int socket_fd;
+
+    if (control_socket < 0)
+    {
+        return;
+    }
+
+    socket_fd = control_socket;
+    control_socket = -1;
+    shutdown(socket_fd, SHUT_RDWR);
+    close(socket_fd);
+    unlink(control_socket_path);
 }
 
-static int run_as_daemon(void) __attribute__((noinline));
-static int run_as_daemon(void)
+static int write_session_data(const uint8_t *data, unsigned int length)
 {
-    int err;
-
-    printf("Running as daemon...\n");
+    ssize_t written;
 
-    err = daemon(0, 0);
-    if (err < 0)
+    while (length != 0)
     {
-        fprintf(stderr, "Error running as daemon: %i\n", err);
-        return -1;
-    }
+        written = write(session_fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        data += written;
+        length -= written;
+    };
 
     return 0;
 }
 
-static int open_midi_port(void) __attribute__((noinline));
-static int open_midi_port(void)
+static void *session_thread_proc(void *arg)
 {
-    int err;
-    unsigned int caps, type;
+    struct timespec timeout;
+    unsigned int length;
+    int index, finished;
 
-    err = snd_seq_open(&midi_seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
-    if (err < 0)
+    while (1)
     {
-        fprintf(stderr, "Error opening ALSA sequencer: %i\n%s\n", err, snd_strerror(err));
-        return -1;
-    }
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;
+        if (timeout.tv_nsec >= 1000000000)
+        {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&session_wakeup, &timeout);
 
-    err = snd_seq_set_client_name(midi_seq, midi_name);
-    if (err < 0)
-    {
-        snd_seq_close(midi_seq);
-        fprintf(stderr, "Error setting sequencer client name: %i\n%s\n", err, snd_strerror(err));
-        return -2;
-    }
+        // recording continues into the other buffer while this buffer is written
+        pthread_mutex_lock(&session_mutex);
+        index = session_current;
+        length = session_length[index];
+        session_current = index ^ 1;
+        finished = !session_recording;
+        pthread_mutex_unlock(&session_mutex);
 
-    caps = SND_SEQ_PORT_CAP_SUBS_WRITE | SND_SEQ_PORT_CAP_WRITE;
-    type = SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_MIDI_GM | SND_SEQ_PORT_TYPE_SYNTHESIZER;
-    err = snd_seq_create_simple_port(midi_seq, port_name, caps, type);
-    if (err < 0)
-    {
-        snd_seq_close(midi_seq);
-        fprintf(stderr, "Error creating sequencer port: %i\n%s\n", err, snd_strerror(err));
-        return -3;
-    }
-    midi_port_id = err;
+        if (write_session_data(session_buffer[index], length) < 0)
+        {
+            fprintf(stderr, "Error writing session log\n");
 
-    printf("%s ALSA address is %i:0\n", midi_name, snd_seq_client_id(midi_seq));
+            pthread_mutex_lock(&session_mutex);
+            session_recording = 0;
+            pthread_mutex_unlock(&session_mutex);
+            break;
+        }
 
-    return 0;
-}
+        pthread_mutex_lock(&session_mutex);
+        session_length[index] = 0;
+        pthread_mutex_unlock(&session_mutex);
 
-static void close_midi_port(void)
-{
-    snd_seq_delete_port(midi_seq, midi_port_id);
-    snd_seq_close(midi_seq);
-}
+        if (finished) break;
+    };
 
+    return NULL;
+}
 
-static int set_hw_params(void)
+static int open_session_log(void) __attribute__((noinline));
+static int open_session_log(void)
 {
-    int err, dir;
-    unsigned int rate;
-    snd_pcm_uframes_t buffer_size, period_size;
-    snd_pcm_hw_params_t *pcm_hwparams;
+    sw10_session_header header;
+    pthread_attr_t attr;
+    pthread_mutexattr_t mutex_attr;
+    struct sched_param param;
+    int err;
 
-    snd_pcm_hw_params_alloca(&pcm_hwparams);
+    if (session_log_path == NULL)
+    {
+        return 0;
+    }
 
-    err = snd_pcm_hw_params_any(midi_pcm, pcm_hwparams);
-    if (err < 0)
+    // the mutex is used by the real-time render and MIDI threads and by the session thread (SCHED_OTHER),
+    // priority inheritance keeps the session thread from delaying the real-time threads behind other threads
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setprotocol(&mutex_attr, PTHREAD_PRIO_INHERIT);
+    err = pthread_mutex_init(&session_mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    if (err != 0)
     {
-        fprintf(stderr, "Error getting hwparams: %i\n%s\n", err, snd_strerror(err));
+        fprintf(stderr, "Error creating session log mutex: %i\n", err);
         return -1;
     }
 
-    err = snd_pcm_hw_params_set_access(midi_pcm, pcm_hwparams, SND_PCM_ACCESS_RW_INTERLEAVED);
-    if (err < 0)
+    session_buffer[0] = (uint8_t *) malloc(SESSION_BUFFER_SIZE);
+    session_buffer[1] = (uint8_t *) malloc(SESSION_BUFFER_SIZE);
+    if ((session_buffer[0] == NULL) || (session_buffer[1] == NULL))
     {
-        fprintf(stderr, "Error setting access: %i\n%s\n", err, snd_strerror(err));
+        fprintf(stderr, "Error allocating session log buffers\n");
+        return -1;
+    }
+
+    session_fd = open(session_log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (session_fd < 0)
+    {
+        fprintf(stderr, "Error opening session log: %s\n", session_log_path);
         return -2;
     }
 
-    err = snd_pcm_hw_params_set_format(midi_pcm, pcm_hwparams, SND_PCM_FORMAT_S16);
-    if (err < 0)
+    // the configuration of the synthesizers, the replay must use the same ROM
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SW10_SESSION_MAGIC, 8);
+    header.version = SW10_SESSION_VERSION;
+    header.frequency = frequency;
+    header.polyphony = polyphony;
+    header.reverb_effect = reverb_effect;
+    header.sub_blocks = sub_blocks;
+    header.num_synths = num_synths;
+    header.event_delay = get_event_delay(frequency);
+    header.rom_checksum = sw10_session_checksum(SW10_SESSION_CHECKSUM_INIT, rom_address, ROMSIZE);
+
+    if (write_session_data((const uint8_t *)&header, sizeof(header)) < 0)
     {
-        fprintf(stderr, "Error setting format: %i\n%s\n", err, snd_strerror(err));
+        close(session_fd);
+        session_fd = -1;
+        fprintf(stderr, "Error writing session log: %s\n", session_log_path);
         return -3;
     }
 
-    err = snd_pcm_hw_params_set_channels(midi_pcm, pcm_hwparams, 2);
-    if (err < 0)
+    sem_init(&session_wakeup, 0, 0);
+    session_current = 0;
+    session_length[0] = 0;
+    session_length[1] = 0;
+    session_recording = 1;
+
+    err = pthread_attr_init(&attr);
+    if (err != 0)
     {
-        fprintf(stderr, "Error setting channels: %i\n%s\n", err, snd_strerror(err));
+        session_recording = 0;
+        close(session_fd);
+        session_fd = -1;
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
         return -4;
     }
 
-    rate = 11025 << frequency;
-    dir = 0;
-    err = snd_pcm_hw_params_set_rate_near(midi_pcm, pcm_hwparams, &rate, &dir);
-    if (err < 0)
+    // writer thread doesn't inherit real-time priority of the main thread
+    param.sched_priority = 0;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    err = pthread_create(&session_thread, &attr, &session_thread_proc, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
     {
-        fprintf(stderr, "Error setting rate: %i\n%s\n", err, snd_strerror(err));
+        session_recording = 0;
+        close(session_fd);
+        session_fd = -1;
+        fprintf(stderr, "Error creating session log thread: %i\n", err);
         return -5;
     }
 
-    buffer_size = samples_per_call * 16;
-    err = snd_pcm_hw_params_set_buffer_size_near(midi_pcm, pcm_hwparams, &buffer_size);
-    if (err < 0)
-    {
-        fprintf(stderr, "Error setting buffer size: %i\n%s\n", err, snd_strerror(err));
-        return -6;
-    }
+    return 0;
+}
 
-    period_size = samples_per_call;
-    dir = 0;
-    err = snd_pcm_hw_params_set_period_size_near(midi_pcm, pcm_hwparams, &period_size, &dir);
-    if (err < 0)
+static void close_session_log(void)
+{
+    if (session_fd < 0)
     {
-        fprintf(stderr, "Error setting period size: %i\n%s\n", err, snd_strerror(err));
-        return -7;
+        return;
     }
 
-    err = snd_pcm_hw_params(midi_pcm, pcm_hwparams);
-    if (err < 0)
-    {
-        fprintf(stderr, "Error setting hwparams: %i\n%s\n", err, snd_strerror(err));
-        return -8;
-    }
+    stop_session_log(SW10_SESSION_END_EXIT);
+    pthread_join(session_thread, NULL);
 
-    return 0;
+    close(session_fd);
+    session_fd = -1;
 }
 
-static int set_sw_params(void)
+static int start_thread(void) __attribute__((noinline));
+static int start_thread(void)
 {
-    snd_pcm_sw_params_t *swparams;
+    pthread_attr_t attr;
     int err;
+    volatile int initialized;
 
-    snd_pcm_sw_params_alloca(&swparams);
+    // try to increase priority (only root)
+    nice(-20);
 
-    err = snd_pcm_sw_params_current(midi_pcm, swparams);
-    if (err < 0)
+    if (rt_priority != 0)
     {
-        fprintf(stderr, "Error getting swparams: %i\n%s\n", err, snd_strerror(err));
-        return -1;
+        struct rlimit limit;
+
+        // raise the limit while running as root, so the real-time priority can be set after dropping root privileges
+        if ((getrlimit(RLIMIT_RTPRIO, &limit) == 0) && (limit.rlim_cur != RLIM_INFINITY) && (limit.rlim_cur < (rlim_t)rt_priority))
+        {
+            limit.rlim_cur = rt_priority;
+            if ((limit.rlim_max != RLIM_INFINITY) && (limit.rlim_max < (rlim_t)rt_priority))
+            {
+                limit.rlim_max = rt_priority;
+            }
+            if (setrlimit(RLIMIT_RTPRIO, &limit) < 0)
+            {
+                fprintf(stderr, "Warning: unable to raise real-time priority limit: %s\n", strerror(errno));
+            }
+        }
     }
 
-    err = snd_pcm_sw_params_set_avail_min(midi_pcm, swparams, samples_per_call);
-    if (err < 0)
+    if (lock_memory)
     {
-        fprintf(stderr, "Error setting avail min: %i\n%s\n", err, snd_strerror(err));
-        return -2;
+        struct rlimit limit;
+
+        // raise the limit while running as root, so the memory can be locked after dropping root privileges
+        limit.rlim_cur = RLIM_INFINITY;
+        limit.rlim_max = RLIM_INFINITY;
+        if (setrlimit(RLIMIT_MEMLOCK, &limit) < 0)
+        {
+            fprintf(stderr, "Warning: unable to raise locked memory limit: %s\n", strerror(errno));
+        }
     }
 
-    err = snd_pcm_sw_params(midi_pcm, swparams);
-    if (err < 0)
+    err = pthread_attr_init(&attr);
+    if (err != 0)
     {
-        fprintf(stderr, "Error setting sw params: %i\n%s\n", err, snd_strerror(err));
-        return -3;
+        fprintf(stderr, "Error creating thread attribute: %i\n", err);
+        return -1;
     }
 
-    return 0;
-}
+    // the thread is joined at exit, before closing the MIDI port
+    if (pipe(midi_stop_pipe) < 0)
+    {
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        pthread_attr_destroy(&attr);
+        return -2;
+    }
 
-static int open_pcm_output(void) __attribute__((noinline));
-static int open_pcm_output(void)
-{
-    int err;
+    midi_init_state = 0;
+    initialized = 0;
+    err = pthread_create(&midi_thread, &attr, &midi_thread_proc, (void *)&initialized);
+    pthread_attr_destroy(&attr);
 
-    err = snd_pcm_open(&midi_pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0)
+    if (err != 0)
     {
-        fprintf(stderr, "Error opening PCM device: %i\n%s\n", err, snd_strerror(err));
-        return -1;
+        fprintf(stderr, "Error creating thread: %i\n", err);
+        close(midi_stop_pipe[0]);
+        close(midi_stop_pipe[1]);
+        midi_stop_pipe[0] = midi_stop_pipe[1] = -1;
+        return -2;
     }
+    midi_thread_started = 1;
 
-    if (set_hw_params() < 0)
+    // wait for thread initialization
+    while (initialized == 0)
     {
-        return -2;
+        struct timespec req;
+
+        req.tv_sec = 0;
+        req.tv_nsec = 10000000;
+        nanosleep(&req, NULL);
+    };
+
+    // the render scheduler and CPU are set after creating the MIDI thread, so the MIDI thread doesn't inherit them
+    if (rt_priority != 0)
+    {
+        set_thread_scheduler("render");
     }
+    set_thread_affinity(render_cpu, "render");
 
-    if (set_sw_params() < 0)
+    if (start_render_threads() < 0)
     {
         return -3;
     }
 
-    // set nonblock mode
-    snd_pcm_nonblock(midi_pcm, 1);
+    if (start_render_ahead_thread() < 0)
+    {
+        return -4;
+    }
 
-    snd_pcm_prepare(midi_pcm);
+    if (drop_privileges() < 0)
+    {
+        fprintf(stderr, "Error dropping root privileges\n");
+    }
 
     return 0;
 }
 
-static void close_pcm_output(void)
+
+static uint8_t prefault_stack(void) __attribute__((noinline));
+static uint8_t prefault_stack(void)
 {
-    snd_pcm_close(midi_pcm);
-}
+    volatile uint8_t stack_area[PREFAULT_STACK_SIZE];
+    int i;
+
+    for (i = 0; i < PREFAULT_STACK_SIZE; i += 4096)
+    {
+        stack_area[i] = 0;
+    }
 
+    return stack_area[0];
+}
 
-static int drop_privileges(void)
+static void lock_and_prefault_memory(void) __attribute__((noinline));
+static void lock_and_prefault_memory(void)
 {
-    uid_t uid;
-    gid_t gid;
-    const char *sudo_id;
-    long long int llid;
-    const char *xdg_dir;
-    char buf[32];
-    struct stat statbuf;
-    struct passwd *passwdbuf;
+    uint8_t *heap_area;
+    unsigned int i;
+    volatile uint8_t value;
+
+    // keep freed memory in the process, so it doesn't page fault again
+#if defined(M_TRIM_THRESHOLD) && defined(M_MMAP_MAX)
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
 
-    if (getuid() != 0)
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
     {
-        return 0;
+        fprintf(stderr, "Warning: unable to lock memory: %s\n", strerror(errno));
     }
 
-    sudo_id = secure_getenv("SUDO_UID");
-    if (sudo_id == NULL)
+    prefault_stack();
+
+    heap_area = (uint8_t *) malloc(PREFAULT_HEAP_SIZE);
+    if (heap_area != NULL)
     {
-        sudo_id = secure_getenv("PKEXEC_UID");
-        if (sudo_id == NULL)
-        {
-            return -1;
-        }
+        memset(heap_area, 0, PREFAULT_HEAP_SIZE);
+        free(heap_area);
+    }
+    else
+    {
+        fprintf(stderr, "Warning: unable to prefault heap\n");
     }
 
-    errno = 0;
-    llid = strtoll(sudo_id, NULL, 10);
-    uid = (uid_t) llid;
-    if (errno != 0 || uid == 0 || llid != (long long int)uid)
+    // engine buffers and ROM
+    for (i = 0; i < (unsigned int)num_synths; i++)
+    {
+        memset(synth_buffer[i], 0, 65536);
+    }
+    for (i = 0; i < ROMSIZE; i += 4096)
+    {
+        value = rom_address[i];
+    }
+    (void)value;
+}
+
+static int64_t get_output_played_frames(void)
+{
+    struct timespec _tp;
+
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &_tp);
+
+    return ((int64_t)(_tp.tv_sec - output_start_time.tv_sec) * output_rate) + (((int64_t)(_tp.tv_nsec - output_start_time.tv_nsec) * output_rate) / 1000000000);
+}
+
+static int output_pause(int enable)
+{
+    if (output_type == OUTPUT_ALSA)
     {
-        return -2;
+        return snd_pcm_pause(midi_pcm, enable);
     }
 
-    gid = getgid();
-    if (gid == 0)
+    if (output_type != OUTPUT_UNPACED)
     {
-        sudo_id = secure_getenv("SUDO_GID");
-        if (sudo_id == NULL)
+        if (enable)
         {
-            passwdbuf = getpwuid(uid);
-            if (passwdbuf != NULL)
-            {
-                gid = passwdbuf->pw_gid;
-            }
-
-            if (gid == 0)
+            // keep the frames which weren't played yet
+            output_queued_frames -= get_output_played_frames();
+            if (output_queued_frames < 0)
             {
-                return -3;
+                output_queued_frames = 0;
             }
         }
         else
         {
-            errno = 0;
-            llid = strtoll(sudo_id, NULL, 10);
-            gid = (gid_t) llid;
-            if (errno != 0 || gid == 0 || llid != (long long int)gid)
-            {
-                return -4;
-            }
+            clock_gettime(MONOTONIC_CLOCK_TYPE, &output_start_time);
         }
     }
 
-    if (setgid(gid) != 0)
+    return 0;
+}
+
+static snd_pcm_sframes_t output_avail(void)
+{
+    int64_t played_frames;
+
+    if (output_type == OUTPUT_ALSA)
     {
-        return -5;
+        if (snd_pcm_state(midi_pcm) == SND_PCM_STATE_XRUN)
+        {
+            fprintf(stderr, "Buffer underrun\n");
+            output_underruns++;
+            snd_pcm_prepare(midi_pcm);
+        }
+
+        return snd_pcm_avail_update(midi_pcm);
     }
-    if (setuid(uid) != 0)
+
+    if (output_type == OUTPUT_UNPACED)
     {
-        return -6;
+        return pcm_buffer_size;
     }
 
-    printf("Dropped root privileges\n");
+    played_frames = get_output_played_frames();
+    if (played_frames > output_queued_frames)
+    {
+        fprintf(stderr, "Buffer underrun\n");
+        output_underruns++;
 
-    chdir("/");
+        // restart the virtual device with empty buffer
+        clock_gettime(MONOTONIC_CLOCK_TYPE, &output_start_time);
+        output_queued_frames = 0;
+        return pcm_buffer_size;
+    }
 
-    // define some environment variables
+    return pcm_buffer_size - (output_queued_frames - played_frames);
+}
 
-    xdg_dir = getenv("XDG_RUNTIME_DIR");
-    if ((xdg_dir == NULL) || (*xdg_dir == 0))
+static snd_pcm_sframes_t output_free_frames(void)
+{
+    int64_t queued_frames;
+
+    // free space in the virtual device, underruns are handled by output_avail
+    queued_frames = output_queued_frames - get_output_played_frames();
+    return (queued_frames > 0) ? (snd_pcm_sframes_t)(pcm_buffer_size - queued_frames) : (snd_pcm_sframes_t)pcm_buffer_size;
+}
+
+static void output_wait(int is_paused)
+{
+    struct timespec req;
+
+    if (is_paused)
     {
-        snprintf(buf, 32, "/run/user/%lli", (long long int)uid);
+        // sleep until a MIDI event, control request or signal arrives (all of them post the semaphore)
+        __atomic_store_n(&output_suspended, 1, __ATOMIC_SEQ_CST);
+        if (!midi_event_written && !__atomic_load_n(&control_pending, __ATOMIC_SEQ_CST) && !exit_requested && !stats_requested)
+        {
+            while ((sem_wait(&resume_wakeup) < 0) && !exit_requested && !stats_requested);
+        }
+        __atomic_store_n(&output_suspended, 0, __ATOMIC_SEQ_CST);
 
-        if ((stat(buf, &statbuf) == 0) && ((statbuf.st_mode & S_IFMT) == S_IFDIR) && (statbuf.st_uid == uid))
+        while (sem_trywait(&resume_wakeup) == 0);
+        return;
+    }
+
+    req.tv_sec = 0;
+    req.tv_nsec = 10000000;
+
+    if (output_type == OUTPUT_UNPACED)
+    {
+        return;
+    }
+
+    if (custom_buffer)
+    {
+        snd_pcm_sframes_t missing_frames;
+
+        if (output_type == OUTPUT_ALSA)
         {
-            // if XDG_RUNTIME_DIR is not defined and directory /run/user/$USER exists then use it for XDG_RUNTIME_DIR
-            setenv("XDG_RUNTIME_DIR", buf, 1);
+            // wait until there's space for a period
+            snd_pcm_wait(midi_pcm, 10);
+            return;
+        }
 
-            xdg_dir = getenv("XDG_CONFIG_HOME");
-            if ((xdg_dir == NULL) || (*xdg_dir == 0))
+        // sleep until there's space for a period (at most 10 ms)
+        missing_frames = write_threshold - output_free_frames();
+        if (missing_frames <= 0)
+        {
+            return;
+        }
+
+        if (missing_frames < (snd_pcm_sframes_t)(output_rate / 100))
+        {
+            req.tv_nsec = (missing_frames * 1000000000LL) / output_rate;
+        }
+    }
+
+    nanosleep(&req, NULL);
+}
+
+static int output_frames(const uint8_t *buf_ptr, snd_pcm_uframes_t remaining)
+{
+    snd_pcm_sframes_t written;
+    snd_pcm_uframes_t file_frames;
+
+    if (output_type != OUTPUT_ALSA)
+    {
+        if (output_file != NULL)
+        {
+            file_frames = remaining;
+            if ((output_type == OUTPUT_WAV) && (output_file_frames + file_frames > WAV_MAX_FRAMES))
             {
-                passwdbuf = getpwuid(uid);
-                if (passwdbuf != NULL)
+                // stop capturing at the size limit, the output stays paced
+                if (output_file_frames < WAV_MAX_FRAMES)
                 {
-                    // also if XDG_CONFIG_HOME is not defined then define it as user's home directory
-                    setenv("XDG_CONFIG_HOME", passwdbuf->pw_dir, 1);
+                    fprintf(stderr, "Warning: WAV file size limit reached, capture stopped\n");
                 }
+                file_frames = WAV_MAX_FRAMES - output_file_frames;
+            }
+
+            if (fwrite(buf_ptr, 4, file_frames, output_file) != file_frames)
+            {
+                return -1;
             }
+            output_file_frames += file_frames;
         }
+
+        output_queued_frames += remaining;
+        return 0;
     }
 
+    while (remaining)
+    {
+        written = snd_pcm_writei(midi_pcm, buf_ptr, remaining);
+        if (written < 0)
+        {
+            return -1;
+        }
+
+        remaining -= written;
+        buf_ptr += written << 2;
+    };
+
     return 0;
 }
 
-static int start_thread(void) __attribute__((noinline));
-static int start_thread(void)
+static void output_silence(snd_pcm_uframes_t frames)
 {
-    pthread_attr_t attr;
-    int err;
-    volatile int initialized;
+    snd_pcm_uframes_t part;
 
-    // try to increase priority (only root)
-    nice(-20);
-
-    err = pthread_attr_init(&attr);
-    if (err != 0)
+    for (; frames != 0; frames -= part)
     {
-        fprintf(stderr, "Error creating thread attribute: %i\n", err);
-        return -1;
+        part = (frames < sizeof(silence_buffer) / 4) ? frames : (sizeof(silence_buffer) / 4);
+        output_frames(silence_buffer, part);
     }
+}
 
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-    midi_init_state = 0;
-    initialized = 0;
-    err = pthread_create(&midi_thread, &attr, &midi_thread_proc, (void *)&initialized);
-    pthread_attr_destroy(&attr);
+static void fill_output_with_silence(void)
+{
+    if (custom_buffer)
+    {
+        // fill the whole buffer with silence
+        output_silence(pcm_buffer_size);
+    }
+    else
+    {
+        output_silence(14 * output_block_frames);
+    }
+}
 
-    if (err != 0)
+static int output_suspend(void)
+{
+    output_dropped = 0;
+    if (0 == output_pause(1))
     {
-        fprintf(stderr, "Error creating thread: %i\n", err);
-        return -2;
+        return 0;
     }
 
-    // wait for thread initialization
-    while (initialized == 0)
+    // device doesn't support pausing - stop it (the buffer contains only silence)
+    if ((output_type == OUTPUT_ALSA) && (0 == snd_pcm_drop(midi_pcm)))
     {
-        struct timespec req;
+        output_dropped = 1;
+        return 0;
+    }
 
-        req.tv_sec = 0;
-        req.tv_nsec = 10000000;
-        nanosleep(&req, NULL);
-    };
+    return -1;
+}
 
-    if (drop_privileges() < 0)
+static void output_resume(void)
+{
+    if (output_dropped)
     {
-        fprintf(stderr, "Error dropping root privileges\n");
+        output_dropped = 0;
+        snd_pcm_prepare(midi_pcm);
+        fill_output_with_silence();
+    }
+    else
+    {
+        output_pause(0);
     }
-
-    return 0;
 }
 
+static void exit_signal_handler(int signum)
+{
+    exit_requested = 1;
+
+    // wake up the main thread, if the output is suspended
+    sem_post(&resume_wakeup);
+}
 
-static int output_subbuffer(int num)
+static void stats_signal_handler(int signum)
 {
-    snd_pcm_uframes_t remaining;
-    snd_pcm_sframes_t written;
-    uint8_t *buf_ptr;
+    stats_requested = 1;
+    sem_post(&resume_wakeup);
+}
 
-    remaining = samples_per_call;
-    buf_ptr = midi_buf[num];
+static void change_output_frequency(void)
+{
+    VLSG_Instance *old_instance;
+    struct timespec req;
+    int index, result;
 
-    while (remaining)
+    // stop the render ahead thread, the rendered blocks are discarded
+    if (render_ahead)
     {
-        written = snd_pcm_writei(midi_pcm, buf_ptr, remaining);
-        if (written < 0)
+        __atomic_store_n(&ahead_lead, 0, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&ahead_idle, __ATOMIC_SEQ_CST))
         {
-            return -1;
+            req.tv_sec = 0;
+            req.tv_nsec = 1000000;
+            nanosleep(&req, NULL);
         }
+    }
 
-        remaining -= written;
-        buf_ptr += written << 2;
-    };
+    close_pcm_output();
+    output_dropped = 0;
 
-    return 0;
+    // the new instances don't continue the recorded session
+    stop_session_log(SW10_SESSION_END_RECONFIGURED);
+
+    frequency = control_frequency;
+    sub_blocks = control_sub_blocks;
+    split_output_buffer();
+
+    // block size changes, so the instances can't be crossfaded
+    for (index = 0; index < num_synths; index++)
+    {
+        old_instance = synth_instance[index];
+
+        pthread_mutex_lock(&(synth_input_mutex[index]));
+        VLSG_InstanceMoveState(control_instance[index], old_instance);
+        synth_instance[index] = control_instance[index];
+        pthread_mutex_unlock(&(synth_input_mutex[index]));
+
+        control_instance[index] = old_instance;
+    }
+
+    result = 0;
+    if (open_pcm_output() < 0)
+    {
+        fprintf(stderr, "Error reopening output\n");
+        exit_requested = 1;
+        result = -1;
+    }
+    else
+    {
+        fill_output_with_silence();
+        printf("Output frequency changed to %i Hz\n", 11025 << frequency);
+    }
+
+    if (render_ahead)
+    {
+        __atomic_store_n(&ahead_produced, outbuf_counter, __ATOMIC_RELEASE);
+        __atomic_store_n(&ahead_consumed, outbuf_counter, __ATOMIC_RELEASE);
+        ahead_min_level = render_ahead;
+        __atomic_store_n(&ahead_lead, render_ahead, __ATOMIC_SEQ_CST);
+        sem_post(&ahead_wakeup);
+    }
+
+    finish_control_request(result);
 }
 
 static void main_loop(void) __attribute__((noinline));
@@ -1310,37 +4630,59 @@ static void main_loop(void)
 {
     int is_paused;
     struct timespec last_written_time, current_time;
+    unsigned int pending_frames, silent_frames;
+    const uint8_t *pending_ptr;
 
-    for (int i = 2; i < 16; i++)
-    {
-        output_subbuffer(i);
-    }
+    fill_output_with_silence();
+
+    // part of the last generated block, which wasn't written yet
+    pending_frames = 0;
+    pending_ptr = NULL;
+
+    // frames of consecutive silent blocks
+    silent_frames = 0;
 
     is_paused = 0;
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &last_written_time);
     // pause pcm playback at the beginning
-    if (0 == snd_pcm_pause(midi_pcm, 1))
+    if (0 == output_suspend())
     {
         is_paused = 1;
         printf("PCM playback paused\n");
     }
-    else
-    {
-        // if pausing doesn't work then set time of last written event as current time, so the next attempt to pause will be in 60 seconds
-        clock_gettime(MONOTONIC_CLOCK_TYPE, &last_written_time);
-    }
 
     midi_event_written = 0;
     midi_init_state = 1;
+    clock_gettime(MONOTONIC_CLOCK_TYPE, &stats_start_time);
 
-    while (1)
+    if (render_ahead)
+    {
+        // start filling the render ahead ring
+        sem_post(&ahead_wakeup);
+    }
+
+    while (!exit_requested)
     {
-        struct timespec req;
-        snd_pcm_state_t pcmstate;
         snd_pcm_sframes_t available_frames;
 
-        req.tv_sec = 0;
-        req.tv_nsec = 10000000;
-        nanosleep(&req, NULL);
+        output_wait(is_paused);
+
+        if (__atomic_load_n(&control_pending, __ATOMIC_ACQUIRE) == CONTROL_FREQUENCY)
+        {
+            change_output_frequency();
+
+            // the rest of the last block has the old format
+            pending_frames = 0;
+            silent_frames = 0;
+            is_paused = 0;
+            clock_gettime(MONOTONIC_CLOCK_TYPE, &last_written_time);
+        }
+
+        if (stats_requested)
+        {
+            stats_requested = 0;
+            print_statistics(stdout);
+        }
 
         if (midi_event_written)
         {
@@ -1352,22 +4694,44 @@ static void main_loop(void)
             if (is_paused)
             {
                 is_paused = 0;
-                snd_pcm_pause(midi_pcm, 0);
+                output_resume();
                 printf("PCM playback unpaused\n");
+
+                // render the first block now, so it's ready when the output has space for it
+                if (pending_frames == 0)
+                {
+                    pending_ptr = get_device_block(&pending_frames);
+                }
             }
+            silent_frames = 0;
         }
         else
         {
             if (is_paused)
             {
+                // instances are swapped between blocks, so the playback must run
+                if (__atomic_load_n(&control_pending, __ATOMIC_ACQUIRE) == CONTROL_SWAP)
+                {
+                    midi_event_written = 1;
+                }
                 continue;
             }
 
             clock_gettime(MONOTONIC_CLOCK_TYPE, &current_time);
-            // if more than 60 seconds elapsed from last written event, then pause pcm playback
-            if (current_time.tv_sec - last_written_time.tv_sec > 60)
+
+            // while there are no MIDI events, reduce the render ahead lead by one block per second
+            if (render_ahead && (ahead_lead > 1) && (current_time.tv_sec != ahead_shrink_time) && ((current_time.tv_sec - last_written_time.tv_sec) * 1000 + (current_time.tv_nsec - last_written_time.tv_nsec) / 1000000 >= 1000))
+            {
+                ahead_shrink_time = current_time.tv_sec;
+                ahead_lead--;
+                print_render_ahead_state("reduced");
+            }
+
+            // when the synthesizers are silent and the output buffer contains only silence, then pause pcm playback
+            // (output file keeps the silence between events, up to 60 seconds)
+            if ((silent_frames >= pending_frames + pcm_buffer_size) && ((output_file == NULL) || (current_time.tv_sec - last_written_time.tv_sec > 60)))
             {
-                if (0 == snd_pcm_pause(midi_pcm, 1))
+                if (0 == output_suspend())
                 {
                     is_paused = 1;
                     printf("PCM playback paused\n");
@@ -1375,36 +4739,55 @@ static void main_loop(void)
                 }
                 else
                 {
-                    // if pausing doesn't work then set time of last written event as current time, so the next attempt to pause will be in 60 seconds
-                    last_written_time = current_time;
+                    // if pausing doesn't work then try it again after another buffer of silence
+                    silent_frames = 0;
                 }
             }
         }
 
-        pcmstate = snd_pcm_state(midi_pcm);
-        if (pcmstate == SND_PCM_STATE_XRUN)
+        available_frames = output_avail();
+        if (available_frames >= 0)
         {
-            fprintf(stderr, "Buffer underrun\n");
-            snd_pcm_prepare(midi_pcm);
+            snd_pcm_sframes_t filled_frames;
+
+            filled_frames = pcm_buffer_size - available_frames;
+            if (filled_frames < 0) filled_frames = 0;
+            stats_output_fill[(filled_frames >= (snd_pcm_sframes_t)pcm_buffer_size) ? (OUTPUT_FILL_BUCKETS - 1) : ((filled_frames * OUTPUT_FILL_BUCKETS) / pcm_buffer_size)]++;
         }
 
-        available_frames = snd_pcm_avail_update(midi_pcm);
-        while (available_frames >= (3 * samples_per_call))
+        while (available_frames >= write_threshold)
         {
-            VLSG_FillOutputBuffer(outbuf_counter);
+            unsigned int frames;
+
+            if (pending_frames == 0)
+            {
+                pending_ptr = get_device_block(&pending_frames);
+
+                if (block_silent[(outbuf_counter - 1) & 15])
+                {
+                    if (silent_frames < pcm_buffer_size + pending_frames) silent_frames += pending_frames;
+                }
+                else
+                {
+                    silent_frames = 0;
+                }
+            }
+
+            frames = (available_frames < pending_frames) ? available_frames : pending_frames;
 
-            if (output_subbuffer(outbuf_counter & 15) < 0)
+            if (output_frames(pending_ptr, frames) < 0)
             {
                 fprintf(stderr, "Error writing audio data\n");
+                pending_frames = 0;
                 available_frames = 0;
                 break;
             }
             else
             {
-                available_frames -= samples_per_call;
+                available_frames -= frames;
+                pending_frames -= frames;
+                pending_ptr += frames << 2;
             }
-
-            outbuf_counter++;
         };
     };
 }
@@ -1413,6 +4796,9 @@ int main(int argc, char *argv[])
 {
     read_arguments(argc, argv);
 
+    // the semaphore is posted by the control thread and signal handlers
+    sem_init(&resume_wakeup, 0, 0);
+
     if (start_synth() < 0)
     {
         return 2;
@@ -1427,32 +4813,97 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (open_session_log() < 0)
+    {
+        stop_synth();
+        return 10;
+    }
+
     if (start_thread() < 0)
     {
+        stop_midi_thread();
+        stop_render_ahead_thread();
+        close_session_log();
         stop_synth();
         return 4;
     }
 
     if (open_pcm_output() < 0)
     {
-        midi_init_state = -1;
+        stop_midi_thread();
+        stop_render_ahead_thread();
+        close_session_log();
         stop_synth();
         return 5;
     }
 
     if (open_midi_port() < 0)
     {
-        midi_init_state = -1;
+        stop_midi_thread();
+        stop_render_ahead_thread();
         close_pcm_output();
+        close_session_log();
         stop_synth();
         return 6;
     }
 
+    if (open_stats_socket() < 0)
+    {
+        stop_midi_thread();
+        stop_render_ahead_thread();
+        close_midi_port();
+        close_pcm_output();
+        close_session_log();
+        stop_synth();
+        return 7;
+    }
+
+    if (open_ingress() < 0)
+    {
+        stop_midi_thread();
+        stop_render_ahead_thread();
+        close_ingress();
+        close_stats_socket();
+        close_midi_port();
+        close_pcm_output();
+        close_session_log();
+        stop_synth();
+        return 8;
+    }
+
+    if (open_control_socket() < 0)
+    {
+        stop_midi_thread();
+        stop_render_ahead_thread();
+        close_ingress();
+        close_stats_socket();
+        close_midi_port();
+        close_pcm_output();
+        close_session_log();
+        stop_synth();
+        return 9;
+    }
+
+    if (lock_memory)
+    {
+        lock_and_prefault_memory();
+    }
+
+    // stop main loop on termination, so the output can be closed properly
+    signal(SIGINT, exit_signal_handler);
+    signal(SIGTERM, exit_signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
+
     main_loop();
 
-    midi_init_state = -1;
+    stop_midi_thread();
+    stop_render_ahead_thread();
+    close_control_socket();
+    close_ingress();
+    close_stats_socket();
     close_midi_port();
     close_pcm_output();
+    close_session_log();
     stop_synth();
     return 0;
 }
@@ -0,0 +1,135 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_SW10_INGRESS_H_INCLUDED_)
+#define _SW10_INGRESS_H_INCLUDED_
+
+// Local MIDI ingress for sw10_alsadrv
+//
+// MIDI data is sent as records - a header followed by one complete MIDI message (starting with a status byte).
+// Records can be sent as packets to a Unix socket (SOCK_SEQPACKET, several records per packet)
+// or written to a shared memory ring (one producer per ring).
+//
+// Record time is CLOCK_MONOTONIC time in microseconds (0 = now). Like sequencer events, records are played
+// after the synthesizer event delay, so records with future time are played with the same relative timing.
+// Records with future time (at most 60 seconds) are held by the daemon until they're due, so they don't delay
+// records sent later with earlier time. Records with the same time are played in the order they were sent.
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SW10_INGRESS_MAGIC 0x30315753
+#define SW10_INGRESS_RING_SIZE 65536
+#define SW10_INGRESS_MAX_PACKET 65536
+
+typedef struct
+{
+    uint64_t time;      // CLOCK_MONOTONIC time in microseconds (0 = now)
+    uint16_t port;      // port number (0 = first port)
+    uint16_t length;    // length of MIDI data following the header
+    uint32_t reserved;
+} sw10_ingress_header;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t write_index;   // free running, written only by the producer
+    uint32_t read_index;    // free running, written only by the daemon
+    uint32_t wakeup;        // futex word, incremented by the producer when the daemon is waiting
+    uint32_t waiting;       // set by the daemon before waiting for data
+    uint32_t reserved[10];
+    uint8_t data[SW10_INGRESS_RING_SIZE];
+} sw10_ingress_ring;
+
+
+static inline uint64_t sw10_ingress_time_now(void)
+{
+    struct timespec _tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &_tp);
+
+    return ((uint64_t)_tp.tv_sec * 1000000) + (_tp.tv_nsec / 1000);
+}
+
+static inline void sw10_ingress_ring_copy_in(sw10_ingress_ring *ring, uint32_t index, const void *src, uint32_t length)
+{
+    uint32_t offset, first;
+
+    offset = index & (SW10_INGRESS_RING_SIZE - 1);
+    first = (length < SW10_INGRESS_RING_SIZE - offset) ? length : (SW10_INGRESS_RING_SIZE - offset);
+
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const uint8_t *)src + first, length - first);
+}
+
+static inline void sw10_ingress_ring_copy_out(const sw10_ingress_ring *ring, uint32_t index, void *dst, uint32_t length)
+{
+    uint32_t offset, first;
+
+    offset = index & (SW10_INGRESS_RING_SIZE - 1);
+    first = (length < SW10_INGRESS_RING_SIZE - offset) ? length : (SW10_INGRESS_RING_SIZE - offset);
+
+    memcpy(dst, ring->data + offset, first);
+    memcpy((uint8_t *)dst + first, ring->data, length - first);
+}
+
+// write one record to the ring, returns 0 on success or -1 when there's not enough space
+static inline int sw10_ingress_ring_write(sw10_ingress_ring *ring, uint64_t time, uint16_t port, const uint8_t *data, uint16_t length)
+{
+    sw10_ingress_header header;
+    uint32_t write_index;
+
+    write_index = ring->write_index;
+    if (SW10_INGRESS_RING_SIZE - (write_index - __atomic_load_n(&ring->read_index, __ATOMIC_ACQUIRE)) < sizeof(header) + length)
+    {
+        return -1;
+    }
+
+    header.time = time;
+    header.port = port;
+    header.length = length;
+    header.reserved = 0;
+
+    sw10_ingress_ring_copy_in(ring, write_index, &header, sizeof(header));
+    sw10_ingress_ring_copy_in(ring, write_index + sizeof(header), data, length);
+
+    __atomic_store_n(&ring->write_index, write_index + sizeof(header) + length, __ATOMIC_RELEASE);
+
+    // wake up the daemon only when it's waiting
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED))
+    {
+        __atomic_fetch_add(&ring->wakeup, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &ring->wakeup, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,886 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <alsa/asoundlib.h>
+#include "sw10_ingress.h"
+
+#define ONSET_THRESHOLD 2048
+#define SILENCE_TIME 500000
+#define ONSET_TIMEOUT 2000000
+#define MAX_MEASUREMENTS 1000
+#define MAX_STEPS 16
+#define AUDIO_FRAMES 1024
+
+
+typedef struct
+{
+    uint32_t midi_events;
+    uint32_t ingress_records;
+    uint32_t synth_events;
+    unsigned long underruns;
+} daemon_stats;
+
+
+static const char *seq_address = "CASIO SW-10:0";
+static const char *socket_path;
+static const char *capture_device;
+static const char *watch_filepath;
+static const char *stats_socket_path;
+static int num_measurements, step_duration;
+static unsigned int audio_rate;
+
+static snd_seq_t *seq;
+static int seq_port;
+static int client_socket = -1;
+static uint8_t packet[SW10_INGRESS_MAX_PACKET];
+static unsigned int packet_length;
+
+static snd_pcm_t *capture_pcm;
+static int watch_fd = -1;
+static int16_t audio_buffer[2 * AUDIO_FRAMES];
+
+static int64_t latencies[MAX_MEASUREMENTS];
+
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "sw10_latency";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - measure latency and throughput of sw10_alsadrv\n"
+        "Usage: %s [OPTIONS]...\n"
+        "  -a ADDR  Sequencer port of sw10_alsadrv (default = CASIO SW-10:0)\n"
+        "  -U PATH  Send MIDI data to the ingress socket of sw10_alsadrv instead of the sequencer port\n"
+        "  -c NAME  Capture device which receives the output of sw10_alsadrv (e.g. hw:Loopback,1,0)\n"
+        "  -w PATH  Output file of sw10_alsadrv (.wav or raw file)\n"
+        "  -r NUM   Rate of raw output file in Hz (default = 44100)\n"
+        "  -n NUM   Number of latency measurements (1 - %i)\n"
+        "  -S PATH  Statistics socket of sw10_alsadrv (enables throughput test)\n"
+        "  -t NUM   Duration of one throughput test step in seconds (1 - 60)\n"
+        "  -h       Help\n"
+        "Latency is measured from sending Note On to the start of the sound in the captured audio or in the output file\n",
+        basename,
+        progname,
+        MAX_MEASUREMENTS
+    );
+    exit(1);
+}
+
+static void read_arguments(int argc, char *argv[])
+{
+    int i, j;
+
+    num_measurements = 20;
+    step_duration = 2;
+    audio_rate = 44100;
+
+    if (argc <= 1)
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'a': // sequencer address
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        seq_address = argv[i];
+                    }
+                    break;
+                case 'U': // ingress socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        socket_path = argv[i];
+                    }
+                    break;
+                case 'c': // capture device
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        capture_device = argv[i];
+                    }
+                    break;
+                case 'w': // output file
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        watch_filepath = argv[i];
+                    }
+                    break;
+                case 'r': // rate
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 8000 && j <= 192000)
+                        {
+                            audio_rate = j;
+                        }
+                    }
+                    break;
+                case 'n': // number of measurements
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= MAX_MEASUREMENTS)
+                        {
+                            num_measurements = j;
+                        }
+                    }
+                    break;
+                case 'S': // statistics socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        stats_socket_path = argv[i];
+                    }
+                    break;
+                case 't': // step duration
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= 60)
+                        {
+                            step_duration = j;
+                        }
+                    }
+                    break;
+                case 'h':
+                default:
+                    usage(argv[0]);
+                    break;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if ((capture_device != NULL) && (watch_filepath != NULL))
+    {
+        fprintf(stderr, "Either capture device or output file can be selected\n");
+        exit(1);
+    }
+
+    if ((capture_device == NULL) && (watch_filepath == NULL) && (stats_socket_path == NULL))
+    {
+        fprintf(stderr, "Capture device, output file or statistics socket must be selected\n");
+        exit(1);
+    }
+}
+
+static void sleep_us(int64_t time)
+{
+    struct timespec req;
+
+    if (time <= 0) return;
+
+    req.tv_sec = time / 1000000;
+    req.tv_nsec = (time % 1000000) * 1000;
+    nanosleep(&req, NULL);
+}
+
+static int open_output(void)
+{
+    struct sockaddr_un addr;
+    snd_seq_addr_t dest;
+    int err;
+
+    if (socket_path != NULL)
+    {
+        if (strlen(socket_path) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Ingress socket path is too long: %s\n", socket_path);
+            return -1;
+        }
+
+        client_socket = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (client_socket < 0)
+        {
+            fprintf(stderr, "Error creating socket\n");
+            return -2;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        if (connect(client_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(client_socket);
+            client_socket = -1;
+            fprintf(stderr, "Error connecting to ingress socket: %s\n", socket_path);
+            return -3;
+        }
+
+        return 0;
+    }
+
+    err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_OUTPUT, 0);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error opening ALSA sequencer: %i\n%s\n", err, snd_strerror(err));
+        return -4;
+    }
+
+    snd_seq_set_client_name(seq, "SW-10 latency");
+
+    seq_port = snd_seq_create_simple_port(seq, "SW-10 latency port", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    if (seq_port < 0)
+    {
+        fprintf(stderr, "Error creating sequencer port: %i\n%s\n", seq_port, snd_strerror(seq_port));
+        return -5;
+    }
+
+    err = snd_seq_parse_address(seq, &dest, seq_address);
+    if (err < 0)
+    {
+        fprintf(stderr, "Invalid sequencer address: %s\n", seq_address);
+        return -6;
+    }
+
+    err = snd_seq_connect_to(seq, seq_port, dest.client, dest.port);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error connecting to sequencer port: %s\n", seq_address);
+        return -7;
+    }
+
+    return 0;
+}
+
+static void close_output(void)
+{
+    if (client_socket >= 0)
+    {
+        close(client_socket);
+        client_socket = -1;
+    }
+
+    if (seq != NULL)
+    {
+        snd_seq_close(seq);
+        seq = NULL;
+    }
+}
+
+static int flush_messages(void)
+{
+    int err;
+
+    if (client_socket >= 0)
+    {
+        // all records are sent in one packet
+        if ((packet_length != 0) && (send(client_socket, packet, packet_length, 0) != (ssize_t)packet_length))
+        {
+            fprintf(stderr, "Error sending data to ingress socket\n");
+            return -1;
+        }
+
+        packet_length = 0;
+        return 0;
+    }
+
+    err = snd_seq_drain_output(seq);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error sending sequencer events: %i\n", err);
+        return -2;
+    }
+
+    return 0;
+}
+
+// sends channel message (note on, note off or control change), the message is buffered until flush_messages
+static int send_message(uint8_t status, uint8_t data1, uint8_t data2)
+{
+    snd_seq_event_t event;
+    sw10_ingress_header header;
+    int err;
+
+    if (client_socket >= 0)
+    {
+        if (packet_length + sizeof(header) + 3 > sizeof(packet))
+        {
+            if (flush_messages() < 0) return -1;
+        }
+
+        // time 0 = now
+        header.time = 0;
+        header.port = 0;
+        header.length = 3;
+        header.reserved = 0;
+
+        memcpy(packet + packet_length, &header, sizeof(header));
+        packet[packet_length + sizeof(header)] = status;
+        packet[packet_length + sizeof(header) + 1] = data1;
+        packet[packet_length + sizeof(header) + 2] = data2;
+        packet_length += sizeof(header) + 3;
+
+        return 0;
+    }
+
+    snd_seq_ev_clear(&event);
+    snd_seq_ev_set_source(&event, seq_port);
+    snd_seq_ev_set_subs(&event);
+    snd_seq_ev_set_direct(&event);
+
+    switch (status & 0xF0)
+    {
+        case 0x90:
+            snd_seq_ev_set_noteon(&event, status & 0x0F, data1, data2);
+            break;
+        case 0x80:
+            snd_seq_ev_set_noteoff(&event, status & 0x0F, data1, data2);
+            break;
+        default:
+            snd_seq_ev_set_controller(&event, status & 0x0F, data1, data2);
+            break;
+    }
+
+    // output buffer is drained when it's full, so this blocks when the daemon doesn't read the events
+    err = snd_seq_event_output(seq, &event);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error sending sequencer event: %i\n", err);
+        return -2;
+    }
+
+    return 0;
+}
+
+static int open_audio(void)
+{
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_uframes_t buffer_size, period_size;
+    uint8_t header[44];
+    off_t position;
+    int err;
+
+    if (watch_filepath != NULL)
+    {
+        watch_fd = open(watch_filepath, O_RDONLY);
+        if (watch_fd < 0)
+        {
+            fprintf(stderr, "Error opening output file: %s\n", watch_filepath);
+            return -1;
+        }
+
+        // rate of wav file is in the header
+        if ((read(watch_fd, header, 44) == 44) && (memcmp(header, "RIFF", 4) == 0) && (memcmp(header + 8, "WAVE", 4) == 0))
+        {
+            audio_rate = header[24] | (header[25] << 8) | (header[26] << 16) | (header[27] << 24);
+        }
+
+        // only new data is watched (header length is multiple of frame size)
+        position = lseek(watch_fd, 0, SEEK_END);
+        if (position < 0)
+        {
+            fprintf(stderr, "Error reading output file: %s\n", watch_filepath);
+            return -2;
+        }
+        lseek(watch_fd, position & ~(off_t)3, SEEK_SET);
+
+        return 0;
+    }
+
+    err = snd_pcm_open(&capture_pcm, capture_device, SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0)
+    {
+        capture_pcm = NULL;
+        fprintf(stderr, "Error opening capture device: %s\n%s\n", capture_device, snd_strerror(err));
+        return -3;
+    }
+
+    snd_pcm_hw_params_alloca(&hw_params);
+
+    // short periods for precise time of the captured frames
+    buffer_size = 8192;
+    period_size = 256;
+    if ((snd_pcm_hw_params_any(capture_pcm, hw_params) < 0) ||
+        (snd_pcm_hw_params_set_access(capture_pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) ||
+        (snd_pcm_hw_params_set_format(capture_pcm, hw_params, SND_PCM_FORMAT_S16) < 0) ||
+        (snd_pcm_hw_params_set_channels(capture_pcm, hw_params, 2) < 0) ||
+        (snd_pcm_hw_params_set_rate_near(capture_pcm, hw_params, &audio_rate, NULL) < 0) ||
+        (snd_pcm_hw_params_set_buffer_size_near(capture_pcm, hw_params, &buffer_size) < 0) ||
+        (snd_pcm_hw_params_set_period_size_near(capture_pcm, hw_params, &period_size, NULL) < 0) ||
+        (snd_pcm_hw_params(capture_pcm, hw_params) < 0))
+    {
+        fprintf(stderr, "Error setting capture parameters\n");
+        return -4;
+    }
+
+    err = snd_pcm_start(capture_pcm);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error starting capture: %s\n", snd_strerror(err));
+        return -5;
+    }
+
+    return 0;
+}
+
+static void close_audio(void)
+{
+    if (capture_pcm != NULL)
+    {
+        snd_pcm_close(capture_pcm);
+        capture_pcm = NULL;
+    }
+
+    if (watch_fd >= 0)
+    {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+}
+
+// reads audio into audio_buffer, returns number of frames and the time when the last frame was played
+static int read_audio(int64_t *last_time)
+{
+    snd_pcm_sframes_t frames, delay;
+    ssize_t length;
+    int retry;
+    static unsigned int partial_length;
+    static uint8_t partial_frame[4];
+
+    if (watch_fd >= 0)
+    {
+        memcpy(audio_buffer, partial_frame, partial_length);
+        for (retry = 0; retry < 10; retry++)
+        {
+            length = read(watch_fd, (uint8_t *)audio_buffer + partial_length, sizeof(audio_buffer) - partial_length);
+            if (length < 0)
+            {
+                fprintf(stderr, "Error reading output file\n");
+                return -1;
+            }
+
+            if (length != 0) break;
+
+            // the daemon writes the file in real time
+            sleep_us(1000);
+        }
+
+        // the file doesn't grow when the daemon suspended the silent output
+        *last_time = sw10_ingress_time_now();
+        if (length == 0) return 0;
+
+        // the file can be read in the middle of a frame
+        length += partial_length;
+        frames = length >> 2;
+        partial_length = length & 3;
+        memcpy(partial_frame, (uint8_t *)audio_buffer + (frames << 2), partial_length);
+
+        return frames;
+    }
+
+    frames = snd_pcm_readi(capture_pcm, audio_buffer, AUDIO_FRAMES);
+    if (frames < 0)
+    {
+        frames = snd_pcm_recover(capture_pcm, frames, 1);
+        if (frames < 0)
+        {
+            fprintf(stderr, "Error reading captured audio: %s\n", snd_strerror(frames));
+            return -2;
+        }
+
+        return 0;
+    }
+
+    // captured frames which weren't read yet are newer than the last read frame
+    *last_time = sw10_ingress_time_now();
+    if ((snd_pcm_delay(capture_pcm, &delay) == 0) && (delay > 0))
+    {
+        *last_time -= ((int64_t)delay * 1000000) / audio_rate;
+    }
+
+    return frames;
+}
+
+static int wait_for_silence(void)
+{
+    int64_t start_time, silence_start, last_time;
+    int frames, index;
+
+    start_time = sw10_ingress_time_now();
+    silence_start = start_time;
+
+    while (1)
+    {
+        frames = read_audio(&last_time);
+        if (frames < 0) return -1;
+
+        for (index = 0; index < 2 * frames; index++)
+        {
+            if ((audio_buffer[index] > ONSET_THRESHOLD) || (audio_buffer[index] < -ONSET_THRESHOLD))
+            {
+                silence_start = last_time;
+                break;
+            }
+        }
+
+        if (last_time - silence_start >= SILENCE_TIME) return 0;
+
+        if (last_time - start_time > 10 * SILENCE_TIME)
+        {
+            fprintf(stderr, "Output isn't silent\n");
+            return -2;
+        }
+    };
+}
+
+// returns time of the first loud frame or 0 on timeout
+static int64_t wait_for_onset(int64_t send_time)
+{
+    int64_t last_time;
+    int frames, index;
+
+    while (1)
+    {
+        frames = read_audio(&last_time);
+        if (frames < 0) return -1;
+
+        for (index = 0; index < 2 * frames; index++)
+        {
+            if ((audio_buffer[index] > ONSET_THRESHOLD) || (audio_buffer[index] < -ONSET_THRESHOLD))
+            {
+                return last_time - ((int64_t)(frames - 1 - index / 2) * 1000000) / audio_rate;
+            }
+        }
+
+        if (last_time - send_time > ONSET_TIMEOUT) return 0;
+    };
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    int64_t value1, value2;
+
+    value1 = *(const int64_t *)a;
+    value2 = *(const int64_t *)b;
+
+    return (value1 < value2) ? -1 : ((value1 > value2) ? 1 : 0);
+}
+
+static int measure_latency(void)
+{
+    static const int percentiles[5] = { 0, 50, 90, 99, 100 };
+    int64_t send_time, onset_time;
+    int index, count, lost;
+
+    printf("Latency test: %i measurements, audio rate %u Hz\n", num_measurements, audio_rate);
+
+    count = 0;
+    lost = 0;
+    for (index = 0; index < num_measurements; index++)
+    {
+        if (wait_for_silence() < 0) return -1;
+
+        // notes are sent at random position in the rendered blocks
+        sleep_us(rand() % 25000);
+
+        if ((send_message(0x90, 60, 127) < 0) || (flush_messages() < 0)) return -2;
+        send_time = sw10_ingress_time_now();
+
+        onset_time = wait_for_onset(send_time);
+
+        if ((send_message(0x80, 60, 0) < 0) || (flush_messages() < 0)) return -2;
+
+        if (onset_time < 0) return -3;
+        if (onset_time == 0)
+        {
+            lost++;
+            continue;
+        }
+
+        latencies[count] = onset_time - send_time;
+        count++;
+    }
+
+    if (lost != 0)
+    {
+        printf("Notes without sound: %i\n", lost);
+    }
+
+    if (count == 0) return 0;
+
+    qsort(latencies, count, sizeof(int64_t), compare_latencies);
+
+    printf("Latency:");
+    for (index = 0; index < 5; index++)
+    {
+        printf("%s p%i %.1f ms", (index != 0) ? "," : "", percentiles[index], latencies[((count - 1) * percentiles[index]) / 100] / 1000.0);
+    }
+    printf("\n");
+
+    return 0;
+}
+
+static int read_stats(daemon_stats *stats)
+{
+    struct sockaddr_un addr;
+    char text[8192], *line;
+    unsigned int length, value;
+    ssize_t received;
+    int stats_fd, synth_index;
+
+    if (strlen(stats_socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Statistics socket path is too long: %s\n", stats_socket_path);
+        return -1;
+    }
+
+    stats_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (stats_fd < 0)
+    {
+        fprintf(stderr, "Error creating socket\n");
+        return -2;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, stats_socket_path);
+
+    if (connect(stats_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(stats_fd);
+        fprintf(stderr, "Error connecting to statistics socket: %s\n", stats_socket_path);
+        return -3;
+    }
+
+    // every connection gets one snapshot of the statistics
+    length = 0;
+    while (length < sizeof(text) - 1)
+    {
+        received = read(stats_fd, text + length, sizeof(text) - 1 - length);
+        if (received <= 0) break;
+        length += received;
+    };
+    close(stats_fd);
+    text[length] = 0;
+
+    memset(stats, 0, sizeof(daemon_stats));
+    for (line = text; line != NULL; line = strchr(line, '\n'))
+    {
+        if (*line == '\n') line++;
+
+        if (sscanf(line, "MIDI events: %u", &value) == 1) stats->midi_events = value;
+        else if (sscanf(line, "Ingress records: %u", &value) == 1) stats->ingress_records = value;
+        else if (sscanf(line, "Buffer underruns: %lu", &(stats->underruns)) == 1) {}
+        else if (sscanf(line, "Synthesizer %i: events %u", &synth_index, &value) == 2) stats->synth_events += value;
+    }
+
+    return 0;
+}
+
+static int send_burst(unsigned int rate, unsigned int *sent, int64_t *duration)
+{
+    int64_t start_time, current_time;
+    unsigned int count, due;
+    uint8_t channel, note;
+
+    count = 0;
+    start_time = sw10_ingress_time_now();
+    current_time = start_time;
+
+    while (current_time - start_time < (int64_t)step_duration * 1000000)
+    {
+        // notes with control changes on all channels (notes are released, so the polyphony doesn't limit the test)
+        due = ((current_time - start_time) * rate) / 1000000;
+        for (; count < due; count++)
+        {
+            channel = (count >> 2) & 0x0F;
+            note = 36 + ((count >> 6) % 60);
+
+            switch (count & 3)
+            {
+                case 0:
+                    if (send_message(0x90 | channel, note, 100) < 0) return -1;
+                    break;
+                case 1:
+                    if (send_message(0xB0 | channel, 1, count & 0x7F) < 0) return -1;
+                    break;
+                case 2:
+                    if (send_message(0x80 | channel, note, 0) < 0) return -1;
+                    break;
+                default:
+                    if (send_message(0xB0 | channel, 11, 127 - (count & 0x3F)) < 0) return -1;
+                    break;
+            }
+        }
+
+        if (flush_messages() < 0) return -1;
+
+        sleep_us(1000);
+        current_time = sw10_ingress_time_now();
+    };
+
+    *sent = count;
+    *duration = current_time - start_time;
+    return 0;
+}
+
+static int measure_throughput(void)
+{
+    daemon_stats before, after;
+    unsigned int rate, good_rate, failed_rate, sent, received, processed;
+    unsigned long underruns;
+    int64_t duration;
+    int step, passed;
+
+    printf("Throughput test: %i s per step\n", step_duration);
+
+    rate = 1000;
+    good_rate = 0;
+    failed_rate = 0;
+    for (step = 0; step < MAX_STEPS; step++)
+    {
+        if (read_stats(&before) < 0) return -1;
+        if (send_burst(rate, &sent, &duration) < 0) return -2;
+
+        // events are played after the synthesizer delay
+        sleep_us(500000);
+        if (read_stats(&after) < 0) return -1;
+
+        received = (client_socket >= 0) ? (after.ingress_records - before.ingress_records) : (after.midi_events - before.midi_events);
+        processed = after.synth_events - before.synth_events;
+        underruns = after.underruns - before.underruns;
+
+        // the rate is sustained when all events were sent in time, all events were processed and the output didn't underrun
+        passed = ((uint64_t)sent * 1000000 >= (uint64_t)rate * duration * 95 / 100) && (received >= sent) && (processed >= sent) && (underruns == 0);
+
+        printf("Rate %u events/s: sent %u, received %u, processed %u, underruns %lu - %s\n", rate, sent, received, processed, underruns, passed ? "ok" : "failed");
+
+        if (passed)
+        {
+            good_rate = rate;
+        }
+        else
+        {
+            failed_rate = rate;
+        }
+
+        // double the rate until it fails, then bisect
+        if (failed_rate == 0)
+        {
+            rate *= 2;
+        }
+        else
+        {
+            if (failed_rate - good_rate <= failed_rate / 16) break;
+            rate = (good_rate + failed_rate) / 2;
+        }
+    }
+
+    if (good_rate == 0)
+    {
+        printf("Maximum sustainable rate: below %u events/s\n", failed_rate);
+    }
+    else
+    {
+        printf("Maximum sustainable rate: %u events/s\n", good_rate);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int result;
+
+    read_arguments(argc, argv);
+
+    srand(time(NULL));
+
+    if (open_output() < 0)
+    {
+        close_output();
+        return 2;
+    }
+
+    result = 0;
+    if ((capture_device != NULL) || (watch_filepath != NULL))
+    {
+        if (open_audio() < 0)
+        {
+            close_audio();
+            close_output();
+            return 3;
+        }
+
+        if (measure_latency() < 0)
+        {
+            result = 4;
+        }
+
+        close_audio();
+    }
+
+    if ((result == 0) && (stats_socket_path != NULL))
+    {
+        if (measure_throughput() < 0)
+        {
+            result = 5;
+        }
+    }
+
+    close_output();
+
+    return result;
+}
@@ -0,0 +1,337 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sw10_ingress.h"
+
+
+static const char *socket_path;
+static const char *ring_name;
+static int port, delay;
+static uint8_t message[2048];
+static unsigned int message_length;
+
+static int client_socket = -1;
+static sw10_ingress_ring *ring;
+static uint8_t packet[SW10_INGRESS_MAX_PACKET];
+static unsigned int packet_length;
+
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "sw10_midiclient";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - send MIDI data to sw10_alsadrv\n"
+        "Usage: %s [OPTIONS]... [BYTE]...\n"
+        "  -U PATH  Ingress socket of sw10_alsadrv\n"
+        "  -M NAME  Ingress shared memory ring of sw10_alsadrv\n"
+        "  -p NUM   Port number (0 = first port)\n"
+        "  -d NUM   Play the data NUM milliseconds in future (0 - 10000)\n"
+        "  -h       Help\n"
+        "BYTE is a hexadecimal byte of one complete MIDI message (e.g. 90 3C 64)\n"
+        "Without MIDI message a C major scale is sent at once, timestamped to play 250 ms per note\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+static void read_arguments(int argc, char *argv[])
+{
+    int i, j;
+    char *endptr;
+    unsigned long value;
+
+    socket_path = NULL;
+    ring_name = NULL;
+    port = 0;
+    delay = 0;
+    message_length = 0;
+
+    if (argc <= 1)
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'U': // ingress socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        socket_path = argv[i];
+                    }
+                    break;
+                case 'M': // ingress ring
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        ring_name = argv[i];
+                    }
+                    break;
+                case 'p': // port
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 65535)
+                        {
+                            port = j;
+                        }
+                    }
+                    break;
+                case 'd': // delay
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 10000)
+                        {
+                            delay = j;
+                        }
+                    }
+                    break;
+                case 'h':
+                default:
+                    usage(argv[0]);
+                    break;
+            }
+        }
+        else
+        {
+            value = strtoul(argv[i], &endptr, 16);
+            if ((*endptr != 0) || (value > 255) || (message_length >= sizeof(message)))
+            {
+                fprintf(stderr, "Invalid MIDI byte: %s\n", argv[i]);
+                exit(1);
+            }
+
+            message[message_length] = value;
+            message_length++;
+        }
+    }
+
+    if ((socket_path == NULL) == (ring_name == NULL))
+    {
+        fprintf(stderr, "Either ingress socket or ingress ring must be selected\n");
+        exit(1);
+    }
+}
+
+static int open_ingress(void)
+{
+    struct sockaddr_un addr;
+    int ring_fd;
+
+    if (socket_path != NULL)
+    {
+        if (strlen(socket_path) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Ingress socket path is too long: %s\n", socket_path);
+            return -1;
+        }
+
+        client_socket = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (client_socket < 0)
+        {
+            fprintf(stderr, "Error creating socket\n");
+            return -2;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        if (connect(client_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(client_socket);
+            client_socket = -1;
+            fprintf(stderr, "Error connecting to ingress socket: %s\n", socket_path);
+            return -3;
+        }
+
+        return 0;
+    }
+
+    ring_fd = shm_open(ring_name, O_RDWR, 0);
+    if (ring_fd < 0)
+    {
+        fprintf(stderr, "Error opening ingress ring: %s\n", ring_name);
+        return -4;
+    }
+
+    ring = (sw10_ingress_ring *) mmap(NULL, sizeof(sw10_ingress_ring), PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    close(ring_fd);
+
+    if (ring == MAP_FAILED)
+    {
+        ring = NULL;
+        fprintf(stderr, "Error mapping ingress ring: %s\n", ring_name);
+        return -5;
+    }
+
+    if ((__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SW10_INGRESS_MAGIC) || (ring->size != SW10_INGRESS_RING_SIZE))
+    {
+        fprintf(stderr, "Invalid ingress ring: %s\n", ring_name);
+        return -6;
+    }
+
+    return 0;
+}
+
+static int add_record(uint64_t time, const uint8_t *data, uint16_t length)
+{
+    sw10_ingress_header header;
+
+    if (ring != NULL)
+    {
+        // ring can be full when the daemon isn't running
+        if (sw10_ingress_ring_write(ring, time, port, data, length) < 0)
+        {
+            fprintf(stderr, "Ingress ring is full\n");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (packet_length + sizeof(header) + length > sizeof(packet))
+    {
+        fprintf(stderr, "Packet is too long\n");
+        return -2;
+    }
+
+    header.time = time;
+    header.port = port;
+    header.length = length;
+    header.reserved = 0;
+
+    memcpy(packet + packet_length, &header, sizeof(header));
+    memcpy(packet + packet_length + sizeof(header), data, length);
+    packet_length += sizeof(header) + length;
+
+    return 0;
+}
+
+static int send_records(void)
+{
+    // all records are sent in one packet
+    if ((client_socket >= 0) && (packet_length != 0))
+    {
+        if (send(client_socket, packet, packet_length, 0) != (ssize_t)packet_length)
+        {
+            fprintf(stderr, "Error sending data to ingress socket\n");
+            return -1;
+        }
+    }
+
+    packet_length = 0;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint8_t scale[8] = { 60, 62, 64, 65, 67, 69, 71, 72 };
+    uint64_t start_time;
+    uint8_t note[3];
+    int index;
+
+    read_arguments(argc, argv);
+
+    if (open_ingress() < 0)
+    {
+        return 2;
+    }
+
+    start_time = sw10_ingress_time_now() + (uint64_t)delay * 1000;
+
+    if (message_length != 0)
+    {
+        if (add_record((delay != 0) ? start_time : 0, message, message_length) < 0)
+        {
+            return 3;
+        }
+    }
+    else
+    {
+        for (index = 0; index < 8; index++)
+        {
+            note[0] = 0x90;
+            note[1] = scale[index];
+            note[2] = 100;
+            if (add_record(start_time + index * 250000, note, 3) < 0)
+            {
+                return 3;
+            }
+
+            note[2] = 0;
+            if (add_record(start_time + index * 250000 + 240000, note, 3) < 0)
+            {
+                return 3;
+            }
+        }
+    }
+
+    if (send_records() < 0)
+    {
+        return 4;
+    }
+
+    if (client_socket >= 0)
+    {
+        close(client_socket);
+    }
+
+    return 0;
+}
@@ -0,0 +1,294 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sw10_resampler.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MAX_PHASES 1024
+#define COEFFICIENT_BITS 14
+
+
+struct sw10_resampler
+{
+    unsigned int taps;              // filter length (multiple of 8)
+    unsigned int phase_step;        // input rate / gcd
+    unsigned int phase_count;       // output rate / gcd
+    unsigned int table_phases;      // number of precomputed phases
+    unsigned int phase;             // output position between two input frames (0 - phase_count-1)
+    unsigned int position;          // input frame at the start of the filter
+    unsigned int length;            // number of frames in the history buffers
+    unsigned int max_input_frames;
+    int16_t *coefficients;
+    int16_t *left;
+    int16_t *right;
+};
+
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    unsigned int c;
+
+    while (b != 0)
+    {
+        c = a % b;
+        a = b;
+        b = c;
+    };
+
+    return a;
+}
+
+// modified Bessel function of the first kind (order 0)
+static double bessel_i0(double x)
+{
+    double sum, term;
+    int k;
+
+    sum = 1.0;
+    term = 1.0;
+    for (k = 1; k < 50; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+
+    return sum;
+}
+
+static void compute_phase(int16_t *coefficients, unsigned int taps, double offset, double cutoff, double beta)
+{
+    double values[128], sum, t, x;
+    unsigned int index;
+    int total, center;
+
+    sum = 0;
+    for (index = 0; index < taps; index++)
+    {
+        // distance of the input frame from the output position (in input frames)
+        t = (double)index - (double)(taps / 2 - 1) - offset;
+        x = t / (taps / 2);
+
+        values[index] = (fabs(t) < 1e-9) ? cutoff : sin(M_PI * cutoff * t) / (M_PI * t);
+        values[index] *= (fabs(x) < 1.0) ? (bessel_i0(beta * sqrt(1.0 - x * x)) / bessel_i0(beta)) : 0.0;
+        sum += values[index];
+    }
+
+    // normalize the gain of every phase to 1.0
+    total = 0;
+    for (index = 0; index < taps; index++)
+    {
+        coefficients[index] = (int16_t)lrint(values[index] * (1 << COEFFICIENT_BITS) / sum);
+        total += coefficients[index];
+    }
+
+    center = (offset < 0.5) ? (taps / 2 - 1) : (taps / 2);
+    coefficients[center] += (1 << COEFFICIENT_BITS) - total;
+}
+
+sw10_resampler *sw10_resampler_create(unsigned int input_rate, unsigned int output_rate, int quality, unsigned int max_input_frames)
+{
+    static const unsigned int quality_taps[3] = { 16, 32, 64 };
+    static const double quality_beta[3] = { 6.0, 8.0, 10.0 };
+    static const double quality_rolloff[3] = { 0.85, 0.91, 0.95 };
+    sw10_resampler *resampler;
+    unsigned int divisor, index;
+    double cutoff;
+
+    if ((input_rate == 0) || (output_rate == 0) || (max_input_frames == 0))
+    {
+        return NULL;
+    }
+
+    if (quality < SW10_RESAMPLER_QUALITY_LOW) quality = SW10_RESAMPLER_QUALITY_LOW;
+    else if (quality > SW10_RESAMPLER_QUALITY_HIGH) quality = SW10_RESAMPLER_QUALITY_HIGH;
+
+    resampler = (sw10_resampler *) calloc(1, sizeof(sw10_resampler));
+    if (resampler == NULL)
+    {
+        return NULL;
+    }
+
+    divisor = gcd(input_rate, output_rate);
+    resampler->taps = quality_taps[quality - 1];
+    resampler->phase_step = input_rate / divisor;
+    resampler->phase_count = output_rate / divisor;
+    resampler->table_phases = (resampler->phase_count < MAX_PHASES) ? resampler->phase_count : MAX_PHASES;
+    resampler->max_input_frames = max_input_frames;
+
+    resampler->coefficients = (int16_t *) malloc(resampler->table_phases * resampler->taps * sizeof(int16_t));
+    resampler->left = (int16_t *) calloc(resampler->taps + max_input_frames, sizeof(int16_t));
+    resampler->right = (int16_t *) calloc(resampler->taps + max_input_frames, sizeof(int16_t));
+    if ((resampler->coefficients == NULL) || (resampler->left == NULL) || (resampler->right == NULL))
+    {
+        sw10_resampler_destroy(resampler);
+        return NULL;
+    }
+
+    // when downsampling, the cutoff frequency is below the output nyquist frequency
+    cutoff = quality_rolloff[quality - 1];
+    if (output_rate < input_rate)
+    {
+        cutoff = (cutoff * output_rate) / input_rate;
+    }
+
+    for (index = 0; index < resampler->table_phases; index++)
+    {
+        compute_phase(&(resampler->coefficients[index * resampler->taps]), resampler->taps, (double)index / resampler->table_phases, cutoff, quality_beta[quality - 1]);
+    }
+
+    // history starts with silence
+    resampler->length = resampler->taps - 1;
+
+    return resampler;
+}
+
+void sw10_resampler_destroy(sw10_resampler *resampler)
+{
+    if (resampler == NULL)
+    {
+        return;
+    }
+
+    free(resampler->coefficients);
+    free(resampler->left);
+    free(resampler->right);
+    free(resampler);
+}
+
+unsigned int sw10_resampler_max_output(const sw10_resampler *resampler, unsigned int input_frames)
+{
+    return (unsigned int)((((uint64_t)input_frames + 1) * resampler->phase_count) / resampler->phase_step) + 1;
+}
+
+static inline int32_t dot_product(const int16_t *coefficients, const int16_t *samples, unsigned int taps)
+{
+    unsigned int index;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t sum4;
+    int32x2_t sum2;
+    int16x8_t coefficient8, sample8;
+
+    sum4 = vdupq_n_s32(0);
+    for (index = 0; index < taps; index += 8)
+    {
+        coefficient8 = vld1q_s16(coefficients + index);
+        sample8 = vld1q_s16(samples + index);
+        sum4 = vmlal_s16(sum4, vget_low_s16(coefficient8), vget_low_s16(sample8));
+        sum4 = vmlal_s16(sum4, vget_high_s16(coefficient8), vget_high_s16(sample8));
+    }
+
+    sum2 = vadd_s32(vget_low_s32(sum4), vget_high_s32(sum4));
+    return vget_lane_s32(vpadd_s32(sum2, sum2), 0);
+#elif defined(__SSE2__)
+    __m128i sum4;
+
+    sum4 = _mm_setzero_si128();
+    for (index = 0; index < taps; index += 8)
+    {
+        sum4 = _mm_add_epi32(sum4, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(coefficients + index)), _mm_loadu_si128((const __m128i *)(samples + index))));
+    }
+
+    sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0x4E));
+    sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, 0xB1));
+    return _mm_cvtsi128_si32(sum4);
+#else
+    int32_t sum;
+
+    sum = 0;
+    for (index = 0; index < taps; index++)
+    {
+        sum += coefficients[index] * samples[index];
+    }
+
+    return sum;
+#endif
+}
+
+static inline int16_t clip_sample(int32_t value)
+{
+    value = (value + (1 << (COEFFICIENT_BITS - 1))) >> COEFFICIENT_BITS;
+
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return value;
+}
+
+unsigned int sw10_resampler_process(sw10_resampler *resampler, const int16_t *input, unsigned int input_frames, int16_t *output)
+{
+    unsigned int index, output_frames, remaining;
+    const int16_t *coefficients;
+
+    if (input_frames > resampler->max_input_frames)
+    {
+        input_frames = resampler->max_input_frames;
+    }
+
+    // deinterleave the input behind the history
+    for (index = 0; index < input_frames; index++)
+    {
+        resampler->left[resampler->length + index] = input[2 * index];
+        resampler->right[resampler->length + index] = input[2 * index + 1];
+    }
+    resampler->length += input_frames;
+
+    output_frames = 0;
+    while (resampler->position + resampler->taps <= resampler->length)
+    {
+        if (resampler->table_phases == resampler->phase_count)
+        {
+            coefficients = &(resampler->coefficients[resampler->phase * resampler->taps]);
+        }
+        else
+        {
+            coefficients = &(resampler->coefficients[((resampler->phase * (uint64_t)resampler->table_phases) / resampler->phase_count) * resampler->taps]);
+        }
+
+        output[2 * output_frames] = clip_sample(dot_product(coefficients, resampler->left + resampler->position, resampler->taps));
+        output[2 * output_frames + 1] = clip_sample(dot_product(coefficients, resampler->right + resampler->position, resampler->taps));
+        output_frames++;
+
+        resampler->phase += resampler->phase_step;
+        resampler->position += resampler->phase / resampler->phase_count;
+        resampler->phase %= resampler->phase_count;
+    };
+
+    // keep the frames which are still needed by the filter
+    remaining = (resampler->position < resampler->length) ? (resampler->length - resampler->position) : 0;
+    memmove(resampler->left, resampler->left + resampler->length - remaining, remaining * sizeof(int16_t));
+    memmove(resampler->right, resampler->right + resampler->length - remaining, remaining * sizeof(int16_t));
+    resampler->position -= resampler->length - remaining;
+    resampler->length = remaining;
+
+    return output_frames;
+}
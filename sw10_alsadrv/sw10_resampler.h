@@ -0,0 +1,52 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_SW10_RESAMPLER_H_INCLUDED_)
+#define _SW10_RESAMPLER_H_INCLUDED_
+
+// Polyphase resampler for 16-bit stereo audio
+//
+// The filter is a Kaiser windowed sinc with fixed-point (Q14) coefficients. The conversion ratio is exact
+// (output position is kept as a fraction of the rates), one filter phase is precomputed for every output
+// position up to 1024 phases - with more phases the nearest precomputed phase is used.
+
+#include <stdint.h>
+
+#define SW10_RESAMPLER_QUALITY_LOW 1
+#define SW10_RESAMPLER_QUALITY_MEDIUM 2
+#define SW10_RESAMPLER_QUALITY_HIGH 3
+
+typedef struct sw10_resampler sw10_resampler;
+
+// returns NULL on error, at most max_input_frames frames can be processed in one call
+sw10_resampler *sw10_resampler_create(unsigned int input_rate, unsigned int output_rate, int quality, unsigned int max_input_frames);
+void sw10_resampler_destroy(sw10_resampler *resampler);
+
+// maximal number of output frames for the given number of input frames
+unsigned int sw10_resampler_max_output(const sw10_resampler *resampler, unsigned int input_frames);
+
+// returns number of output frames written to the output buffer
+unsigned int sw10_resampler_process(sw10_resampler *resampler, const int16_t *input, unsigned int input_frames, int16_t *output);
+
+#endif
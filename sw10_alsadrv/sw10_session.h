@@ -0,0 +1,92 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_SW10_SESSION_H_INCLUDED_)
+#define _SW10_SESSION_H_INCLUDED_
+
+// Session log of sw10_alsadrv
+//
+// The log contains everything which is needed to repeat the synthesizer output: the configuration,
+// the MIDI data written to the synthesizers (in the format of VLSG_AddMidiData - 4 bytes time + 1 byte data),
+// the values returned by the GetTime function and the boundaries of the rendered blocks.
+//
+// The log starts with the header followed by records - a record header followed by the record data.
+// Values are stored in the native byte order (little-endian on supported platforms). Records of a block are written between the BLOCK and BLOCK_END records,
+// MIDI records inside a block were written while the block was rendered, so they belong after the block.
+// Recording stops when the synthesizers are reconfigured or when the log can't be written fast enough.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SW10_SESSION_MAGIC "SW10SES1"
+#define SW10_SESSION_VERSION 2
+
+#define SW10_SESSION_MIDI 1         // MIDI data (multiple of 5 bytes)
+#define SW10_SESSION_TIME 2         // uint32 value returned by the GetTime function
+#define SW10_SESSION_BLOCK 3        // uint32 output buffer counter
+#define SW10_SESSION_BLOCK_END 4    // uint32 output buffer counter, uint32 render time (in microseconds), uint32 checksum of the block
+#define SW10_SESSION_END 5          // uint32 reason
+
+#define SW10_SESSION_END_EXIT 0
+#define SW10_SESSION_END_RECONFIGURED 1
+#define SW10_SESSION_END_OVERFLOW 2
+
+#define SW10_SESSION_MAX_RECORD 65530
+#define SW10_SESSION_CHECKSUM_INIT 2166136261u
+
+typedef struct
+{
+    uint8_t magic[8];
+    uint32_t version;
+    uint32_t frequency;     // 0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz
+    uint32_t polyphony;     // 0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices
+    uint32_t reverb_effect; // 0 = off, 1 = reverb 1, 2 = reverb 2
+    uint32_t sub_blocks;    // number of sub-blocks in one block
+    uint32_t num_synths;    // number of synthesizers, outputs of all synthesizers are mixed into one block
+    uint32_t rom_checksum;  // checksum of the ROM file
+    uint32_t event_delay;   // delay of MIDI events in milliseconds (version 1 = reserved, delay is 100 ms)
+} sw10_session_header;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t synth;      // synthesizer index (MIDI and TIME records)
+    uint16_t length;    // length of data following the record header
+} sw10_session_record;
+
+
+// FNV-1a hash, used for the ROM and block checksums
+static inline uint32_t sw10_session_checksum(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *ptr;
+
+    for (ptr = (const uint8_t *)data; length != 0; length--, ptr++)
+    {
+        hash = (hash ^ *ptr) * 16777619;
+    }
+
+    return hash;
+}
+
+#endif
@@ -27,6 +27,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "midi_loader.h"
 
 
@@ -51,31 +60,141 @@
 #define MIDI_STATUS_SYSEX       0x0F
 
 
+typedef struct {
+    uint8_t data[8];
+    uint32_t len;
+    const uint8_t *sysex;   // rest of long sysex events (in the MIDI data), the first byte is in data
+    uint32_t time;
+} midi_event_info;
+
 typedef struct {
     const uint8_t *ptr;
-    unsigned int len, delta;
+    unsigned int len;
     uint8_t prev_event, pad[3];
     int eot;
+    uint64_t tick;
 } midi_track_info;
 
+// Event file header, it's followed by the event stream (values are stored in native byte order)
+#define MIDI_EVENT_FILE_MAGIC "SW10EVTS"
+#define MIDI_EVENT_FILE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t time_division;
+    uint64_t source_hash;   // FNV-1a hash of the MIDI file
+    uint64_t source_size;
+} midi_event_file_header;
+
+struct midi_parser {
+    const uint8_t *midi;    // MIDI file data or event file data (mapped or in memory)
+    size_t midilen;
+    int mapped;
+    midi_track_info *tracks;
+    unsigned int number_of_tracks, time_division;
+    unsigned int *heap, heap_len;
+    unsigned int lasttracknum;
+    uint64_t last_tick;
+    unsigned int tempo, tempo_tick;
+    uint32_t tempo_time;
+    uint32_t end_time;
+    midi_event_info event;  // last parsed event
+    int has_event;
+    uint8_t *sysex_buffer;
+    uint32_t sysex_buffer_size;
+    const midi_event_stream *stream;    // precompiled events (tracks aren't used)
+    midi_event_stream *allocated_stream;
+};
+
+// length of channel messages by status byte (0 = not a channel message)
+static const uint8_t channel_message_length[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 3, 3, 3, 3, 2, 2, 3, 0 };
+
+// tracks with lower tick are first, tracks with equal tick are ordered by track number
+#define TRACK_BEFORE(tracks, tracknum1, tracknum2) (((tracks)[tracknum1].tick < (tracks)[tracknum2].tick) || (((tracks)[tracknum1].tick == (tracks)[tracknum2].tick) && ((tracknum1) < (tracknum2))))
+
 
-void free_midi_data(midi_event_info *data)
+void free_midi_data(midi_event_stream *stream)
 {
-    unsigned int index;
+    // the stream is allocated in one block
+    if (stream != NULL)
+    {
+        free(stream);
+    }
+}
 
-    if (data != NULL)
+static uint8_t *write_varint(uint8_t *ptr, uint32_t value)
+{
+    while (value >= 0x80)
     {
-        for (index = data[0].len; index != 0; index--)
-        {
-            if (data[index].sysex != NULL)
-            {
-                free(data[index].sysex);
-                data[index].sysex = NULL;
-            }
-        }
+        *ptr = (value & 0x7f) | 0x80;
+        ptr++;
+        value >>= 7;
+    };
+
+    *ptr = value;
+    return ptr + 1;
+}
+
+static const uint8_t *read_varint(const uint8_t *ptr, uint32_t *value)
+{
+    uint32_t result;
+    unsigned int shift;
+
+    result = 0;
+    shift = 0;
+    while (*ptr & 0x80)
+    {
+        result |= ((uint32_t)(*ptr & 0x7f)) << shift;
+        ptr++;
+        shift += 7;
+    };
+
+    *value = result | (((uint32_t)*ptr) << shift);
+    return ptr + 1;
+}
+
+static int next_parsed_event(midi_event_iterator *iterator);
 
-        free(data);
+int midi_event_first(midi_event_iterator *iterator, const midi_event_stream *stream)
+{
+    iterator->parser = NULL;
+    iterator->time = 0;
+    iterator->next = (const uint8_t *)(stream + 1);
+    iterator->end = iterator->next + stream->size;
+
+    return midi_event_next(iterator);
+}
+
+int midi_event_next(midi_event_iterator *iterator)
+{
+    const uint8_t *ptr;
+    uint32_t delta;
+
+    if (iterator->parser != NULL)
+    {
+        return next_parsed_event(iterator);
     }
+
+    ptr = iterator->next;
+    if (ptr >= iterator->end)
+    {
+        return 0;
+    }
+
+    ptr = read_varint(ptr, &delta);
+    iterator->time += delta;
+
+    iterator->len = channel_message_length[*ptr >> 4];
+    if (iterator->len == 0)
+    {
+        ptr = read_varint(ptr + 1, &(iterator->len));
+    }
+
+    iterator->data = ptr;
+    iterator->next = ptr + iterator->len;
+
+    return 1;
 }
 
 static int readmidi(const uint8_t *midi, unsigned int midilen, unsigned int *number_of_tracks_ptr, unsigned int *time_division_ptr, midi_track_info **tracks_ptr)
@@ -199,252 +318,195 @@ static unsigned int read_varlen(midi_track_info *track)
     return (track->eot)?0:varlen;
 }
 
-static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_event_info **dataptr)
+static void push_track(unsigned int *heap, unsigned int *heap_len, const midi_track_info *tracks, unsigned int tracknum)
 {
-    unsigned int number_of_tracks, time_division, index, lasttracknum, varlen;
-    midi_track_info *tracks, *curtrack;
-    unsigned int num_allocated, num_events, last_tick;
-    midi_event_info *events;
-    int retval, eventextralen;
-    midi_event_info event;
-    unsigned int tempo, tempo_tick;
-    uint32_t tempo_time;
+    unsigned int position, parent;
 
-    retval = readmidi(midi, midilen, &number_of_tracks, &time_division, &tracks);
-    if (retval) return retval;
+    position = *heap_len;
+    (*heap_len)++;
 
-    // prepare tracks
-    for (index = 0; index < number_of_tracks; index++)
+    while (position != 0)
     {
-        curtrack = &(tracks[index]);
+        parent = (position - 1) / 2;
+        if (!TRACK_BEFORE(tracks, tracknum, heap[parent])) break;
 
-        // read delta
-        curtrack->delta = read_varlen(curtrack);
-    }
+        heap[position] = heap[parent];
+        position = parent;
+    };
 
-    num_allocated = midilen / 4;
-    num_events = 1;
+    heap[position] = tracknum;
+}
 
-    events = (midi_event_info *) malloc(sizeof(midi_event_info) * num_allocated);
-    if (events == NULL)
-    {
-        retval = 11;
-        goto midi_error_1;
-    }
+static unsigned int pop_track(unsigned int *heap, unsigned int *heap_len, const midi_track_info *tracks)
+{
+    unsigned int tracknum, lasttracknum, position, child;
 
-    events[0].tick = 0;
-    events[0].len = 0;
-    events[0].sysex = NULL;
-    events[0].time = 0;
+    tracknum = heap[0];
+    (*heap_len)--;
+    lasttracknum = heap[*heap_len];
 
-    lasttracknum = 0;
-    last_tick = 0;
-    tempo = 500000; // 500000 MPQN = 120 BPM
-    tempo_tick = 0;
-    tempo_time = 0;
+    position = 0;
     for (;;)
     {
-        curtrack = NULL;
+        child = 2 * position + 1;
+        if (child >= *heap_len) break;
 
-        if ((lasttracknum < number_of_tracks) && (!tracks[lasttracknum].eot) && (tracks[lasttracknum].delta == 0))
-        {
-            curtrack = &(tracks[lasttracknum]);
-        }
-        else
-        {
-            unsigned int mindelta;
-            mindelta = UINT_MAX;
-            for (index = 0; index < number_of_tracks; index++)
-            {
-                if ((!tracks[index].eot) && (tracks[index].delta < mindelta))
-                {
-                    mindelta = tracks[index].delta;
-                    curtrack = &(tracks[index]);
-                    lasttracknum = index;
-                }
-            }
-        }
+        if ((child + 1 < *heap_len) && TRACK_BEFORE(tracks, heap[child + 1], heap[child])) child++;
+        if (!TRACK_BEFORE(tracks, heap[child], lasttracknum)) break;
 
-        if (curtrack == NULL) break;
+        heap[position] = heap[child];
+        position = child;
+    };
 
-        // update deltas
-        if (curtrack->delta != 0)
-        for (index = 0; index < number_of_tracks; index++)
-        {
-            if ((!tracks[index].eot) && (index != lasttracknum))
-            {
-                tracks[index].delta -= curtrack->delta;
-            }
-        }
+    heap[position] = lasttracknum;
 
-        // read and process data
-        event.tick = last_tick + curtrack->delta;
-        last_tick = event.tick;
-        event.sysex = NULL;
+    return tracknum;
+}
 
-        // calculate event time in miliseconds
-        event.time = (uint32_t)( ((event.tick - tempo_tick) * (uint64_t) tempo) / (time_division * 1000) ) + tempo_time;
+// reads one event from the track, sysex data longer than 8 bytes is not copied
+// returns 0 when no event was read, 1 for event, 2 for tempo event
+static int read_event(midi_track_info *curtrack, midi_event_info *event)
+{
+    unsigned int varlen;
+    int retval;
 
-        if (event.time > events[0].time) events[0].time = event.time;
+    retval = 0;
+    event->sysex = NULL;
 
-        eventextralen = -1;
+    if (*curtrack->ptr & 0x80)
+    {
+        curtrack->prev_event = *curtrack->ptr;
+        curtrack->ptr += 1;
+        curtrack->len -= 1;
+    }
 
-        if (*curtrack->ptr & 0x80)
-        {
-            curtrack->prev_event = *curtrack->ptr;
-            curtrack->ptr += 1;
-            curtrack->len -= 1;
-        }
+    switch (curtrack->prev_event >> 4)
+    {
+        case MIDI_STATUS_NOTE_OFF:
+        case MIDI_STATUS_NOTE_ON:
+        case MIDI_STATUS_AFTERTOUCH:
+        case MIDI_STATUS_CONTROLLER:
+        case MIDI_STATUS_PITCH_WHEEL:
+            if (curtrack->len >= 2)
+            {
+                event->data[0] = curtrack->prev_event;
+                event->data[1] = curtrack->ptr[0];
+                event->data[2] = curtrack->ptr[1];
+                event->len = 3;
+                curtrack->ptr += 2;
+                curtrack->len -= 2;
+                retval = 1;
+            }
+            else
+            {
+                curtrack->len = 0;
+                curtrack->eot = 1;
+            }
 
-        switch (curtrack->prev_event >> 4)
-        {
-            case MIDI_STATUS_NOTE_OFF:
-            case MIDI_STATUS_NOTE_ON:
-            case MIDI_STATUS_AFTERTOUCH:
-            case MIDI_STATUS_CONTROLLER:
-            case MIDI_STATUS_PITCH_WHEEL:
-                if (curtrack->len >= 2)
-                {
-                    event.data[0] = curtrack->prev_event;
-                    event.data[1] = curtrack->ptr[0];
-                    event.data[2] = curtrack->ptr[1];
-                    event.len = 3;
-                    curtrack->ptr += 2;
-                    curtrack->len -= 2;
-                    eventextralen = 0;
-                }
-                else
-                {
-                    curtrack->len = 0;
-                    curtrack->eot = 1;
-                }
+            break;
 
-                break;
+        case MIDI_STATUS_PROG_CHANGE:
+        case MIDI_STATUS_PRESSURE:
+            if (curtrack->len >= 1)
+            {
+                event->data[0] = curtrack->prev_event;
+                event->data[1] = curtrack->ptr[0];
+                event->len = 2;
+                curtrack->ptr += 1;
+                curtrack->len -= 1;
+                retval = 1;
+            }
+            else
+            {
+                curtrack->len = 0;
+                curtrack->eot = 1;
+            }
+            break;
 
-            case MIDI_STATUS_PROG_CHANGE:
-            case MIDI_STATUS_PRESSURE:
-                if (curtrack->len >= 1)
+        case MIDI_STATUS_SYSEX:
+            if (curtrack->prev_event == 0xff) // meta events
+            {
+                if (curtrack->len >= 2)
                 {
-                    event.data[0] = curtrack->prev_event;
-                    event.data[1] = curtrack->ptr[0];
-                    event.len = 2;
-                    curtrack->ptr += 1;
-                    curtrack->len -= 1;
-                    eventextralen = 0;
+                    if (curtrack->ptr[0] == 0x2f) // end of track
+                    {
+                        curtrack->len = 0;
+                        curtrack->eot = 1;
+                    }
+                    else
+                    {
+                        if ((curtrack->ptr[0] == 0x51) && (curtrack->ptr[1] == 3) && (curtrack->len >= 5)) // set tempo
+                        {
+                            event->data[0] = curtrack->prev_event;
+                            event->data[1] = curtrack->ptr[0];
+                            event->data[2] = curtrack->ptr[1];
+                            event->data[3] = curtrack->ptr[2];
+                            event->data[4] = curtrack->ptr[3];
+                            event->data[5] = curtrack->ptr[4];
+                            event->len = 6;
+                            retval = 2;
+                        }
+
+                        // read length and skip event
+                        curtrack->ptr += 1;
+                        curtrack->len -= 1;
+                        varlen = read_varlen(curtrack);
+                        if (varlen <= curtrack->len)
+                        {
+                            curtrack->ptr += varlen;
+                            curtrack->len -= varlen;
+                        }
+                        else
+                        {
+                            curtrack->len = 0;
+                            curtrack->eot = 1;
+                        }
+                    }
                 }
                 else
                 {
                     curtrack->len = 0;
                     curtrack->eot = 1;
                 }
-                break;
-
-            case MIDI_STATUS_SYSEX:
-                if (curtrack->prev_event == 0xff) // meta events
+            }
+            else if ((curtrack->prev_event == 0xf0) || (curtrack->prev_event == 0xf7)) // sysex
+            {
+                varlen = read_varlen(curtrack);
+                if (varlen <= curtrack->len)
                 {
-                    if (curtrack->len >= 2)
+                    event->len = varlen + ((curtrack->prev_event == 0xf0)?1:0);
+                    if (event->len)
                     {
-                        if (curtrack->ptr[0] == 0x2f) // end of track
-                        {
-                            curtrack->len = 0;
-                            curtrack->eot = 1;
-                        }
-                        else
+                        if (event->len <= 8)
                         {
-                            if ((curtrack->ptr[0] == 0x51) && (curtrack->ptr[1] == 3) && (curtrack->len >= 5)) // set tempo
-                            {
-                                // time_division is assumed to be positive (ticks per beat / PPQN - Pulses (i.e. clocks) Per Quarter Note)
-
-                                event.data[0] = curtrack->prev_event;
-                                event.data[1] = curtrack->ptr[0];
-                                event.data[2] = curtrack->ptr[1];
-                                event.data[3] = curtrack->ptr[2];
-                                event.data[4] = curtrack->ptr[3];
-                                event.data[5] = curtrack->ptr[4];
-                                event.len = 6;
-                                eventextralen = 0;
-
-                                tempo = (((uint32_t)(curtrack->ptr[2])) << 16) | (((uint32_t)(curtrack->ptr[3])) << 8) | ((uint32_t)(curtrack->ptr[4]));
-                                tempo_tick = event.tick;
-                                tempo_time = event.time;
-                            }
-
-                            // read length and skip event
-                            curtrack->ptr += 1;
-                            curtrack->len -= 1;
-                            varlen = read_varlen(curtrack);
-                            if (varlen <= curtrack->len)
+                            if (curtrack->prev_event == 0xf0)
                             {
-                                curtrack->ptr += varlen;
-                                curtrack->len -= varlen;
+                                event->data[0] = 0xf0;
+                                memcpy(&(event->data[1]), curtrack->ptr, varlen);
                             }
                             else
                             {
-                                curtrack->len = 0;
-                                curtrack->eot = 1;
+                                memcpy(&(event->data[0]), curtrack->ptr, varlen);
                             }
                         }
-                    }
-                    else
-                    {
-                        curtrack->len = 0;
-                        curtrack->eot = 1;
-                    }
-                }
-                else if ((curtrack->prev_event == 0xf0) || (curtrack->prev_event == 0xf7)) // sysex
-                {
-                    const uint8_t *startevent;
-
-                    startevent = curtrack->ptr;
-
-                    varlen = read_varlen(curtrack);
-                    if (varlen <= curtrack->len)
-                    {
-                        event.len = varlen + ((curtrack->prev_event == 0xf0)?1:0);
-                        if (event.len)
+                        else
                         {
-                            if (event.len <= 8)
+                            if (curtrack->prev_event == 0xf0)
                             {
-                                if (curtrack->prev_event == 0xf0)
-                                {
-                                    event.data[0] = 0xf0;
-                                    memcpy(&(event.data[1]), curtrack->ptr, varlen);
-                                }
-                                else
-                                {
-                                    memcpy(&(event.data[0]), curtrack->ptr, varlen);
-                                }
+                                event->data[0] = 0xf0;
+                                event->sysex = curtrack->ptr;
                             }
                             else
                             {
-                                event.sysex = (uint8_t *) malloc(event.len);
-                                if (event.sysex == NULL)
-                                {
-                                    retval = 12;
-                                    goto midi_error_2;
-                                }
-
-                                if (curtrack->prev_event == 0xf0)
-                                {
-                                    event.sysex[0] = 0xf0;
-                                    memcpy(event.sysex + 1, curtrack->ptr, varlen);
-                                }
-                                else
-                                {
-                                    memcpy(event.sysex, curtrack->ptr, varlen);
-                                }
+                                event->data[0] = curtrack->ptr[0];
+                                event->sysex = curtrack->ptr + 1;
                             }
+                        }
 
-                            curtrack->ptr += varlen;
-                            curtrack->len -= varlen;
+                        curtrack->ptr += varlen;
+                        curtrack->len -= varlen;
 
-                            eventextralen = (int)(1 + curtrack->ptr - startevent);
-                        }
-                    }
-                    else
-                    {
-                        curtrack->len = 0;
-                        curtrack->eot = 1;
+                        retval = 1;
                     }
                 }
                 else
@@ -452,107 +514,798 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
                     curtrack->len = 0;
                     curtrack->eot = 1;
                 }
-                break;
-
-            default:
+            }
+            else
+            {
                 curtrack->len = 0;
                 curtrack->eot = 1;
-                break;
-        }
+            }
+            break;
+
+        default:
+            curtrack->len = 0;
+            curtrack->eot = 1;
+            break;
+    }
+
+    return retval;
+}
+
+static int is_channel_message(const midi_event_info *event)
+{
+    return (event->len <= 8) && (channel_message_length[event->data[0] >> 4] == event->len);
+}
+
+// computes maximal size of the event stream without merging the tracks
+static size_t prescan_tracks(const midi_track_info *tracks, unsigned int number_of_tracks)
+{
+    unsigned int index;
+    size_t stream_size;
+    midi_track_info track;
+    midi_event_info event;
+
+    stream_size = 0;
+    for (index = 0; index < number_of_tracks; index++)
+    {
+        track = tracks[index];
 
-        if (eventextralen >= 0)
+        // delta of the first event was already read
+        while (!track.eot)
         {
-            if (num_events >= num_allocated)
+            if (read_event(&track, &event))
             {
-                midi_event_info *new_events;
+                // time difference + (marker + length) + data
+                stream_size += 5 + (is_channel_message(&event) ? 0 : 6) + event.len;
+            }
 
-                new_events = (midi_event_info *) realloc(events, sizeof(midi_event_info) * num_allocated * 2);
-                if (new_events == NULL)
-                {
-                    retval = 13;
-                    goto midi_error_2;
-                }
+            read_varlen(&track);
+        };
+    }
 
-                num_allocated = num_allocated * 2;
-                events = new_events;
-            }
+    return stream_size;
+}
 
-            events[num_events] = event;
-            events[0].len = num_events;
-            num_events++;
-        }
+static int init_parser(midi_parser *parser)
+{
+    unsigned int index;
+    midi_track_info *curtrack;
+    int retval;
 
-        // read delta
-        curtrack->delta = read_varlen(curtrack);
-    };
+    if (parser->midilen > UINT_MAX)
+    {
+        return 22;
+    }
+
+    retval = readmidi(parser->midi, (unsigned int)parser->midilen, &(parser->number_of_tracks), &(parser->time_division), &(parser->tracks));
+    if (retval) return retval;
 
-    if (events[0].len == 0)
+    // min-heap of track numbers ordered by tick of the next event
+    parser->heap = (unsigned int *) malloc(parser->number_of_tracks * sizeof(unsigned int));
+    if (parser->heap == NULL)
     {
-        retval = 14;
-        goto midi_error_2;
+        free(parser->tracks);
+        parser->tracks = NULL;
+        return 15;
     }
 
-    // return values
-    *timediv = time_division;
-    *dataptr = events;
+    // prepare tracks
+    parser->heap_len = 0;
+    for (index = 0; index < parser->number_of_tracks; index++)
+    {
+        curtrack = &(parser->tracks[index]);
 
-    free(tracks);
-    return 0;
+        // read delta
+        curtrack->tick = read_varlen(curtrack);
 
-midi_error_2:
-    free_midi_data(events);
-midi_error_1:
-    free(tracks);
-    return retval;
+        // first track is the last processed track, it's not in the heap
+        if ((index != 0) && (!curtrack->eot))
+        {
+            push_track(parser->heap, &(parser->heap_len), parser->tracks, index);
+        }
+    }
+
+    parser->end_time = 0;
+    parser->lasttracknum = 0;
+    parser->last_tick = 0;
+    parser->tempo = 500000; // 500000 MPQN = 120 BPM
+    parser->tempo_tick = 0;
+    parser->tempo_time = 0;
+
+    return 0;
 }
 
-int load_midi_file(const char *filename, unsigned int *timediv, midi_event_info **dataptr)
+// merges the tracks until the next event, returns 0 when there are no more events
+static int parse_event(midi_parser *parser, midi_event_info *event)
 {
-    FILE *f;
-    long fsize;
-    uint8_t *midi;
-    int retval;
+    midi_track_info *tracks, *curtrack;
+    uint32_t tick;
+    int eventtype;
 
-#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-    if (fopen_s(&f, filename, "rb")) return 21;
-#else
-    f = fopen(filename, "rb");
-    if (f == NULL) return 21;
-#endif
+    tracks = parser->tracks;
 
-    midi = NULL;
+    for (;;)
+    {
+        // the last processed track continues while it has events at the same tick,
+        // otherwise the track with the lowest tick (and lowest track number) is selected
+        curtrack = &(tracks[parser->lasttracknum]);
+
+        if ((curtrack->eot) || (curtrack->tick != parser->last_tick))
+        {
+            if (!curtrack->eot)
+            {
+                push_track(parser->heap, &(parser->heap_len), tracks, parser->lasttracknum);
+            }
 
-    // get file size
-    retval = 22;
-    if (fseek(f, 0, SEEK_END)) goto FILE_ERROR;
+            if (parser->heap_len == 0) return 0;
 
-    fsize = ftell(f);
-    if (fsize == -1) goto FILE_ERROR;
+            // delta UINT_MAX is never selected
+            if (tracks[parser->heap[0]].tick - parser->last_tick >= UINT_MAX) return 0;
 
-    if (fseek(f, 0, SEEK_SET)) goto FILE_ERROR;
+            parser->lasttracknum = pop_track(parser->heap, &(parser->heap_len), tracks);
+            curtrack = &(tracks[parser->lasttracknum]);
+        }
 
-    // allocate memory for the whole file
-    retval = 24;
-    midi = (uint8_t *)malloc(fsize);
-    if (midi == NULL) goto FILE_ERROR;
+        // read and process data
+        tick = (uint32_t)curtrack->tick;
+        parser->last_tick = curtrack->tick;
 
-    // read the whole file
-    retval = 25;
-    if (fread(midi, 1, fsize, f) != (unsigned long)fsize) goto FILE_ERROR;
+        // calculate event time in miliseconds
+        event->time = (uint32_t)( ((tick - parser->tempo_tick) * (uint64_t) parser->tempo) / (parser->time_division * 1000) ) + parser->tempo_time;
 
-    fclose(f);
-    f = NULL;
+        if (event->time > parser->end_time) parser->end_time = event->time;
 
-    // preprocess midi
-    retval = preprocessmidi(midi, fsize, timediv, dataptr);
+        eventtype = read_event(curtrack, event);
 
-    free(midi);
+        if (eventtype == 2)
+        {
+            // time_division is assumed to be positive (ticks per beat / PPQN - Pulses (i.e. clocks) Per Quarter Note)
+            parser->tempo = (((uint32_t)(event->data[3])) << 16) | (((uint32_t)(event->data[4])) << 8) | ((uint32_t)(event->data[5]));
+            parser->tempo_tick = tick;
+            parser->tempo_time = event->time;
+        }
 
-    return retval;
+        // read delta
+        curtrack->tick += read_varlen(curtrack);
 
-FILE_ERROR:
-    if (midi != NULL) free(midi);
-    fclose(f);
-    return retval;
+        if (eventtype != 0) return 1;
+    };
 }
 
+static void free_parser_data(midi_parser *parser)
+{
+    if (parser->heap != NULL)
+    {
+        free(parser->heap);
+        parser->heap = NULL;
+    }
+
+    if (parser->tracks != NULL)
+    {
+        free(parser->tracks);
+        parser->tracks = NULL;
+    }
+
+    if (parser->sysex_buffer != NULL)
+    {
+        free(parser->sysex_buffer);
+        parser->sysex_buffer = NULL;
+    }
+
+    if (parser->allocated_stream != NULL)
+    {
+        free(parser->allocated_stream);
+        parser->allocated_stream = NULL;
+    }
+
+    if (parser->midi != NULL)
+    {
+#ifndef _WIN32
+        if (parser->mapped)
+        {
+            munmap((void *)parser->midi, parser->midilen);
+        }
+        else
+#endif
+        {
+            free((void *)parser->midi);
+        }
+        parser->midi = NULL;
+    }
+}
+
+// reads the whole file (or pipe) to memory
+static int read_midi_input(FILE *f, midi_parser *parser)
+{
+    uint8_t *midi, *new_midi;
+    size_t midilen, allocated, bytes_read;
+
+    allocated = 65536;
+    midi = (uint8_t *)malloc(allocated);
+    if (midi == NULL) return 24;
+
+    midilen = 0;
+    for (;;)
+    {
+        if (midilen == allocated)
+        {
+            new_midi = (uint8_t *)realloc(midi, allocated * 2);
+            if (new_midi == NULL)
+            {
+                free(midi);
+                return 24;
+            }
+
+            midi = new_midi;
+            allocated *= 2;
+        }
+
+        bytes_read = fread(midi + midilen, 1, allocated - midilen, f);
+        midilen += bytes_read;
+
+        if (bytes_read == 0) break;
+    };
+
+    if (ferror(f))
+    {
+        free(midi);
+        return 25;
+    }
+
+    parser->midi = midi;
+    parser->midilen = midilen;
+    parser->mapped = 0;
+    return 0;
+}
+
+static int open_midi_input(const char *filename, midi_parser *parser)
+{
+    FILE *f;
+    int retval;
+#ifndef _WIN32
+    struct stat file_stat;
+    void *map;
+#endif
+
+    // standard input
+    if (strcmp(filename, "-") == 0)
+    {
+#ifdef _WIN32
+        if (_setmode(_fileno(stdin), _O_BINARY) == -1) return 22;
+#endif
+        return read_midi_input(stdin, parser);
+    }
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, filename, "rb")) return 21;
+#else
+    f = fopen(filename, "rb");
+    if (f == NULL) return 21;
+#endif
+
+#ifndef _WIN32
+    // regular files are mapped to memory, other files are read to memory
+    if ((fstat(fileno(f), &file_stat) == 0) && S_ISREG(file_stat.st_mode) && (file_stat.st_size > 0) && ((uint64_t)file_stat.st_size <= SIZE_MAX))
+    {
+        map = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (map != MAP_FAILED)
+        {
+            fclose(f);
+
+            parser->midi = (const uint8_t *)map;
+            parser->midilen = (size_t)file_stat.st_size;
+            parser->mapped = 1;
+            return 0;
+        }
+    }
+#endif
+
+    retval = read_midi_input(f, parser);
+    fclose(f);
+    return retval;
+}
+
+static int build_event_stream(midi_parser *parser, midi_event_stream **streamptr)
+{
+    size_t stream_size;
+    midi_event_stream *stream, *new_stream;
+    uint8_t *stream_ptr;
+    midi_event_info event;
+    uint32_t last_time;
+
+    // the stream is allocated in one block, its maximal size is counted before merging the tracks
+    stream_size = prescan_tracks(parser->tracks, parser->number_of_tracks);
+
+    stream = (midi_event_stream *) malloc(sizeof(midi_event_stream) + stream_size);
+    if (stream == NULL)
+    {
+        return 11;
+    }
+
+    stream_ptr = (uint8_t *)(stream + 1);
+    stream->num_events = 0;
+
+    last_time = 0;
+    while (parse_event(parser, &event))
+    {
+        stream_ptr = write_varint(stream_ptr, event.time - last_time);
+        last_time = event.time;
+
+        if (!is_channel_message(&event))
+        {
+            // marker and length
+            *stream_ptr = 0;
+            stream_ptr = write_varint(stream_ptr + 1, event.len);
+        }
+
+        if (event.sysex == NULL)
+        {
+            memcpy(stream_ptr, event.data, event.len);
+        }
+        else
+        {
+            stream_ptr[0] = event.data[0];
+            memcpy(stream_ptr + 1, event.sysex, event.len - 1);
+        }
+        stream_ptr += event.len;
+
+        stream->num_events++;
+    };
+
+    stream->end_time = parser->end_time;
+
+    if (stream->num_events == 0)
+    {
+        free(stream);
+        return 14;
+    }
+
+    // release unused part of the block
+    stream->size = (uint32_t)(stream_ptr - (uint8_t *)(stream + 1));
+    new_stream = (midi_event_stream *) realloc(stream, sizeof(midi_event_stream) + stream->size);
+    if (new_stream != NULL)
+    {
+        stream = new_stream;
+    }
+
+    *streamptr = stream;
+    return 0;
+}
+
+int load_midi_file(const char *filename, unsigned int *timediv, midi_event_stream **streamptr)
+{
+    midi_parser parser;
+    int retval;
+
+    memset(&parser, 0, sizeof(parser));
+
+    retval = open_midi_input(filename, &parser);
+    if (retval == 0)
+    {
+        retval = init_parser(&parser);
+    }
+
+    if (retval == 0)
+    {
+        retval = build_event_stream(&parser, streamptr);
+    }
+
+    if (retval == 0)
+    {
+        *timediv = parser.time_division;
+    }
+
+    free_parser_data(&parser);
+    return retval;
+}
+
+int open_midi_parser(const char *filename, unsigned int *timediv, midi_parser **parserptr)
+{
+    midi_parser *parser;
+    int retval;
+
+    parser = (midi_parser *) calloc(1, sizeof(midi_parser));
+    if (parser == NULL)
+    {
+        return 24;
+    }
+
+    retval = open_midi_input(filename, parser);
+    if (retval == 0)
+    {
+        retval = init_parser(parser);
+    }
+
+    if (retval == 0)
+    {
+        // the first event is parsed in advance to detect files without events
+        parser->has_event = parse_event(parser, &(parser->event));
+        if (!parser->has_event)
+        {
+            retval = 14;
+        }
+    }
+
+    if (retval)
+    {
+        close_midi_parser(parser);
+        return retval;
+    }
+
+    *timediv = parser->time_division;
+    *parserptr = parser;
+    return 0;
+}
+
+void close_midi_parser(midi_parser *parser)
+{
+    if (parser != NULL)
+    {
+        free_parser_data(parser);
+        free(parser);
+    }
+}
+
+uint32_t midi_parser_end_time(const midi_parser *parser)
+{
+    return parser->end_time;
+}
+
+// sets the iterator to the parsed event, long sysex events are copied to one buffer
+static int set_parsed_event(midi_event_iterator *iterator)
+{
+    midi_parser *parser;
+    uint8_t *new_buffer;
+
+    parser = iterator->parser;
+
+    iterator->time = parser->event.time;
+    iterator->len = parser->event.len;
+
+    if (parser->event.sysex == NULL)
+    {
+        iterator->data = parser->event.data;
+        return 1;
+    }
+
+    if (parser->event.len > parser->sysex_buffer_size)
+    {
+        new_buffer = (uint8_t *)realloc(parser->sysex_buffer, parser->event.len);
+        if (new_buffer == NULL)
+        {
+            // parsing ends when there isn't enough memory
+            return 0;
+        }
+
+        parser->sysex_buffer = new_buffer;
+        parser->sysex_buffer_size = parser->event.len;
+    }
+
+    parser->sysex_buffer[0] = parser->event.data[0];
+    memcpy(parser->sysex_buffer + 1, parser->event.sysex, parser->event.len - 1);
+
+    iterator->data = parser->sysex_buffer;
+    return 1;
+}
+
+int midi_parser_first(midi_event_iterator *iterator, midi_parser *parser)
+{
+    iterator->parser = parser;
+    iterator->next = NULL;
+    iterator->end = NULL;
+
+    if (!parser->has_event)
+    {
+        return 0;
+    }
+
+    parser->has_event = 0;
+
+    if (parser->stream != NULL)
+    {
+        return midi_event_first(iterator, parser->stream);
+    }
+
+    return set_parsed_event(iterator);
+}
+
+static int next_parsed_event(midi_event_iterator *iterator)
+{
+    if (!parse_event(iterator->parser, &(iterator->parser->event)))
+    {
+        return 0;
+    }
+
+    return set_parsed_event(iterator);
+}
+
+static uint64_t hash_midi_data(const uint8_t *data, size_t len)
+{
+    uint64_t hash;
+
+    hash = UINT64_C(14695981039346656037);
+    for (; len != 0; len--, data++)
+    {
+        hash ^= *data;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+// reads variable length value, returns NULL when the value isn't complete before the end
+static const uint8_t *read_varint_checked(const uint8_t *ptr, const uint8_t *end, uint32_t *value)
+{
+    unsigned int index;
+
+    for (index = 0; (index < 5) && (ptr + index < end); index++)
+    {
+        if ((ptr[index] & 0x80) == 0)
+        {
+            return read_varint(ptr, value);
+        }
+    }
+
+    return NULL;
+}
+
+// checks that all events are within the stream, so the iterator doesn't have to check them
+static int check_event_stream(const midi_event_stream *stream)
+{
+    const uint8_t *ptr, *end;
+    uint32_t delta, len, num_events;
+
+    ptr = (const uint8_t *)(stream + 1);
+    end = ptr + stream->size;
+
+    for (num_events = 0; ptr < end; num_events++)
+    {
+        ptr = read_varint_checked(ptr, end, &delta);
+        if ((ptr == NULL) || (ptr >= end))
+        {
+            return 0;
+        }
+
+        len = channel_message_length[*ptr >> 4];
+        if (len == 0)
+        {
+            ptr = read_varint_checked(ptr + 1, end, &len);
+            if (ptr == NULL)
+            {
+                return 0;
+            }
+        }
+
+        if (len > (size_t)(end - ptr))
+        {
+            return 0;
+        }
+        ptr += len;
+    }
+
+    return num_events == stream->num_events;
+}
+
+// returns the event stream when the event file is valid for the MIDI file
+static const midi_event_stream *check_event_file(const midi_parser *event_file, uint64_t source_hash, uint64_t source_size, unsigned int *time_division)
+{
+    const midi_event_file_header *header;
+    const midi_event_stream *stream;
+
+    if (event_file->midilen < sizeof(midi_event_file_header) + sizeof(midi_event_stream))
+    {
+        return NULL;
+    }
+
+    header = (const midi_event_file_header *)event_file->midi;
+    stream = (const midi_event_stream *)(header + 1);
+
+    if ((memcmp(header->magic, MIDI_EVENT_FILE_MAGIC, 8) != 0) ||
+        (header->version != MIDI_EVENT_FILE_VERSION) ||
+        (header->source_hash != source_hash) ||
+        (header->source_size != source_size) ||
+        (stream->num_events == 0) ||
+        (event_file->midilen != sizeof(midi_event_file_header) + sizeof(midi_event_stream) + stream->size) ||
+        !check_event_stream(stream)
+       )
+    {
+        return NULL;
+    }
+
+    *time_division = header->time_division;
+    return stream;
+}
+
+static int write_event_file(const char *path, const midi_event_stream *stream, uint64_t source_hash, uint64_t source_size, unsigned int time_division)
+{
+    midi_event_file_header header;
+    FILE *f;
+    int retval;
+#ifndef _WIN32
+    char *temp_path;
+    int fd;
+#endif
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MIDI_EVENT_FILE_MAGIC, 8);
+    header.version = MIDI_EVENT_FILE_VERSION;
+    header.time_division = time_division;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+
+#ifdef _WIN32
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, path, "wb")) return 32;
+#else
+    f = fopen(path, "wb");
+    if (f == NULL) return 32;
+#endif
+#else
+    // the file is written with temporary name and renamed, so incomplete file is never used by other process
+    temp_path = (char *) malloc(strlen(path) + 8);
+    if (temp_path == NULL) return 24;
+
+    strcpy(temp_path, path);
+    strcat(temp_path, ".XXXXXX");
+
+    fd = mkstemp(temp_path);
+    if (fd < 0)
+    {
+        free(temp_path);
+        return 32;
+    }
+
+    fchmod(fd, 0644);
+
+    f = fdopen(fd, "wb");
+    if (f == NULL)
+    {
+        close(fd);
+        remove(temp_path);
+        free(temp_path);
+        return 32;
+    }
+#endif
+
+    retval = 0;
+    if ((fwrite(&header, 1, sizeof(header), f) != sizeof(header)) ||
+        (fwrite(stream, 1, sizeof(midi_event_stream) + stream->size, f) != sizeof(midi_event_stream) + stream->size)
+       )
+    {
+        retval = 33;
+    }
+
+    if (fclose(f) != 0)
+    {
+        retval = 33;
+    }
+
+#ifdef _WIN32
+    if (retval)
+    {
+        remove(path);
+    }
+#else
+    if ((retval == 0) && (rename(temp_path, path) != 0))
+    {
+        retval = 34;
+    }
+
+    if (retval)
+    {
+        remove(temp_path);
+    }
+
+    free(temp_path);
+#endif
+
+    return retval;
+}
+
+// the events are read from the event file when it's valid, otherwise the MIDI file is parsed and the event file is written
+static int open_cached_events(const char *filename, const char *cache_dir, midi_parser *parser, int *cache_status)
+{
+    midi_parser event_file;
+    const midi_event_stream *stream;
+    uint64_t source_hash, source_size;
+    unsigned int time_division;
+    char *path;
+    int retval;
+
+    retval = open_midi_input(filename, parser);
+    if (retval) return retval;
+
+    source_hash = hash_midi_data(parser->midi, parser->midilen);
+    source_size = parser->midilen;
+
+    // name of the event file is the hash of the MIDI file
+    path = (char *) malloc(strlen(cache_dir) + 32);
+    if (path == NULL) return 24;
+
+    sprintf(path, "%s/%08x%08x.sw10evt", cache_dir, (unsigned int)(source_hash >> 32), (unsigned int)source_hash);
+
+    stream = NULL;
+    memset(&event_file, 0, sizeof(event_file));
+    if (open_midi_input(path, &event_file) == 0)
+    {
+        stream = check_event_file(&event_file, source_hash, source_size, &time_division);
+        if (stream == NULL)
+        {
+            free_parser_data(&event_file);
+        }
+    }
+
+    if (stream != NULL)
+    {
+        // the MIDI file is replaced by the event file
+        free_parser_data(parser);
+
+        parser->midi = event_file.midi;
+        parser->midilen = event_file.midilen;
+        parser->mapped = event_file.mapped;
+        parser->time_division = time_division;
+
+        *cache_status = MIDI_CACHE_VALID;
+    }
+    else
+    {
+        retval = init_parser(parser);
+
+        if (retval == 0)
+        {
+            retval = build_event_stream(parser, &(parser->allocated_stream));
+        }
+
+        if (retval == 0)
+        {
+            stream = parser->allocated_stream;
+
+            *cache_status = (write_event_file(path, stream, source_hash, source_size, parser->time_division) == 0) ? MIDI_CACHE_CREATED : MIDI_CACHE_NOT_WRITTEN;
+        }
+    }
+
+    free(path);
+
+    if (retval) return retval;
+
+    parser->stream = stream;
+    parser->end_time = stream->end_time;
+    parser->has_event = 1;
+
+    return 0;
+}
+
+int open_midi_parser_cached(const char *filename, const char *cache_dir, unsigned int *timediv, midi_parser **parserptr)
+{
+    midi_parser *parser;
+    int retval, cache_status;
+
+    parser = (midi_parser *) calloc(1, sizeof(midi_parser));
+    if (parser == NULL)
+    {
+        return 24;
+    }
+
+    retval = open_cached_events(filename, cache_dir, parser, &cache_status);
+    if (retval)
+    {
+        close_midi_parser(parser);
+        return retval;
+    }
+
+    *timediv = parser->time_division;
+    *parserptr = parser;
+    return 0;
+}
+
+int update_midi_cache(const char *filename, const char *cache_dir, int *cache_status)
+{
+    midi_parser parser;
+    int retval;
+
+    memset(&parser, 0, sizeof(parser));
+
+    retval = open_cached_events(filename, cache_dir, &parser, cache_status);
+
+    free_parser_data(&parser);
+    return retval;
+}
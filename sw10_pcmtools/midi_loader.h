@@ -27,21 +27,60 @@
 
 #include <stdint.h>
 
+// Events are stored in a packed stream following the structure. Every event is stored as time difference
+// from the previous event (in miliseconds) followed by the event data. Channel messages are stored without
+// length, other events (sysex, tempo) with length. Meta events other than tempo are not stored.
 typedef struct
 {
-    uint32_t tick;
-    uint8_t data[8];
-    uint32_t len;
-    uint8_t *sysex;
-    uint32_t time;
-} midi_event_info;
+    uint32_t num_events;    // number of events in the stream
+    uint32_t end_time;      // time of the last event (in miliseconds)
+    uint32_t size;          // size of the stream data (in bytes)
+} midi_event_stream;
+
+// Parser merges the tracks while the events are used, only the tracks are kept in memory
+// (regular files are mapped to memory, other files are read to memory)
+typedef struct midi_parser midi_parser;
+
+// Event files in the cache directory contain precompiled events of MIDI files. Name of the event file
+// is the hash of the MIDI file, so changed MIDI file never uses old event file.
+#define MIDI_CACHE_VALID 0          // events were read from the event file
+#define MIDI_CACHE_CREATED 1        // event file was created
+#define MIDI_CACHE_NOT_WRITTEN 2    // event file couldn't be written
+
+typedef struct
+{
+    uint32_t time;          // time of the event (in miliseconds)
+    uint32_t len;           // length of the event data
+    const uint8_t *data;    // event data (valid until the next event)
+    const uint8_t *next;
+    const uint8_t *end;
+    midi_parser *parser;
+} midi_event_iterator;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern void free_midi_data(midi_event_info *data);
-extern int load_midi_file(const char *filename, unsigned int *timediv, midi_event_info **dataptr);
+// filename "-" is standard input
+extern void free_midi_data(midi_event_stream *stream);
+extern int load_midi_file(const char *filename, unsigned int *timediv, midi_event_stream **streamptr);
+
+// sets the iterator to the first event, returns 0 when there are no events
+extern int midi_event_first(midi_event_iterator *iterator, const midi_event_stream *stream);
+// moves the iterator to the next event, returns 0 when there are no more events
+extern int midi_event_next(midi_event_iterator *iterator);
+
+extern int open_midi_parser(const char *filename, unsigned int *timediv, midi_parser **parserptr);
+extern void close_midi_parser(midi_parser *parser);
+// sets the iterator to the first event, returns 0 when there are no events (events can be iterated only once)
+extern int midi_parser_first(midi_event_iterator *iterator, midi_parser *parser);
+// time of the last parsed event (end time of the file after all events were parsed)
+extern uint32_t midi_parser_end_time(const midi_parser *parser);
+
+// same as open_midi_parser, but the events are read from the event file in the cache directory (the event file is created when it isn't valid)
+extern int open_midi_parser_cached(const char *filename, const char *cache_dir, unsigned int *timediv, midi_parser **parserptr);
+// creates the event file in the cache directory when it isn't valid
+extern int update_midi_cache(const char *filename, const char *cache_dir, int *cache_status);
 
 #ifdef __cplusplus
 }
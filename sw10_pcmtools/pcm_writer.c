@@ -0,0 +1,539 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#include "pcm_writer.h"
+
+#if defined(_MSC_VER)
+
+#undef BIG_ENDIAN_BYTE_ORDER
+
+#elif defined(__BYTE_ORDER__)
+
+#if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define BIG_ENDIAN_BYTE_ORDER
+#else
+#undef BIG_ENDIAN_BYTE_ORDER
+#endif
+
+#else
+
+#include <endian.h>
+#if (__BYTE_ORDER == __BIG_ENDIAN)
+#define BIG_ENDIAN_BYTE_ORDER
+#else
+#undef BIG_ENDIAN_BYTE_ORDER
+#endif
+
+#endif
+
+#define WRITER_BUFFER_SIZE (1024 * 1024)
+#define WRITER_NUM_BUFFERS 4
+#define WAV_HEADER_SIZE 44
+
+
+struct pcm_writer
+{
+    unsigned int sample_rate;   // 0 = raw data
+    uint64_t data_length;       // number of bytes of samples
+    int trim_silence;
+    int sound_started;          // first non-silent sample was written
+    uint64_t pending_silence;   // number of bytes of silence which is written only when it's followed by other samples
+    uint8_t *buffers[WRITER_NUM_BUFFERS];
+    uint32_t lengths[WRITER_NUM_BUFFERS];
+    unsigned int fill_index;    // buffer which is filled by the calling thread
+    int error;
+#ifdef _WIN32
+    FILE *f;
+#else
+    int fd;
+    int regular_file;           // data is written using pwrite (only files opened by the writer, not standard output)
+    uint64_t file_offset;
+    unsigned int write_index;   // next buffer which is written by the writer thread
+    unsigned int num_filled;    // number of buffers waiting for the writer thread
+    int finished;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_filled;
+    pthread_cond_t cond_written;
+#endif
+};
+
+
+static void WRITE_LE_UINT16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+}
+
+static void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+    ptr[2] = (value >> 16) & 0xff;
+    ptr[3] = (value >> 24) & 0xff;
+}
+
+static void create_wav_header(uint8_t *header, unsigned int sample_rate, uint32_t data_length)
+{
+    // wav header
+    WRITE_LE_UINT32(header, 0x46464952);                // "RIFF" tag
+    WRITE_LE_UINT32(header + 4, 36 + data_length);      // RIFF length
+    WRITE_LE_UINT32(header + 8, 0x45564157);            // "WAVE" tag
+    header += 12;
+
+    // fmt chunk
+    WRITE_LE_UINT32(header, 0x20746D66);    // "fmt " tag
+    WRITE_LE_UINT32(header + 4, 16);        // chunk length
+    header += 8;
+
+    // PCMWAVEFORMAT structure
+    WRITE_LE_UINT16(header, 1);                     // wFormatTag - 1 = PCM
+    WRITE_LE_UINT16(header + 2, 2);                 // nChannels - 2 = stereo
+    WRITE_LE_UINT32(header + 4, sample_rate);       // nSamplesPerSec
+    WRITE_LE_UINT32(header + 8, 4 * sample_rate);   // nAvgBytesPerSec
+    WRITE_LE_UINT16(header + 12, 4);                // nBlockAlign
+    WRITE_LE_UINT16(header + 14, 16);               // wBitsPerSample
+    header += 16;
+
+    // data chunk
+    WRITE_LE_UINT32(header, 0x61746164);        // "data" tag
+    WRITE_LE_UINT32(header + 4, data_length);   // chunk length
+}
+
+static void copy_samples(uint8_t *dst, const uint8_t *src, unsigned int length)
+{
+#ifdef BIG_ENDIAN_BYTE_ORDER
+    // swap values to little-endian, two values at once (the loop can be vectorized by the compiler)
+    unsigned int index;
+    uint32_t value;
+
+    for (index = 0; index + 4 <= length; index += 4)
+    {
+        memcpy(&value, src + index, 4);
+        value = ((value >> 8) & 0x00ff00ff) | ((value << 8) & 0xff00ff00);
+        memcpy(dst + index, &value, 4);
+    }
+
+    for (; index + 2 <= length; index += 2)
+    {
+        dst[index] = src[index + 1];
+        dst[index + 1] = src[index];
+    }
+#else
+    memcpy(dst, src, length);
+#endif
+}
+
+// returns the number of bytes before the first non-silent frame
+static unsigned int skip_silence(const uint8_t *samples, unsigned int length)
+{
+    unsigned int index;
+    uint32_t frame;
+
+    for (index = 0; index + 4 <= length; index += 4)
+    {
+        memcpy(&frame, samples + index, 4);
+        if (frame != 0) break;
+    }
+
+    return index;
+}
+
+// returns the number of bytes after the last non-silent frame
+static unsigned int trailing_silence(const uint8_t *samples, unsigned int length)
+{
+    unsigned int index;
+    uint32_t frame;
+
+    for (index = length & ~3; index != 0; index -= 4)
+    {
+        memcpy(&frame, samples + index - 4, 4);
+        if (frame != 0) break;
+    }
+
+    return length - index;
+}
+
+#ifdef _WIN32
+
+static int write_buffer(pcm_writer *writer)
+{
+    if (fwrite(writer->buffers[0], 1, writer->lengths[0], writer->f) != writer->lengths[0])
+    {
+        writer->error = 1;
+    }
+
+    writer->lengths[0] = 0;
+    return writer->error ? -1 : 0;
+}
+
+#else
+
+static int write_all(pcm_writer *writer, const uint8_t *data, uint32_t length)
+{
+    ssize_t written;
+
+    while (length != 0)
+    {
+        if (writer->regular_file)
+        {
+            written = pwrite(writer->fd, data, length, writer->file_offset);
+        }
+        else
+        {
+            written = write(writer->fd, data, length);
+        }
+
+        if (written <= 0) return -1;
+
+        data += written;
+        length -= written;
+        writer->file_offset += written;
+    };
+
+    return 0;
+}
+
+static void *writer_thread_proc(void *arg)
+{
+    pcm_writer *writer;
+    unsigned int index;
+    int result;
+
+    writer = (pcm_writer *)arg;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (1)
+    {
+        while ((writer->num_filled == 0) && !writer->finished)
+        {
+            pthread_cond_wait(&writer->cond_filled, &writer->mutex);
+        };
+
+        if (writer->num_filled == 0) break;
+
+        index = writer->write_index;
+        pthread_mutex_unlock(&writer->mutex);
+
+        // after an error the buffers are only released, so the calling thread isn't blocked
+        result = writer->error ? -1 : write_all(writer, writer->buffers[index], writer->lengths[index]);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (result < 0) writer->error = 1;
+        writer->write_index = (index + 1) % WRITER_NUM_BUFFERS;
+        writer->num_filled--;
+        pthread_cond_signal(&writer->cond_written);
+    };
+    pthread_mutex_unlock(&writer->mutex);
+
+    return NULL;
+}
+
+// passes the filled buffer to the writer thread and waits for a free buffer
+static int write_buffer(pcm_writer *writer)
+{
+    int error;
+
+    pthread_mutex_lock(&writer->mutex);
+
+    writer->num_filled++;
+    pthread_cond_signal(&writer->cond_filled);
+
+    writer->fill_index = (writer->fill_index + 1) % WRITER_NUM_BUFFERS;
+    while (writer->num_filled == WRITER_NUM_BUFFERS)
+    {
+        pthread_cond_wait(&writer->cond_written, &writer->mutex);
+    };
+
+    error = writer->error;
+    pthread_mutex_unlock(&writer->mutex);
+
+    writer->lengths[writer->fill_index] = 0;
+    return error ? -1 : 0;
+}
+
+#endif
+
+static void free_writer(pcm_writer *writer)
+{
+    unsigned int index;
+
+    for (index = 0; index < WRITER_NUM_BUFFERS; index++)
+    {
+        free(writer->buffers[index]);
+    }
+
+    free(writer);
+}
+
+pcm_writer *pcm_writer_open(const char *filename, unsigned int sample_rate, int trim_silence)
+{
+    pcm_writer *writer;
+#ifndef _WIN32
+    unsigned int index;
+    struct stat file_stat;
+#endif
+
+    writer = (pcm_writer *) calloc(1, sizeof(pcm_writer));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+
+    writer->trim_silence = trim_silence;
+
+#ifdef _WIN32
+    // data is written by the calling thread, so one buffer is enough
+    writer->buffers[0] = (uint8_t *) malloc(WRITER_BUFFER_SIZE);
+    if (writer->buffers[0] == NULL)
+    {
+        free_writer(writer);
+        return NULL;
+    }
+#else
+    for (index = 0; index < WRITER_NUM_BUFFERS; index++)
+    {
+        writer->buffers[index] = (uint8_t *) malloc(WRITER_BUFFER_SIZE);
+        if (writer->buffers[index] == NULL)
+        {
+            free_writer(writer);
+            return NULL;
+        }
+    }
+#endif
+
+    if (filename == NULL)
+    {
+        writer->sample_rate = 0;
+#ifdef _WIN32
+        if (_setmode(_fileno(stdout), _O_BINARY) == -1)
+        {
+            free_writer(writer);
+            return NULL;
+        }
+        writer->f = stdout;
+#else
+        writer->fd = STDOUT_FILENO;
+#endif
+    }
+    else
+    {
+        writer->sample_rate = sample_rate;
+#ifdef _WIN32
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+        if (fopen_s(&(writer->f), filename, "wb"))
+#else
+        writer->f = fopen(filename, "wb");
+        if (writer->f == NULL)
+#endif
+        {
+            free_writer(writer);
+            return NULL;
+        }
+#else
+        writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (writer->fd < 0)
+        {
+            free_writer(writer);
+            return NULL;
+        }
+#endif
+
+        // header is written with the samples and rewritten with the correct lengths at the end
+        create_wav_header(writer->buffers[0], sample_rate, 0);
+        writer->lengths[0] = WAV_HEADER_SIZE;
+    }
+
+#ifndef _WIN32
+    // standard output can be shared with other writers, so it's written at the current file offset
+    writer->regular_file = (filename != NULL) && (fstat(writer->fd, &file_stat) == 0) && S_ISREG(file_stat.st_mode);
+
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond_filled, NULL);
+    pthread_cond_init(&writer->cond_written, NULL);
+
+    if (pthread_create(&writer->thread, NULL, &writer_thread_proc, writer) != 0)
+    {
+        pthread_cond_destroy(&writer->cond_written);
+        pthread_cond_destroy(&writer->cond_filled);
+        pthread_mutex_destroy(&writer->mutex);
+        if (filename != NULL)
+        {
+            close(writer->fd);
+        }
+        free_writer(writer);
+        return NULL;
+    }
+#endif
+
+    return writer;
+}
+
+// samples = NULL writes silence
+static int write_samples(pcm_writer *writer, const uint8_t *samples, uint64_t length)
+{
+    unsigned int index, part;
+
+    writer->data_length += length;
+
+    while (length != 0)
+    {
+        index = writer->fill_index;
+        part = WRITER_BUFFER_SIZE - writer->lengths[index];
+        if (part > length) part = length;
+
+        if (samples != NULL)
+        {
+            copy_samples(writer->buffers[index] + writer->lengths[index], samples, part);
+            samples += part;
+        }
+        else
+        {
+            memset(writer->buffers[index] + writer->lengths[index], 0, part);
+        }
+        writer->lengths[index] += part;
+        length -= part;
+
+        if (writer->lengths[index] == WRITER_BUFFER_SIZE)
+        {
+            if (write_buffer(writer) < 0) return -1;
+        }
+    };
+
+    return writer->error ? -1 : 0;
+}
+
+int pcm_writer_write(pcm_writer *writer, const uint8_t *samples, unsigned int length)
+{
+    unsigned int skipped, trailing;
+
+    if (!writer->trim_silence)
+    {
+        return write_samples(writer, samples, length);
+    }
+
+    if (!writer->sound_started)
+    {
+        skipped = skip_silence(samples, length);
+        if (skipped == length) return writer->error ? -1 : 0;
+
+        writer->sound_started = 1;
+        samples += skipped;
+        length -= skipped;
+    }
+
+    trailing = trailing_silence(samples, length);
+    if (trailing == length)
+    {
+        writer->pending_silence += length;
+        return writer->error ? -1 : 0;
+    }
+
+    // silence between sounds is kept
+    if (writer->pending_silence != 0)
+    {
+        if (write_samples(writer, NULL, writer->pending_silence) < 0) return -1;
+        writer->pending_silence = 0;
+    }
+
+    if (write_samples(writer, samples, length - trailing) < 0) return -1;
+
+    writer->pending_silence = trailing;
+    return 0;
+}
+
+int pcm_writer_close(pcm_writer *writer)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+    int error;
+
+    if (writer->lengths[writer->fill_index] != 0)
+    {
+        write_buffer(writer);
+    }
+
+#ifdef _WIN32
+    if ((writer->sample_rate != 0) && !writer->error)
+    {
+        create_wav_header(header, writer->sample_rate, (uint32_t)writer->data_length);
+        if ((fseek(writer->f, 0, SEEK_SET) != 0) || (fwrite(header, 1, WAV_HEADER_SIZE, writer->f) != WAV_HEADER_SIZE))
+        {
+            writer->error = 1;
+        }
+    }
+
+    if (writer->sample_rate != 0)
+    {
+        if (fclose(writer->f) != 0) writer->error = 1;
+    }
+    else
+    {
+        if (fflush(writer->f) != 0) writer->error = 1;
+    }
+#else
+    pthread_mutex_lock(&writer->mutex);
+    writer->finished = 1;
+    pthread_cond_signal(&writer->cond_filled);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->cond_written);
+    pthread_cond_destroy(&writer->cond_filled);
+    pthread_mutex_destroy(&writer->mutex);
+
+    if (writer->sample_rate != 0)
+    {
+        // header can't be rewritten when the output isn't a regular file
+        if (!writer->error && writer->regular_file)
+        {
+            create_wav_header(header, writer->sample_rate, (uint32_t)writer->data_length);
+            if (pwrite(writer->fd, header, WAV_HEADER_SIZE, 0) != WAV_HEADER_SIZE)
+            {
+                writer->error = 1;
+            }
+        }
+
+        if (close(writer->fd) != 0) writer->error = 1;
+    }
+#endif
+
+    error = writer->error;
+    free_writer(writer);
+    return error ? -1 : 0;
+}
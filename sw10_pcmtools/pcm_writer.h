@@ -0,0 +1,57 @@
+/**
+ *
+ *  Copyright (C) 2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_PCM_WRITER_H_INCLUDED_)
+#define _PCM_WRITER_H_INCLUDED_
+
+// Output writer for 16-bit stereo audio
+//
+// Samples are collected in large buffers which are written by a separate thread, so the rendering doesn't wait
+// for the file system (on Windows the buffers are written by the calling thread). Samples are converted
+// to little-endian while they are copied to the buffers.
+//
+// Leading and trailing digital silence can be trimmed while the samples are written - trailing silence is only
+// counted and written when it's followed by other samples.
+
+#include <stdint.h>
+
+typedef struct pcm_writer pcm_writer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// filename NULL = raw data to standard output, otherwise wav file with the given sample rate
+// returns NULL on error
+extern pcm_writer *pcm_writer_open(const char *filename, unsigned int sample_rate, int trim_silence);
+// samples are in native byte order, returns 0 on success
+extern int pcm_writer_write(pcm_writer *writer, const uint8_t *samples, unsigned int length);
+// writes the remaining samples and the wav header, returns 0 on success
+extern int pcm_writer_close(pcm_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
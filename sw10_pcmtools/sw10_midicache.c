@@ -0,0 +1,143 @@
+/**
+ *
+ *  Copyright (C) 2022-2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+// Creates precompiled events of MIDI files in the cache directory (event files aren't created when they're valid).
+// sw10_pcmconvert with the same cache directory (option -c) reads the events from the event files instead of parsing the MIDI files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi_loader.h"
+
+
+static const char *arg_cache = NULL;
+
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "sw10_midicache";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - precompile MIDI files for CASIO Software Sound Generator SW-10 tools\n"
+        "Usage: %s [OPTIONS]... FILE...\n"
+        "  -c PATH  Cache directory for precompiled MIDI events\n"
+        "  -h       Help\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+static int read_arguments(int argc, char *argv[])
+{
+    int i, num_files;
+
+    num_files = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'c': // cache directory
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_cache = argv[i];
+                    }
+                    break;
+                case 'h':
+                default:
+                    usage(argv[0]);
+                    break;
+            }
+        }
+        else
+        {
+            num_files++;
+        }
+    }
+
+    if ((arg_cache == NULL) || (num_files == 0))
+    {
+        usage(argv[0]);
+    }
+
+    return num_files;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const status_messages[3] = { "valid", "created", "not written" };
+    int i, num_files, retval, cache_status;
+    unsigned int num_valid, num_created, num_errors;
+
+    num_files = read_arguments(argc, argv);
+
+    num_valid = num_created = num_errors = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            // skip option value
+            i++;
+            continue;
+        }
+
+        retval = update_midi_cache(argv[i], arg_cache, &cache_status);
+        if (retval)
+        {
+            num_errors++;
+            fprintf(stderr, "%s: error loading MIDI file (%i)\n", argv[i], retval);
+            continue;
+        }
+
+        if (cache_status == MIDI_CACHE_VALID) num_valid++;
+        else if (cache_status == MIDI_CACHE_CREATED) num_created++;
+        else num_errors++;
+
+        printf("%s: %s\n", argv[i], status_messages[cache_status]);
+    }
+
+    printf("%i files: %u valid, %u created, %u errors\n", num_files, num_valid, num_created, num_errors);
+
+    return (num_errors != 0) ? 2 : 0;
+}
@@ -45,6 +45,10 @@
 #include "dll_loader.h"
 #endif
 
+#if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
+#include "pcm_writer.h"
+#endif
+
 #if PCM_TOOL == PCM_CONVERT_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL
 #include "VLSG.h"
 #else
@@ -70,27 +74,13 @@ enum ParameterType
     #include <dirent.h>
 #endif
 
-#if defined(_MSC_VER)
-
-#undef BIG_ENDIAN_BYTE_ORDER
-
-#elif defined(__BYTE_ORDER__)
-
-#if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
-#define BIG_ENDIAN_BYTE_ORDER
-#else
-#undef BIG_ENDIAN_BYTE_ORDER
-#endif
-
-#else
-
-#include <endian.h>
-#if (__BYTE_ORDER == __BIG_ENDIAN)
-#define BIG_ENDIAN_BYTE_ORDER
-#else
-#undef BIG_ENDIAN_BYTE_ORDER
-#endif
-
+// batch mode converts files in parallel using separate synthesizer instances
+#if PCM_TOOL == PCM_CONVERT_INTERNAL && !defined(_WIN32)
+#define BATCH_MODE
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #endif
 
 #if defined(__GNUC__)
@@ -107,7 +97,19 @@ static const char *arg_output = NULL;
 static const char *arg_dll = "VLSG.DLL";
 static const char *arg_rom = "ROMSXGM.BIN";
 static const char *arg_exttool = NULL;
+static const char *arg_cache = NULL;
 static int wav_to_file = 1;
+static int tail_length = 0;
+#if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
+static int trim_silence = 0;
+static uint32_t seek_start = 0;
+#endif
+static uint32_t seek_end = 0;
+#ifdef BATCH_MODE
+static const char *arg_batch = NULL;
+static const char *arg_configs = NULL;
+static int num_workers = 0;
+#endif
 
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
 static void *hVLSG;
@@ -118,7 +120,7 @@ static uint32_t outbuf_counter;
 static uint32_t current_time;
 
 static unsigned int timediv;
-static midi_event_info *midi_events;
+static midi_parser *midi_file;
 
 static int frequency, polyphony, reverb_effect;
 
@@ -253,7 +255,58 @@ static void *load_rom_file(const char *romname)
     return mem;
 }
 
-static void lsgWrite(uint8_t *event, unsigned int length)
+// output with smaller values is considered silent when rendering the tail
+#define SILENCE_THRESHOLD 16
+
+static int is_silent_output(const uint8_t *buffer, unsigned int length)
+{
+    const int16_t *samples;
+    unsigned int index;
+
+    samples = (const int16_t *)buffer;
+    for (index = 0; index < length / 2; index++)
+    {
+        if ((samples[index] > SILENCE_THRESHOLD) || (samples[index] < -SILENCE_THRESHOLD))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// returns nonzero when the rendering continues after the last event
+static int continue_tail(uint32_t time, uint32_t end_time, int silent)
+{
+    if (tail_length == 0)
+    {
+        // fixed tail
+        return time < end_time + 112;
+    }
+
+    // the engine delays the events by 100 ms, so the output is not checked for silence until the last events (plus one block) were processed
+    // then until there are no active voices and the output (reverb) is silent, but at most the maximum tail length
+    return (time < end_time + 112) || (!silent && (time < end_time + tail_length));
+}
+
+// start time of the output block in milliseconds
+static uint32_t block_start_time(unsigned int num_calls)
+{
+    return ((uint64_t)num_calls * 256 * 1000) / 11025;
+}
+
+#if PCM_TOOL == PCM_CONVERT_INTERNAL
+// the reverb is not processed when fast-forwarding, so the last part before the seek start is rendered normally (in milliseconds)
+#define SEEK_WARMUP 2000
+
+// returns nonzero when the output block before the seek start doesn't have to be mixed
+static int fast_forward_block(uint32_t block_time)
+{
+    return (seek_start > SEEK_WARMUP) && (block_time + SEEK_WARMUP < seek_start);
+}
+#endif
+
+static void lsgWrite(const uint8_t *event, unsigned int length)
 {
     uint8_t event_time[4];
 
@@ -272,6 +325,571 @@ static void lsgWrite(uint8_t *event, unsigned int length)
     }
 }
 
+#ifdef BATCH_MODE
+typedef struct
+{
+    int frequency;
+    int polyphony;
+    int reverb_effect;
+} render_config;
+
+typedef struct
+{
+    char *input;
+    char *output;
+    off_t size;
+    render_config config;
+    int result;
+    unsigned int num_calls;
+    double render_time;
+} batch_file;
+
+typedef struct
+{
+    pthread_t thread;
+    VLSG_Instance *instance;
+    uint32_t current_time;
+    uint8_t buffer[65536];
+} batch_worker;
+
+static batch_file *batch_files;
+static unsigned int num_batch_files, max_batch_files;
+static unsigned int batch_next_file;
+static pthread_mutex_t batch_print_mutex = PTHREAD_MUTEX_INITIALIZER;
+// in multi-configuration mode all configurations use the same events
+static midi_event_stream *batch_stream;
+
+
+static double get_time_seconds(void)
+{
+    struct timespec _tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &_tp);
+
+    return _tp.tv_sec + (_tp.tv_nsec / 1000000000.0);
+}
+
+static uint32_t batch_get_time(void *context)
+{
+    return ((batch_worker *)context)->current_time;
+}
+
+static void batch_write(batch_worker *worker, const uint8_t *event, unsigned int length)
+{
+    uint8_t event_time[4];
+
+    WRITE_LE_UINT32(event_time, worker->current_time);
+
+    for (; length != 0; length--,event++)
+    {
+        VLSG_InstanceAddMidiData(worker->instance, event_time, 4);
+        VLSG_InstanceAddMidiData(worker->instance, event, 1);
+    }
+}
+
+// output path is the template with %s replaced by the name
+static char *get_batch_output_path(const char *name, size_t name_length)
+{
+    const char *pattern;
+    char *output;
+
+    pattern = strstr(arg_output, "%s");
+
+    output = (char *) malloc(strlen(arg_output) + name_length + 1);
+    if (output == NULL) return NULL;
+
+    memcpy(output, arg_output, pattern - arg_output);
+    memcpy(output + (pattern - arg_output), name, name_length);
+    strcpy(output + (pattern - arg_output) + name_length, pattern + 2);
+
+    return output;
+}
+
+static batch_file *new_batch_file(void)
+{
+    batch_file *file;
+
+    if (num_batch_files == max_batch_files)
+    {
+        max_batch_files = (max_batch_files != 0) ? (2 * max_batch_files) : 256;
+        file = (batch_file *) realloc(batch_files, max_batch_files * sizeof(batch_file));
+        if (file == NULL) return NULL;
+        batch_files = file;
+    }
+
+    file = &(batch_files[num_batch_files]);
+    memset(file, 0, sizeof(batch_file));
+    return file;
+}
+
+static int add_batch_file(const char *input)
+{
+    struct stat file_stat;
+    batch_file *file;
+    const char *name, *extension;
+
+    file = new_batch_file();
+    if (file == NULL) return -1;
+
+    file->input = strdup(input);
+    if (file->input == NULL) return -1;
+
+    // name of the output file is the input file name without extension
+    name = strrchr(input, '/');
+    name = (name != NULL) ? (name + 1) : input;
+    extension = strrchr(name, '.');
+
+    file->output = get_batch_output_path(name, ((extension != NULL) && (extension != name)) ? (size_t)(extension - name) : strlen(name));
+    if (file->output == NULL)
+    {
+        free(file->input);
+        return -1;
+    }
+
+    file->size = (stat(input, &file_stat) == 0) ? file_stat.st_size : 0;
+    file->config.frequency = frequency;
+    file->config.polyphony = polyphony;
+    file->config.reverb_effect = reverb_effect;
+
+    num_batch_files++;
+    return 0;
+}
+
+static int is_midi_file_name(const char *name)
+{
+    const char *extension;
+
+    extension = strrchr(name, '.');
+    if (extension == NULL) return 0;
+
+    return (0 == strcasecmp(extension, ".mid")) || (0 == strcasecmp(extension, ".midi")) || (0 == strcasecmp(extension, ".kar")) || (0 == strcasecmp(extension, ".rmi"));
+}
+
+// batch input is a directory with MIDI files or a text file with one path per line
+static int read_batch_input(void)
+{
+    struct stat file_stat;
+    DIR *dir;
+    struct dirent *entry;
+    FILE *f;
+    char path[4096];
+    size_t length;
+
+    if (stat(arg_batch, &file_stat) != 0)
+    {
+        return -1;
+    }
+
+    if (S_ISDIR(file_stat.st_mode))
+    {
+        dir = opendir(arg_batch);
+        if (dir == NULL) return -1;
+
+        while (1)
+        {
+            entry = readdir(dir);
+            if (entry == NULL) break;
+
+            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) continue;
+            if (!is_midi_file_name(entry->d_name)) continue;
+
+            if ((size_t)snprintf(path, sizeof(path), "%s/%s", arg_batch, entry->d_name) >= sizeof(path)) continue;
+
+            if (add_batch_file(path) < 0)
+            {
+                closedir(dir);
+                return -2;
+            }
+        };
+
+        closedir(dir);
+        return 0;
+    }
+
+    f = fopen(arg_batch, "rt");
+    if (f == NULL) return -1;
+
+    while (fgets(path, sizeof(path), f) != NULL)
+    {
+        length = strlen(path);
+        while ((length != 0) && ((path[length - 1] == '\n') || (path[length - 1] == '\r')))
+        {
+            length--;
+        }
+        path[length] = 0;
+
+        if ((length == 0) || (path[0] == '#')) continue;
+
+        if (add_batch_file(path) < 0)
+        {
+            fclose(f);
+            return -2;
+        }
+    };
+
+    fclose(f);
+    return 0;
+}
+
+static int add_render_config(int frequency, int polyphony, int reverb_effect)
+{
+    static const int polyphony_voices[4] = { 24, 32, 48, 64 };
+    batch_file *file;
+    char name[32];
+
+    file = new_batch_file();
+    if (file == NULL) return -1;
+
+    file->input = strdup(arg_input);
+    if (file->input == NULL) return -1;
+
+    // name of the output file is the configuration, e.g. 44100_64v_r2
+    sprintf(name, "%i_%iv_r%i", 11025 << frequency, polyphony_voices[polyphony], reverb_effect);
+
+    file->output = get_batch_output_path(name, strlen(name));
+    if (file->output == NULL)
+    {
+        free(file->input);
+        return -1;
+    }
+
+    // configurations with the most work are rendered first
+    file->size = (off_t)(1 << frequency) * polyphony_voices[polyphony];
+    file->config.frequency = frequency;
+    file->config.polyphony = polyphony;
+    file->config.reverb_effect = reverb_effect;
+
+    num_batch_files++;
+    return 0;
+}
+
+// configurations are three digits (frequency, polyphony, reverb effect) separated by commas, or "all" for all configurations
+static int read_render_configs(void)
+{
+    const char *ptr;
+    int f, p, e;
+
+    if (strcmp(arg_configs, "all") == 0)
+    {
+        for (f = 0; f <= 2; f++)
+        {
+            for (p = 0; p <= 3; p++)
+            {
+                for (e = 0; e <= 2; e++)
+                {
+                    if (add_render_config(f, p, e) < 0) return -2;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    ptr = arg_configs;
+    while (1)
+    {
+        if ((ptr[0] < '0') || (ptr[0] > '2') || (ptr[1] < '0') || (ptr[1] > '3') || (ptr[2] < '0') || (ptr[2] > '2') || ((ptr[3] != ',') && (ptr[3] != 0)))
+        {
+            fprintf(stderr, "invalid configuration: \"%.*s\" (frequency 0 - 2, polyphony 0 - 3, reverb effect 0 - 2)\n", (int)strcspn(ptr, ","), ptr);
+            return -1;
+        }
+
+        if (add_render_config(ptr[0] - '0', ptr[1] - '0', ptr[2] - '0') < 0) return -2;
+
+        if (ptr[3] == 0) break;
+        ptr += 4;
+    };
+
+    return 0;
+}
+
+// largest files are converted first, so the last files don't keep one thread busy at the end
+static int compare_batch_files(const void *a, const void *b)
+{
+    off_t size1, size2;
+
+    size1 = ((const batch_file *)a)->size;
+    size2 = ((const batch_file *)b)->size;
+
+    return (size1 > size2) ? -1 : ((size1 < size2) ? 1 : 0);
+}
+
+static int convert_batch_file(batch_worker *worker, batch_file *file)
+{
+    unsigned int num_calls, bytes_per_call;
+    unsigned int timediv;
+    int frequency;
+    uint32_t outbuf_counter;
+    midi_parser *midi_file;
+    midi_event_iterator cur_event;
+    int more_events, active_voices, tail_silent;
+    pcm_writer *fout;
+    int return_value;
+
+    if (batch_stream != NULL)
+    {
+        midi_file = NULL;
+    }
+    else if ((arg_cache != NULL) ? open_midi_parser_cached(file->input, arg_cache, &timediv, &midi_file) : open_midi_parser(file->input, &timediv, &midi_file))
+    {
+        return 4;
+    }
+
+    frequency = file->config.frequency;
+
+    // PlaybackStart doesn't reset all synthesizer state, so every file uses new instance to get the same output as single file conversion
+    worker->instance = VLSG_CreateInstance();
+    if (worker->instance == NULL)
+    {
+        if (midi_file != NULL) close_midi_parser(midi_file);
+        return 2;
+    }
+
+    VLSG_InstanceSetParameter(worker->instance, PARAMETER_Frequency, frequency);
+    VLSG_InstanceSetParameter(worker->instance, PARAMETER_Polyphony, 0x10 + file->config.polyphony);
+    VLSG_InstanceSetParameter(worker->instance, PARAMETER_Effect, 0x20 + file->config.reverb_effect);
+    VLSG_InstanceSetParameter(worker->instance, PARAMETER_ROMAddress, (uintptr_t)rom_address);
+    VLSG_InstanceSetParameter(worker->instance, PARAMETER_OutputBuffer, (uintptr_t)worker->buffer);
+    VLSG_InstanceSetFunc_GetTime(worker->instance, &batch_get_time, worker);
+
+    fout = pcm_writer_open(file->output, 11025 << frequency, trim_silence);
+    if (fout == NULL)
+    {
+        VLSG_DestroyInstance(worker->instance);
+        if (midi_file != NULL) close_midi_parser(midi_file);
+        return 5;
+    }
+
+    bytes_per_call = 4 * (256 << frequency);
+
+    return_value = 0;
+
+    worker->current_time = 0;
+    VLSG_InstancePlaybackStart(worker->instance);
+
+    // same timing as in single file conversion
+    outbuf_counter = 0;
+    num_calls = 0;
+    if (midi_file != NULL)
+    {
+        more_events = midi_parser_first(&cur_event, midi_file);
+    }
+    else
+    {
+        // every configuration has its own iterator of the shared events
+        more_events = midi_event_first(&cur_event, batch_stream);
+    }
+    tail_silent = 0;
+    while ((return_value == 0) && (more_events || continue_tail(worker->current_time, (midi_file != NULL) ? midi_parser_end_time(midi_file) : batch_stream->end_time, tail_silent)))
+    {
+        uint32_t next_time, block_time;
+
+        block_time = block_start_time(num_calls);
+        if ((seek_end != 0) && (block_time >= seek_end)) break;
+
+        num_calls++;
+
+        next_time = ((num_calls * 256 + 128) * (uint64_t)1000) / 11025;
+        while (more_events && (cur_event.time <= next_time))
+        {
+            worker->current_time = cur_event.time;
+            if (worker->current_time == 0) worker->current_time = 1; // !!! events with zero timestamp are ignored
+
+            if (cur_event.data[0] != 0xff) // skip meta events
+            {
+                batch_write(worker, cur_event.data, cur_event.len);
+            }
+
+            more_events = midi_event_next(&cur_event);
+        }
+
+        worker->current_time = next_time;
+
+        if (seek_start != 0)
+        {
+            VLSG_InstanceSetParameter(worker->instance, PARAMETER_FastForward, fast_forward_block(block_time));
+        }
+
+        active_voices = VLSG_InstanceFillOutputBuffer(worker->instance, outbuf_counter);
+
+        if (tail_length != 0)
+        {
+            tail_silent = (active_voices == 0) && is_silent_output(&(worker->buffer[(outbuf_counter & 0x0f) * bytes_per_call]), bytes_per_call);
+        }
+
+        if ((block_time >= seek_start) && (pcm_writer_write(fout, &(worker->buffer[(outbuf_counter & 0x0f) * bytes_per_call]), bytes_per_call) != 0))
+        {
+            return_value = 6;
+            break;
+        }
+
+        outbuf_counter++;
+    }
+
+    VLSG_InstancePlaybackStop(worker->instance);
+    VLSG_DestroyInstance(worker->instance);
+    if (midi_file != NULL) close_midi_parser(midi_file);
+
+    // wav header is written when the remaining samples are written
+    if (pcm_writer_close(fout) != 0)
+    {
+        return_value = 6;
+    }
+
+    file->num_calls = num_calls;
+    return return_value;
+}
+
+static void *batch_worker_proc(void *arg)
+{
+    static const char *const error_messages[7] = { NULL, NULL, "error allocating synthesizer", NULL, "error loading MIDI file", "error opening output file", "error writing to output file" };
+    batch_worker *worker;
+    batch_file *file;
+    unsigned int index;
+    double start_time, audio_time;
+
+    worker = (batch_worker *)arg;
+
+    // every worker takes the next unconverted file, so faster workers convert more files
+    while (1)
+    {
+        index = __sync_fetch_and_add(&batch_next_file, 1);
+        if (index >= num_batch_files) break;
+
+        file = &(batch_files[index]);
+
+        start_time = get_time_seconds();
+        file->result = convert_batch_file(worker, file);
+        file->render_time = get_time_seconds() - start_time;
+
+        pthread_mutex_lock(&batch_print_mutex);
+        if (file->result == 0)
+        {
+            audio_time = (file->num_calls * (256.0 * 1000 / 11025)) / 1000;
+            printf("%s: %.1f s in %.2f s (%.1fx)\n", (batch_stream != NULL) ? file->output : file->input, audio_time, file->render_time, (file->render_time > 0) ? (audio_time / file->render_time) : 0.0);
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s\n", (batch_stream != NULL) ? file->output : file->input, error_messages[file->result]);
+        }
+        pthread_mutex_unlock(&batch_print_mutex);
+    };
+
+    return NULL;
+}
+
+static int run_batch(void)
+{
+    batch_worker *workers;
+    unsigned int index, num_converted;
+    int num_started, err;
+    double start_time, total_time, audio_time;
+    uint64_t output_bytes;
+
+    if (arg_configs != NULL)
+    {
+        if (read_render_configs() < 0)
+        {
+            fprintf(stderr, "error reading configurations\n");
+            return 4;
+        }
+
+        // MIDI file is parsed only once for all configurations
+        if (load_midi_file(arg_input, &timediv, &batch_stream))
+        {
+            fprintf(stderr, "error loading MIDI file\n");
+            return 4;
+        }
+
+        // one thread per configuration
+        if (num_workers == 0) num_workers = num_batch_files;
+    }
+    else if (read_batch_input() < 0)
+    {
+        fprintf(stderr, "error reading batch input\n");
+        return 4;
+    }
+
+    if (num_batch_files == 0)
+    {
+        fprintf(stderr, "no input files\n");
+        return 4;
+    }
+
+    qsort(batch_files, num_batch_files, sizeof(batch_file), compare_batch_files);
+
+    if (num_workers == 0)
+    {
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_workers < 1) num_workers = 1;
+    }
+    if ((unsigned int)num_workers > num_batch_files) num_workers = num_batch_files;
+
+    workers = (batch_worker *) calloc(num_workers, sizeof(batch_worker));
+    if (workers == NULL)
+    {
+        if (batch_stream != NULL) free_midi_data(batch_stream);
+        fprintf(stderr, "error allocating memory\n");
+        return 2;
+    }
+
+    start_time = get_time_seconds();
+
+    num_started = 0;
+    for (index = 0; index < (unsigned int)num_workers; index++)
+    {
+        err = pthread_create(&(workers[index].thread), NULL, &batch_worker_proc, &(workers[index]));
+        if (err != 0)
+        {
+            fprintf(stderr, "error creating thread: %i\n", err);
+            break;
+        }
+        num_started++;
+    }
+
+    // files are converted in this thread when no thread was started
+    if (num_started == 0)
+    {
+        batch_worker_proc(&(workers[0]));
+    }
+
+    for (index = 0; index < (unsigned int)num_started; index++)
+    {
+        pthread_join(workers[index].thread, NULL);
+    }
+
+    total_time = get_time_seconds() - start_time;
+
+    free(workers);
+
+    num_converted = 0;
+    audio_time = 0;
+    output_bytes = 0;
+    for (index = 0; index < num_batch_files; index++)
+    {
+        if (batch_files[index].result == 0)
+        {
+            num_converted++;
+            audio_time += (batch_files[index].num_calls * (256.0 * 1000 / 11025)) / 1000;
+            output_bytes += 44 + (uint64_t)batch_files[index].num_calls * (4 * (256 << batch_files[index].config.frequency));
+        }
+
+        free(batch_files[index].input);
+        free(batch_files[index].output);
+    }
+    free(batch_files);
+
+    printf("Converted %u of %u %s using %i threads: %.1f s in %.2f s (%.1fx), %.1f MB/s\n", num_converted, num_batch_files, (batch_stream != NULL) ? "configurations" : "files", (num_started != 0) ? num_started : 1, audio_time, total_time, (total_time > 0) ? (audio_time / total_time) : 0.0, (total_time > 0) ? (output_bytes / (total_time * 1000000)) : 0.0);
+
+    if (batch_stream != NULL)
+    {
+        free_midi_data(batch_stream);
+    }
+
+    return (num_converted == num_batch_files) ? 0 : 9;
+}
+#endif
+
 
 static void usage(const char *progname)
 {
@@ -308,11 +926,20 @@ static void usage(const char *progname)
     printf(
         "%s - CASIO Software Sound Generator SW-10 tool\n"
         "Usage: %s [OPTIONS]...\n"
-        "  -i PATH  Input path (path to .mid)\n"
+        "  -i PATH  Input path (path to .mid, - = standard input)\n"
+        "  -c PATH  Cache directory for precompiled MIDI events\n"
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
         "  -s       Output raw data do stdout\n"
         "  -o PATH  Output path (path to .wav)\n"
 #endif
+#ifdef BATCH_MODE
+        "  -b PATH  Batch input (directory with MIDI files or file with list of paths), output path is a template\n"
+        "           where %%s is replaced by the input file name without extension (e.g. out/%%s.wav)\n"
+        "  -m LIST  Render configurations of one input file, output path is a template where %%s is replaced\n"
+        "           by the configuration (e.g. 44100_64v_r2), LIST is \"all\" or comma-separated configurations\n"
+        "           consisting of frequency, polyphony and reverb effect values (e.g. 202,232)\n"
+        "  -j NUM   Number of threads in batch mode (1 - 256, default = number of CPUs or configurations)\n"
+#endif
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
         "  -d PATH  Dll path (path to VLSG.DLL)\n"
 #endif
@@ -323,6 +950,12 @@ static void usage(const char *progname)
         "  -f NUM   Frequency (0 = 11025 Hz, 1 = 22050 Hz, 2 = 44100 Hz)\n"
         "  -p NUM   Polyphony (0 = 24 voices, 1 = 32 voices, 2 = 48 voices, 3 = 64 voices)\n"
         "  -e NUM   Reverb effect (0 = off, 1 = reverb 1, 2 = reverb 2)\n"
+#if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
+        "  -x NUM   Render the tail until silence, maximal tail length in milliseconds (1 - 60000, default = fixed 112 ms tail)\n"
+        "  -z       Trim leading and trailing silence\n"
+        "  -a NUM   Start of the output in milliseconds (0 - 86400000), the part before it is fast-forwarded\n"
+        "  -u NUM   End of the output in milliseconds (1 - 86400000, default = end of the MIDI file)\n"
+#endif
         "  -h       Help\n",
         basename,
         progname
@@ -381,9 +1014,43 @@ int main(int argc, char *argv[])
                             arg_rom = argv[i];
                         }
                         break;
+                    case 'c': // cache directory
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            arg_cache = argv[i];
+                        }
+                        break;
                     case 's': // stdout
                         wav_to_file = 0;
                         break;
+#ifdef BATCH_MODE
+                    case 'b': // batch input
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            arg_batch = argv[i];
+                        }
+                        break;
+                    case 'm': // configurations
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            arg_configs = argv[i];
+                        }
+                        break;
+                    case 'j': // threads
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            j = atoi(argv[i]);
+                            if (j >= 1 && j <= 256)
+                            {
+                                num_workers = j;
+                            }
+                        }
+                        break;
+#endif
                     case 't': // tool
                         if ((i + 1) < argc)
                         {
@@ -424,6 +1091,44 @@ int main(int argc, char *argv[])
                             }
                         }
                         break;
+#if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
+                    case 'x': // tail length
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            j = atoi(argv[i]);
+                            if (j >= 1 && j <= 60000)
+                            {
+                                tail_length = j;
+                            }
+                        }
+                        break;
+                    case 'z': // trim silence
+                        trim_silence = 1;
+                        break;
+                    case 'a': // seek start
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            j = atoi(argv[i]);
+                            if (j >= 0 && j <= 86400000)
+                            {
+                                seek_start = j;
+                            }
+                        }
+                        break;
+                    case 'u': // seek end
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            j = atoi(argv[i]);
+                            if (j >= 1 && j <= 86400000)
+                            {
+                                seek_end = j;
+                            }
+                        }
+                        break;
+#endif
                     case 'h': // help
                         usage(argv[0]);
                     default:
@@ -437,6 +1142,42 @@ int main(int argc, char *argv[])
         }
     }
 
+#ifdef BATCH_MODE
+    if ((arg_batch != NULL) || (arg_configs != NULL))
+    {
+        if ((arg_batch != NULL) && (arg_configs != NULL))
+        {
+            fprintf(stderr, "batch input and configurations can't be used together\n");
+            usage(argv[0]);
+        }
+
+        if ((arg_configs != NULL) && (arg_input == NULL))
+        {
+            fprintf(stderr, "no input file\n");
+            usage(argv[0]);
+        }
+
+        if ((arg_output == NULL) || (strstr(arg_output, "%s") == NULL))
+        {
+            fprintf(stderr, "no output template\n");
+            usage(argv[0]);
+        }
+
+        // ROM is loaded only once for all files (configurations)
+        rom_address = load_rom_file(arg_rom);
+        if (rom_address == NULL)
+        {
+            fprintf(stderr, "error loading ROM file\n");
+            return 3;
+        }
+
+        return_value = run_batch();
+
+        free(rom_address);
+        return return_value;
+    }
+#endif
+
     if (arg_input == NULL)
     {
         fprintf(stderr, "no input file\n");
@@ -478,8 +1219,8 @@ int main(int argc, char *argv[])
         return 3;
     }
 
-    // load MIDI file
-    if (load_midi_file(arg_input, &timediv, &midi_events))
+    // open MIDI file, events are parsed during playback (or read from the event file in the cache directory)
+    if ((arg_cache != NULL) ? open_midi_parser_cached(arg_input, arg_cache, &timediv, &midi_file) : open_midi_parser(arg_input, &timediv, &midi_file))
     {
         free(rom_address);
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
@@ -574,75 +1315,24 @@ int main(int argc, char *argv[])
 
     // play midi
     {
-        unsigned int num_calls, remaining_events;
-        midi_event_info *cur_event;
+        unsigned int num_calls;
+        int more_events, active_voices, tail_silent;
+        midi_event_iterator cur_event;
 
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
-        FILE *fout;
+        pcm_writer *fout;
 
-        if (wav_to_file)
+        // samples are written by writer thread, wav header is written at the end
+        fout = pcm_writer_open(wav_to_file ? arg_output : NULL, 11025 << frequency, trim_silence);
+        if (fout == NULL)
         {
-            uint8_t wav_header[44];
-            uint8_t *header_ptr;
-
-#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-            if (fopen_s(&fout, arg_output, "wb"))
-#else
-            fout = fopen(arg_output, "wb");
-            if (fout == NULL)
-#endif
-            {
-                free_midi_data(midi_events);
-                free(rom_address);
+            close_midi_parser(midi_file);
+            free(rom_address);
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
-                free_vlsg_dll(hVLSG);
-#endif
-                fprintf(stderr, "error opening output file\n");
-                return 5;
-            }
-
-            // wav header
-            header_ptr = wav_header;
-            WRITE_LE_UINT32(header_ptr, 0x46464952);        // "RIFF" tag
-            WRITE_LE_UINT32(header_ptr + 4, 36);            // RIFF length - filled later
-            WRITE_LE_UINT32(header_ptr + 8, 0x45564157);    // "WAVE" tag
-            header_ptr += 12;
-
-            // fmt chunk
-            WRITE_LE_UINT32(header_ptr, 0x20746D66);    // "fmt " tag
-            WRITE_LE_UINT32(header_ptr + 4, 16);        // chunk length
-            header_ptr += 8;
-
-            // PCMWAVEFORMAT structure
-            WRITE_LE_UINT16(header_ptr, 1);                             // wFormatTag - 1 = PCM
-            WRITE_LE_UINT16(header_ptr + 2, 2);                         // nChannels - 2 = stereo
-            WRITE_LE_UINT32(header_ptr + 4, 11025 << frequency);        // nSamplesPerSec
-            WRITE_LE_UINT32(header_ptr + 8, 4 * (11025 << frequency));  // nAvgBytesPerSec
-            WRITE_LE_UINT16(header_ptr + 12, 4);                        // nBlockAlign
-            WRITE_LE_UINT16(header_ptr + 14, 16);                       // wBitsPerSample
-            header_ptr += 16;
-
-            // data chunk
-            WRITE_LE_UINT32(header_ptr, 0x61746164);    // "data" tag
-            WRITE_LE_UINT32(header_ptr + 4, 0);         // chunk length - filled later
-            header_ptr += 8;
-
-            if (fwrite(wav_header, 1, 44, fout) != 44)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 6;
-            }
-        }
-        else
-        {
-#ifdef _WIN32
-            if (_setmode(_fileno(stdout), _O_BINARY) == -1)
-            {
-                fprintf(stderr, "error changing output mode to binary\n");
-                return 6;
-            }
+            free_vlsg_dll(hVLSG);
 #endif
-            fout = stdout;
+            fprintf(stderr, "error opening output file\n");
+            return 5;
         }
 #endif
 
@@ -674,47 +1364,54 @@ int main(int argc, char *argv[])
 #endif
 
         num_calls = 0;
-        remaining_events = midi_events[0].len;
-        cur_event = midi_events + 1;
-        while (current_time < midi_events[0].time + 112)
+        more_events = midi_parser_first(&cur_event, midi_file);
+        tail_silent = 0;
+        while (more_events || continue_tail(current_time, midi_parser_end_time(midi_file), tail_silent))
         {
-            uint32_t next_time;
+            uint32_t next_time, block_time;
+
+            block_time = block_start_time(num_calls);
+            if ((seek_end != 0) && (block_time >= seek_end)) break;
+
             num_calls++;
 
             next_time = ((num_calls * 256 + 128) * (uint64_t)1000) / 11025;
-            while ((remaining_events > 0) && (cur_event->time <= next_time))
+            while (more_events && (cur_event.time <= next_time))
             {
-                current_time = cur_event->time;
+                current_time = cur_event.time;
                 if (current_time == 0) current_time = 1; // !!! events with zero timestamp are ignored
 
-                if (cur_event->len <= 8)
-                {
-                    if (cur_event->data[0] != 0xff) // skip meta events
-                    {
-                        lsgWrite(cur_event->data, cur_event->len);
-                    }
-                }
-                else
+                if (cur_event.data[0] != 0xff) // skip meta events
                 {
-                    if (cur_event->sysex[0] != 0xff) // skip meta events
-                    {
-                        lsgWrite(cur_event->sysex, cur_event->len);
-                    }
+                    lsgWrite(cur_event.data, cur_event.len);
                 }
 
-                cur_event++;
-                remaining_events--;
+                more_events = midi_event_next(&cur_event);
             }
 
             current_time = next_time;
 
+#if PCM_TOOL == PCM_CONVERT_INTERNAL
+            // original dll doesn't support fast-forward, the output before the seek start is only discarded
+            if (seek_start != 0)
+            {
+                VLSG_SetParameter(PARAMETER_FastForward, fast_forward_block(block_time));
+            }
+#endif
+
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
-            dll_functions.VLSG_FillOutputBuffer(outbuf_counter);
+            active_voices = dll_functions.VLSG_FillOutputBuffer(outbuf_counter);
 #endif
 #if PCM_TOOL == PCM_CONVERT_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL
-            VLSG_FillOutputBuffer(outbuf_counter);
+            active_voices = VLSG_FillOutputBuffer(outbuf_counter);
 #endif
 
+            // FillOutputBuffer returns the number of active voices
+            if (tail_length != 0)
+            {
+                tail_silent = (active_voices == 0) && is_silent_output(midi_buf[outbuf_counter & 0x0f], bytes_per_call);
+            }
+
 #if PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
             if (fread(midi_buf2[outbuf_counter & 0x0f], 1, bytes_per_call, fpipe) != bytes_per_call)
             {
@@ -726,21 +1423,7 @@ int main(int argc, char *argv[])
 
 
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
-#ifdef BIG_ENDIAN_BYTE_ORDER
-            // swap values to little-endian
-            {
-                int i;
-                for (i = 0; i < bytes_per_call; i += 2)
-                {
-                    uint8_t value;
-                    value = midi_buf[outbuf_counter & 0x0f][i];
-                    midi_buf[outbuf_counter & 0x0f][i] = midi_buf[outbuf_counter & 0x0f][i + 1];
-                    midi_buf[outbuf_counter & 0x0f][i + 1] = value;
-                }
-            }
-#endif
-
-            if (fwrite(midi_buf[outbuf_counter & 0x0f], 1, bytes_per_call, fout) != bytes_per_call)
+            if ((block_time >= seek_start) && (pcm_writer_write(fout, midi_buf[outbuf_counter & 0x0f], bytes_per_call) != 0))
             {
                 fprintf(stderr, "error writing to output file\n");
                 return_value = 6;
@@ -770,34 +1453,10 @@ int main(int argc, char *argv[])
         }
 
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_CONVERT_INTERNAL
-        if (wav_to_file)
-        {
-            uint8_t chunk_length[4];
-
-            // RIFF length
-            WRITE_LE_UINT32(chunk_length, 36 + num_calls * bytes_per_call);
-            fseek(fout, 4, SEEK_SET);
-            if (fwrite(chunk_length, 4, 1, fout) != 1)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 6;
-            }
-
-            // data chunk length
-            WRITE_LE_UINT32(chunk_length, num_calls * bytes_per_call);
-            fseek(fout, 40, SEEK_SET);
-            if (fwrite(chunk_length, 4, 1, fout) != 1)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 6;
-            }
-
-            fclose(fout);
-        }
-        else
+        if ((pcm_writer_close(fout) != 0) && (return_value == 0))
         {
-            fflush(fout);
-            fout = NULL;
+            fprintf(stderr, "error writing to output file\n");
+            return 6;
         }
 #endif
 
@@ -820,7 +1479,7 @@ int main(int argc, char *argv[])
 #endif
 
     // free MIDI file, ROM file, dll
-    free_midi_data(midi_events);
+    close_midi_parser(midi_file);
     free(rom_address);
 #if PCM_TOOL == PCM_CONVERT_DLL || PCM_TOOL == PCM_COMPARE_DLL_INTERNAL || PCM_TOOL == PCM_COMPARE_DLL_EXTERNAL
     free_vlsg_dll(hVLSG);
@@ -0,0 +1,650 @@
+/**
+ *
+ *  Copyright (C) 2022-2025 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+// Replays session log recorded by sw10_alsadrv (option -L) at full speed.
+// The synthesizers get the same MIDI data, the same time values and render the same blocks as in the recorded session,
+// so the output is bit-exact (checked using the block checksums) and the render times can be compared.
+
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "VLSG.h"
+#include "sw10_session.h"
+
+#define MAX_SYNTHS 8
+#define MAX_TIME_VALUES 64
+#define SLOWEST_BLOCKS 5
+
+typedef struct
+{
+    VLSG_Instance *instance;
+    uint8_t *buffer;
+    uint32_t time_values[MAX_TIME_VALUES];
+    unsigned int time_read, time_write;
+    uint32_t last_time;
+} replay_synth;
+
+typedef struct
+{
+    uint32_t counter;
+    uint32_t recorded_time;
+    uint32_t replay_time;
+} block_time;
+
+
+static const char *arg_input = NULL;
+static const char *arg_output = NULL;
+static const char *arg_rom = "ROMSXGM.BIN";
+static int verbose;
+
+static uint8_t *session_data;
+static size_t session_size;
+static sw10_session_header header;
+static uint8_t *rom_address;
+static replay_synth synths[MAX_SYNTHS];
+static unsigned int bytes_per_call;
+
+static uint32_t num_blocks, num_mismatches, num_time_errors;
+static uint64_t total_recorded_time, total_replay_time;
+static uint32_t max_recorded_time, max_replay_time;
+static block_time slowest_blocks[SLOWEST_BLOCKS];
+
+
+static void WRITE_LE_UINT16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+}
+
+static void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+    ptr[2] = (value >> 16) & 0xff;
+    ptr[3] = (value >> 24) & 0xff;
+}
+
+static int64_t get_time_ns(void)
+{
+    struct timespec _tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &_tp);
+
+    return ((int64_t)_tp.tv_sec * 1000000000) + _tp.tv_nsec;
+}
+
+// returns the recorded time values in the recorded order
+static uint32_t replay_get_time(void *context)
+{
+    replay_synth *synth;
+
+    synth = (replay_synth *)context;
+    if (synth->time_read == synth->time_write)
+    {
+        // the log doesn't match the synthesizer
+        num_time_errors++;
+        return synth->last_time;
+    }
+
+    synth->last_time = synth->time_values[synth->time_read % MAX_TIME_VALUES];
+    synth->time_read++;
+    return synth->last_time;
+}
+
+static void *load_file(const char *filename, size_t *size)
+{
+    FILE *f;
+    void *mem;
+    long length;
+
+    f = fopen(filename, "rb");
+    if (f == NULL) return NULL;
+
+    if ((fseek(f, 0, SEEK_END) != 0) || ((length = ftell(f)) < 0) || (fseek(f, 0, SEEK_SET) != 0))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    mem = malloc(length + 1);
+    if (mem == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(mem, 1, length, f) != (size_t)length)
+    {
+        free(mem);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+    *size = length;
+    return mem;
+}
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "sw10_replay";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - replay session log of CASIO Software Sound Generator SW-10 driver\n"
+        "Usage: %s [OPTIONS]...\n"
+        "  -i PATH  Input path (session log recorded by sw10_alsadrv -L)\n"
+        "  -r PATH  Rom path (path to ROMSXGM.BIN)\n"
+        "  -o PATH  Output path (path to .wav, time when the output was suspended isn't included)\n"
+        "  -v       Print every block\n"
+        "  -h       Help\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+static void read_arguments(int argc, char *argv[])
+{
+    int i;
+
+    verbose = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'i': // input
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_input = argv[i];
+                    }
+                    break;
+                case 'o': // output
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_output = argv[i];
+                    }
+                    break;
+                case 'r': // rom
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_rom = argv[i];
+                    }
+                    break;
+                case 'v': // verbose
+                    verbose = 1;
+                    break;
+                case 'h':
+                default:
+                    usage(argv[0]);
+                    break;
+            }
+        }
+    }
+
+    if (arg_input == NULL)
+    {
+        usage(argv[0]);
+    }
+}
+
+static int start_synths(void)
+{
+    unsigned int index;
+
+    for (index = 0; index < header.num_synths; index++)
+    {
+        synths[index].instance = VLSG_CreateInstance();
+        synths[index].buffer = (uint8_t *) calloc(1, 65536);
+        if ((synths[index].instance == NULL) || (synths[index].buffer == NULL))
+        {
+            fprintf(stderr, "error allocating synthesizer\n");
+            return -1;
+        }
+
+        // same configuration as in sw10_alsadrv
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_Frequency, header.frequency);
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_Polyphony, 0x10 + header.polyphony);
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_Effect, 0x20 + header.reverb_effect);
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_ROMAddress, (uintptr_t)rom_address);
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_OutputBuffer, (uintptr_t)synths[index].buffer);
+        VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_EventDelay, header.event_delay);
+        if (!VLSG_InstanceSetParameter(synths[index].instance, PARAMETER_SubBlocks, header.sub_blocks))
+        {
+            fprintf(stderr, "error setting number of sub-blocks: %u\n", header.sub_blocks);
+            return -2;
+        }
+        VLSG_InstanceSetFunc_GetTime(synths[index].instance, &replay_get_time, &(synths[index]));
+
+        VLSG_InstancePlaybackStart(synths[index].instance);
+    }
+
+    bytes_per_call = 4 * (64 << header.frequency) * header.sub_blocks;
+
+    return 0;
+}
+
+static void stop_synths(void)
+{
+    unsigned int index;
+
+    for (index = 0; index < header.num_synths; index++)
+    {
+        if (synths[index].instance != NULL)
+        {
+            VLSG_InstancePlaybackStop(synths[index].instance);
+            VLSG_DestroyInstance(synths[index].instance);
+        }
+        free(synths[index].buffer);
+    }
+}
+
+// returns pointer to the next record or NULL at the end of the log
+static const sw10_session_record *next_record(size_t *offset)
+{
+    const sw10_session_record *record;
+
+    if (*offset + sizeof(sw10_session_record) > session_size)
+    {
+        return NULL;
+    }
+
+    record = (const sw10_session_record *)(session_data + *offset);
+    if (*offset + sizeof(sw10_session_record) + record->length > session_size)
+    {
+        return NULL;
+    }
+
+    *offset += sizeof(sw10_session_record) + record->length;
+    return record;
+}
+
+static void add_midi_data(const sw10_session_record *record)
+{
+    if (record->synth < header.num_synths)
+    {
+        VLSG_InstanceAddMidiData(synths[record->synth].instance, (const uint8_t *)(record + 1), record->length);
+    }
+}
+
+static void record_block_time(uint32_t counter, uint32_t recorded_time, uint32_t replay_time)
+{
+    int index;
+
+    total_recorded_time += recorded_time;
+    total_replay_time += replay_time;
+    if (recorded_time > max_recorded_time) max_recorded_time = recorded_time;
+    if (replay_time > max_replay_time) max_replay_time = replay_time;
+
+    // keep the slowest recorded blocks sorted from the slowest
+    for (index = SLOWEST_BLOCKS; (index > 0) && (recorded_time > slowest_blocks[index - 1].recorded_time); index--)
+    {
+        if (index < SLOWEST_BLOCKS)
+        {
+            slowest_blocks[index] = slowest_blocks[index - 1];
+        }
+    }
+
+    if (index < SLOWEST_BLOCKS)
+    {
+        slowest_blocks[index].counter = counter;
+        slowest_blocks[index].recorded_time = recorded_time;
+        slowest_blocks[index].replay_time = replay_time;
+    }
+}
+
+// renders one block, returns offset of the record after the block or 0 when the block is incomplete
+static size_t replay_block(size_t offset, uint32_t counter, FILE *fout)
+{
+    const sw10_session_record *record;
+    size_t block_offset;
+    uint32_t block_end[3], checksum, replay_time;
+    unsigned int index, sample;
+    int32_t value;
+    int16_t *output_ptr;
+    int64_t start_time;
+
+    // time values are needed during the block, MIDI data was written while the block was rendered
+    block_offset = offset;
+    while (1)
+    {
+        record = next_record(&offset);
+        if ((record == NULL) || (record->type == SW10_SESSION_BLOCK) || (record->type == SW10_SESSION_END))
+        {
+            return 0;
+        }
+
+        if (record->type == SW10_SESSION_BLOCK_END) break;
+
+        if ((record->type == SW10_SESSION_TIME) && (record->synth < header.num_synths) && (record->length == 4))
+        {
+            replay_synth *synth = &(synths[record->synth]);
+
+            if (synth->time_write - synth->time_read < MAX_TIME_VALUES)
+            {
+                memcpy(&(synth->time_values[synth->time_write % MAX_TIME_VALUES]), record + 1, 4);
+                synth->time_write++;
+            }
+        }
+    };
+
+    if (record->length != sizeof(block_end))
+    {
+        return 0;
+    }
+    memcpy(block_end, record + 1, sizeof(block_end));
+
+    start_time = get_time_ns();
+
+    for (index = 0; index < header.num_synths; index++)
+    {
+        VLSG_InstanceFillOutputBuffer(synths[index].instance, counter);
+    }
+
+    // mix output of other synthesizers into the output of the first synthesizer
+    output_ptr = (int16_t *)&(synths[0].buffer[(counter & 15) * bytes_per_call]);
+    if (header.num_synths > 1)
+    {
+        for (sample = 0; sample < bytes_per_call / 2; sample++)
+        {
+            value = output_ptr[sample];
+            for (index = 1; index < header.num_synths; index++)
+            {
+                value += ((const int16_t *)&(synths[index].buffer[(counter & 15) * bytes_per_call]))[sample];
+            }
+
+            if (value > 32767) value = 32767;
+            else if (value < -32768) value = -32768;
+
+            output_ptr[sample] = value;
+        }
+    }
+
+    replay_time = (get_time_ns() - start_time) / 1000;
+
+    checksum = sw10_session_checksum(SW10_SESSION_CHECKSUM_INIT, output_ptr, bytes_per_call);
+    if (checksum != block_end[2])
+    {
+        if (num_mismatches == 0)
+        {
+            fprintf(stderr, "first mismatch in block %u (block counter %u)\n", num_blocks, counter);
+        }
+        num_mismatches++;
+    }
+
+    if (verbose)
+    {
+        printf("block %u: counter %u, recorded %u us, replay %u us%s\n", num_blocks, counter, block_end[1], replay_time, (checksum != block_end[2]) ? ", mismatch" : "");
+    }
+
+    record_block_time(counter, block_end[1], replay_time);
+    num_blocks++;
+
+    if (fout != NULL)
+    {
+        if (fwrite(output_ptr, 1, bytes_per_call, fout) != bytes_per_call)
+        {
+            fprintf(stderr, "error writing to output file\n");
+            fclose(fout);
+            exit(6);
+        }
+    }
+
+    // MIDI data written during the block
+    while (1)
+    {
+        record = next_record(&block_offset);
+        if (record->type == SW10_SESSION_BLOCK_END) break;
+
+        if (record->type == SW10_SESSION_MIDI)
+        {
+            add_midi_data(record);
+        }
+    };
+
+    return offset;
+}
+
+static int write_wav_header(FILE *fout, uint32_t data_length)
+{
+    uint8_t wav_header[44], *header_ptr;
+
+    // wav header
+    header_ptr = wav_header;
+    WRITE_LE_UINT32(header_ptr, 0x46464952);        // "RIFF" tag
+    WRITE_LE_UINT32(header_ptr + 4, 36 + data_length);  // RIFF length
+    WRITE_LE_UINT32(header_ptr + 8, 0x45564157);    // "WAVE" tag
+    header_ptr += 12;
+
+    // fmt chunk
+    WRITE_LE_UINT32(header_ptr, 0x20746D66);    // "fmt " tag
+    WRITE_LE_UINT32(header_ptr + 4, 16);        // chunk length
+    header_ptr += 8;
+
+    // PCMWAVEFORMAT structure
+    WRITE_LE_UINT16(header_ptr, 1);                                     // wFormatTag - 1 = PCM
+    WRITE_LE_UINT16(header_ptr + 2, 2);                                 // nChannels - 2 = stereo
+    WRITE_LE_UINT32(header_ptr + 4, 11025 << header.frequency);         // nSamplesPerSec
+    WRITE_LE_UINT32(header_ptr + 8, 4 * (11025 << header.frequency));   // nAvgBytesPerSec
+    WRITE_LE_UINT16(header_ptr + 12, 4);                                // nBlockAlign
+    WRITE_LE_UINT16(header_ptr + 14, 16);                               // wBitsPerSample
+    header_ptr += 16;
+
+    // data chunk
+    WRITE_LE_UINT32(header_ptr, 0x61746164);    // "data" tag
+    WRITE_LE_UINT32(header_ptr + 4, data_length);   // chunk length
+    header_ptr += 8;
+
+    fseek(fout, 0, SEEK_SET);
+    if (fwrite(wav_header, 1, 44, fout) != 44)
+    {
+        fprintf(stderr, "error writing to output file\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void print_summary(void)
+{
+    int index;
+
+    printf("blocks: %u, mismatched blocks: %u, time errors: %u\n", num_blocks, num_mismatches, num_time_errors);
+    if (num_blocks == 0) return;
+
+    printf("recorded render time: average %u us, maximum %u us\n", (uint32_t)(total_recorded_time / num_blocks), max_recorded_time);
+    printf("replay render time: average %u us, maximum %u us\n", (uint32_t)(total_replay_time / num_blocks), max_replay_time);
+
+    printf("slowest recorded blocks:\n");
+    for (index = 0; (index < SLOWEST_BLOCKS) && (index < (int)num_blocks); index++)
+    {
+        printf("  counter %u: recorded %u us, replay %u us\n", slowest_blocks[index].counter, slowest_blocks[index].recorded_time, slowest_blocks[index].replay_time);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *end_reasons[3] = { "exit", "reconfiguration", "log overflow" };
+    const sw10_session_record *record;
+    size_t offset, rom_size, next_offset;
+    uint32_t value;
+    FILE *fout;
+    int ended;
+
+    read_arguments(argc, argv);
+
+    session_data = (uint8_t *) load_file(arg_input, &session_size);
+    if (session_data == NULL)
+    {
+        fprintf(stderr, "error reading input file: %s\n", arg_input);
+        return 2;
+    }
+
+    if ((session_size < sizeof(header)) || (memcmp(session_data, SW10_SESSION_MAGIC, 8) != 0))
+    {
+        fprintf(stderr, "not a session log: %s\n", arg_input);
+        return 2;
+    }
+
+    memcpy(&header, session_data, sizeof(header));
+    if (header.version == 1)
+    {
+        // logs written before the event delay was configurable
+        header.event_delay = 100;
+    }
+    else if (header.version != SW10_SESSION_VERSION)
+    {
+        fprintf(stderr, "unsupported session log: %s\n", arg_input);
+        return 2;
+    }
+
+    if ((header.event_delay > 1000) || (header.frequency > 2) || (header.polyphony > 3) || (header.reverb_effect > 2) || (header.num_synths == 0) || (header.num_synths > MAX_SYNTHS))
+    {
+        fprintf(stderr, "unsupported session log: %s\n", arg_input);
+        return 2;
+    }
+
+    rom_address = (uint8_t *) load_file(arg_rom, &rom_size);
+    if ((rom_address == NULL) || (rom_size < 2 * 1024 * 1024))
+    {
+        fprintf(stderr, "error reading rom file: %s\n", arg_rom);
+        return 3;
+    }
+
+    // replay with a different ROM isn't bit-exact
+    if (sw10_session_checksum(SW10_SESSION_CHECKSUM_INIT, rom_address, 2 * 1024 * 1024) != header.rom_checksum)
+    {
+        fprintf(stderr, "warning: rom file differs from the recorded session\n");
+    }
+
+    if (start_synths() < 0)
+    {
+        stop_synths();
+        return 4;
+    }
+
+    fout = NULL;
+    if (arg_output != NULL)
+    {
+        fout = fopen(arg_output, "wb");
+        if ((fout == NULL) || (write_wav_header(fout, 0) < 0))
+        {
+            fprintf(stderr, "error opening output file: %s\n", arg_output);
+            stop_synths();
+            return 5;
+        }
+    }
+
+    printf("session: %i Hz, %u synthesizer(s), %u sub-blocks per block, event delay %u ms\n", 11025 << header.frequency, header.num_synths, header.sub_blocks, header.event_delay);
+
+    ended = 0;
+    offset = sizeof(header);
+    while (!ended)
+    {
+        record = next_record(&offset);
+        if (record == NULL)
+        {
+            printf("session log ends without end record\n");
+            break;
+        }
+
+        switch (record->type)
+        {
+            case SW10_SESSION_MIDI:
+                add_midi_data(record);
+                break;
+            case SW10_SESSION_BLOCK:
+                if (record->length != 4)
+                {
+                    printf("session log ends with incomplete block\n");
+                    ended = 1;
+                    break;
+                }
+                memcpy(&value, record + 1, 4);
+                next_offset = replay_block(offset, value, fout);
+                if (next_offset == 0)
+                {
+                    printf("session log ends with incomplete block\n");
+                    ended = 1;
+                }
+                offset = next_offset;
+                break;
+            case SW10_SESSION_END:
+                if (record->length != 4)
+                {
+                    printf("session log ends without end record\n");
+                    ended = 1;
+                    break;
+                }
+                memcpy(&value, record + 1, 4);
+                printf("session ended by %s\n", (value <= SW10_SESSION_END_OVERFLOW) ? end_reasons[value] : "unknown reason");
+                ended = 1;
+                break;
+            default:
+                // time values outside of blocks aren't used by the synthesizers
+                break;
+        }
+    };
+
+    print_summary();
+
+    if (fout != NULL)
+    {
+        if (write_wav_header(fout, num_blocks * bytes_per_call) < 0)
+        {
+            fclose(fout);
+            stop_synths();
+            return 6;
+        }
+        fclose(fout);
+    }
+
+    stop_synths();
+
+    return (num_mismatches != 0) ? 7 : 0;
+}